@@ -0,0 +1,85 @@
+#!/usr/bin/python
+
+import mmap
+import os
+import struct
+import time
+
+""" ADXL335 accelerometer
+
+                scripts/read_accel samples the three axes through the ADC bridge
+                at a fixed rate, low-pass filters and decimates them, and publishes
+                the records to a ring in /dev/shm/hab_accel (layout in
+                scripts/accel.h).  This reads the newest record from that ring, so
+                the flight software never puts the accelerometer on its own I2C
+                schedule.
+"""
+
+ACCEL_SHM_PATH = '/dev/shm/hab_accel'
+ACCEL_MAGIC = 0x41434331                # 'ACC1'
+ACCEL_RING_SIZE = 1024
+
+HEADER = struct.Struct('<8I')           # magic size raw_hz output_hz overruns errors head reserved
+RECORD = struct.Struct('<Q12fII')       # timestamp g[3] min[3] max[3] rms[3] samples reserved
+HEAD_OFFSET = 24
+RING_BYTES = HEADER.size + ACCEL_RING_SIZE * RECORD.size
+
+class ADXL335:
+    def __init__(self, path=ACCEL_SHM_PATH, staleAfter=5):
+        """ staleAfter: seconds without a new record before read() gives up on the sampler """
+        self.path = path
+        self.staleAfter = staleAfter
+        self.shm = None
+        self.lastHead = None
+        self.lastChange = 0
+
+    def _open(self):
+        try:
+            fd = os.open(self.path, os.O_RDONLY)
+        except OSError:
+            return False
+        try:
+            if os.fstat(fd).st_size < RING_BYTES:
+                return False
+            shm = mmap.mmap(fd, RING_BYTES, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        (magic, size) = HEADER.unpack_from(shm, 0)[:2]
+        if magic != ACCEL_MAGIC or size != ACCEL_RING_SIZE:
+            shm.close()
+            return False
+        self.shm = shm
+        return True
+
+    def isavailable(self):
+        return self.shm is not None or self._open()
+
+    def stats(self):
+        """ the sampler's rates and error counters, None if it isn't running """
+        if not self.isavailable():
+            return None
+        (magic, size, rawHz, outputHz, overruns, errors, head, reserved) = HEADER.unpack_from(self.shm, 0)
+        return {'rawHz': rawHz, 'outputHz': outputHz, 'overruns': overruns, 'errors': errors, 'records': head}
+
+    def read(self):
+        """ the newest record as a dict of 'g', 'min', 'max', 'rms' (x,y,z tuples in g)
+        and 'samples'; None if there is no sampler or it has stopped publishing """
+        if not self.isavailable():
+            return None
+        while True:
+            head = struct.unpack_from('<I', self.shm, HEAD_OFFSET)[0]
+            if head == 0:
+                return None
+            offset = HEADER.size + ((head - 1) % ACCEL_RING_SIZE) * RECORD.size
+            values = RECORD.unpack_from(self.shm, offset)
+            """ the slot is only reused a whole ring later; retry if that happened under us """
+            if (struct.unpack_from('<I', self.shm, HEAD_OFFSET)[0] - head) & 0xffffffff < ACCEL_RING_SIZE - 1:
+                break
+        now = time.time()
+        if head != self.lastHead:
+            self.lastHead = head
+            self.lastChange = now
+        elif now - self.lastChange > self.staleAfter:
+            return None
+        return {'g': values[1:4], 'min': values[4:7], 'max': values[7:10], 'rms': values[10:13],
+                'samples': values[13]}
@@ -9,5 +9,8 @@ class ADC:
 		self.address = address
 		
 	def readChannel(self, channel):
+		""" 10 bit conversion, sent low byte first; -1 if the bus read failed """
 		val_list = self.i2c.readList(channel,2)
-		return val_list[0] + val_list[1]**8
\ No newline at end of file
+		if val_list == -1:
+			return -1
+		return val_list[0] | (val_list[1] << 8)
\ No newline at end of file
@@ -1,6 +1,7 @@
 #!/usr/bin/python
 
 import time
+import struct
 from protocols import i2c
 
 # ===========================================================================
@@ -64,7 +65,15 @@ class BMP085:
         self.readCalibrationData()
   
     def readCalibrationData(self):
-        "Reads the calibration data from the IC"
+        "Reads the calibration data from the IC, all eleven words in one block read"
+        block = self.i2c.readList(self.__BMP085_CAL_AC1, 22)
+        if isinstance(block, list) and len(block) == 22:
+            (self._cal_AC1, self._cal_AC2, self._cal_AC3, self._cal_AC4, self._cal_AC5, self._cal_AC6,
+             self._cal_B1, self._cal_B2, self._cal_MB, self._cal_MC, self._cal_MD) = \
+                struct.unpack('>hhhHHHhhhhh', str(bytearray(block)))
+            if (self.debug):
+                self.showCalibrationData()
+            return
         self._cal_AC1 = self.i2c.readS16(self.__BMP085_CAL_AC1)   # INT16
         self._cal_AC2 = self.i2c.readS16(self.__BMP085_CAL_AC2)   # INT16
         self._cal_AC3 = self.i2c.readS16(self.__BMP085_CAL_AC3)   # INT16
@@ -121,74 +130,24 @@ class BMP085:
             print "DBG: Raw Pressure: 0x%04X (%d)" % (raw & 0xFFFF, raw)
         return raw
   
-    def readTemperature(self):
-        """Gets the compensated temperature in degrees celcius"""
-        UT = 0
-        X1 = 0
-        X2 = 0
-        B5 = 0
-        temp = 0.0
-    
-        # Read raw temp before aligning it with the calibration values
-        UT = self.readRawTemp()
-        X1 = ((UT - self._cal_AC6) * self._cal_AC5) >> 15
-        X2 = (self._cal_MC << 11) / (X1 + self._cal_MD)
-        B5 = X1 + X2
-        temp = ((B5 + 8) >> 4) / 10.0
-        if (self.debug):
-            print "DBG: Calibrated temperature = %f C" % temp
-        return temp
-  
-    def readPressure(self):
-        """Gets the compensated pressure in pascal"""
-        UT = 0
-        UP = 0
-        B3 = 0
-        B5 = 0
-        B6 = 0
-        X1 = 0
-        X2 = 0
-        X3 = 0
-        p = 0
-        B4 = 0
-        B7 = 0
-    
-        UT = self.readRawTemp()
-        UP = self.readRawPressure()
-    
-        # You can use the datasheet values to test the conversion results
-        # dsValues = True
-        dsValues = False
-    
-        if (dsValues):
-            UT = 27898
-            UP = 23843
-            self._cal_AC6 = 23153
-            self._cal_AC5 = 32757
-            self._cal_MC = -8711
-            self._cal_MD = 2868
-            self._cal_B1 = 6190
-            self._cal_B2 = 4
-            self._cal_AC3 = -14383
-            self._cal_AC2 = -72
-            self._cal_AC1 = 408
-            self._cal_AC4 = 32741
-            self.mode = self.__BMP085_ULTRALOWPOWER
-            if (self.debug):
-                  self.showCalibrationData()
-    
+    def _compensate(self, UT, UP=None):
+        """Datasheet integer compensation of a raw temperature and, if given, a
+        raw pressure taken with it; returns (temperature C, pressure Pa or None)"""
         # True Temperature Calculations
         X1 = ((UT - self._cal_AC6) * self._cal_AC5) >> 15
         X2 = (self._cal_MC << 11) / (X1 + self._cal_MD)
         B5 = X1 + X2
+        temp = ((B5 + 8) >> 4) / 10.0
         if (self.debug):
             debugDict = {'X1' : X1, 'X2' : X2, 'B5' : B5}
             self._printDebugDictionary(debugDict)
-            print "DBG: True Temperature = %.2f C" % (((B5 + 8) >> 4) / 10.0)
+            print "DBG: True Temperature = %.2f C" % temp
+        if (UP is None):
+            return (temp, None)
     
         # Pressure Calculations
         B6 = B5 - 4000
-        X1 = (self._cal_B2 * (B6 * B6) >> 12) >> 11
+        X1 = (self._cal_B2 * ((B6 * B6) >> 12)) >> 11
         X2 = (self._cal_AC2 * B6) >> 11
         X3 = X1 + X2
         B3 = (((self._cal_AC1 * 4 + X3) << self.mode) + 2) / 4
@@ -212,7 +171,7 @@ class BMP085:
     
         X1 = (p >> 8) * (p >> 8)
         X1 = (X1 * 3038) >> 16
-        X2 = (-7375 * p) >> 16
+        X2 = (-7357 * p) >> 16
         if (self.debug):
             debugDict = {'X1' : X1, 'X2' : X2, 'p':p}
             self._printDebugDictionary(debugDict)
@@ -220,9 +179,53 @@ class BMP085:
         p = p + ((X1 + X2 + 3791) >> 4)
         if (self.debug):
             print "DBG: Pressure = %d Pa" % (p)
+        return (temp, p)
+  
+    def readTemperature(self):
+        """Gets the compensated temperature in degrees celcius"""
+        (temp, p) = self._compensate(self.readRawTemp())
+        return temp
+  
+    def readPressure(self):
+        """Gets the compensated pressure in pascal"""
+        UT = self.readRawTemp()
+        UP = self.readRawPressure()
     
+        # You can use the datasheet values to test the conversion results
+        # dsValues = True
+        dsValues = False
+    
+        if (dsValues):
+            UT = 27898
+            UP = 23843
+            self._cal_AC6 = 23153
+            self._cal_AC5 = 32757
+            self._cal_MC = -8711
+            self._cal_MD = 2868
+            self._cal_B1 = 6190
+            self._cal_B2 = 4
+            self._cal_AC3 = -14383
+            self._cal_AC2 = -72
+            self._cal_AC1 = 408
+            self._cal_AC4 = 32741
+            self.mode = self.__BMP085_ULTRALOWPOWER
+            if (self.debug):
+                  self.showCalibrationData()
+    
+        (temp, p) = self._compensate(UT, UP)
         return p
   
+    def readSample(self, seaLevelPressure=101325):
+        """Returns (temperature C, pressure Pa, altitude m) from a single
+        temperature + pressure conversion pair"""
+        UT = self.readRawTemp()
+        UP = self.readRawPressure()
+        (temp, p) = self._compensate(UT, UP)
+        altitude = 44330.0 * (1.0 - pow(float(p) / seaLevelPressure, 0.1903))
+        if (self.debug):
+            print "DBG: Sample = %.1f C %d Pa %.1f m" % (temp, p, altitude)
+        return (temp, p, altitude)
+
     def readAltitude(self, seaLevelPressure=101325):
         "Calculates the altitude in meters"
         altitude = 0.0
@@ -233,5 +236,5 @@ class BMP085:
         return altitude
     
     def _printDebugDictionary(self,dict):
-        for key,value in dict:
+        for key,value in dict.items():
             print "DBG | %s = %d" % (key,value)
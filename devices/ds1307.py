@@ -1,7 +1,8 @@
 #!/usr/bin/python
 
-import os
+import datetime
 from protocols import i2c
+from services.scheduler import monotonic
 
 DS1307_SECONDS  = 0x00
 DS1307_MINUTES  = 0x01
@@ -12,42 +13,102 @@ DS1307_MONTH    = 0x05
 DS1307_YEAR     = 0x06
 DS1307_CONTROL  = 0x07
 
-CH              = (1<<7)
+CH              = (1<<7)        # clock halt: set, the oscillator is stopped
+HOUR_12         = (1<<6)
+HOUR_PM         = (1<<5)
 
 class RTCMode:
     (H12,H24) = range(2)
 
+def decimalToBCD(dec):
+    return ((dec / 10) << 4) | (dec % 10)
+
+def bcdToDecimal(bcd):
+    return (bcd >> 4) * 10 + (bcd & 0x0F)
 
 class DS1307:
-    def __init__(self):
+    """ The clock holds UTC.  All seven time registers are read in one block
+    transfer, so they come from the DS1307's buffered copy and can't tear across
+    a rollover.  now() serves a cached reading advanced on the monotonic clock and
+    only goes back to the chip every maxAge seconds; scripts/rtc_sync sets the
+    system clock from the RTC at boot. """
+
+    def __init__(self, maxAge=300):
         self.i2c = i2c.I2C(address= 0x68)
-        seconds = self.i2c.readU8(DS1307_SECONDS)
-        //  start the oscillator
-        seconds |= CH
-        self.i2c.write8(DS1307_SECONDS,control)
-        
-        h = self.i2c.readU8(DS1307_HOURS)
-        if h & (1<<6):
+        self.maxAge = maxAge
+        self.cached = None
+        self.cachedAt = 0
+        self.mode = RTCMode.H24
+
+        regs = self.readRegisters()
+        if regs is None:
+            return
+        if regs[DS1307_SECONDS] & CH:
+            """ start the oscillator; the time it holds is stale until it is set """
+            print "WARN | DS1307 oscillator was halted"
+            self.i2c.write8(DS1307_SECONDS,regs[DS1307_SECONDS] & ~CH)
+        if regs[DS1307_HOURS] & HOUR_12:
             self.mode = RTCMode.H12
-         else:
-            self.mode = RTCMode.H24
-        
+
+    def readRegisters(self):
+        """ the seven time registers, or None if the bus read failed """
+        regs = self.i2c.readList(DS1307_SECONDS,7)
+        if regs == -1:
+            return None
+        return regs
+
+    def readTime(self):
+        """ the RTC time as a naive UTC datetime, None if unreadable, halted or invalid """
+        regs = self.readRegisters()
+        if regs is None or regs[DS1307_SECONDS] & CH:
+            return None
+        hours = regs[DS1307_HOURS]
+        if hours & HOUR_12:
+            hour = bcdToDecimal(hours & 0x1F) % 12
+            if hours & HOUR_PM:
+                hour += 12
+        else:
+            hour = bcdToDecimal(hours & 0x3F)
+        try:
+            return datetime.datetime(2000 + bcdToDecimal(regs[DS1307_YEAR]),
+                                     bcdToDecimal(regs[DS1307_MONTH] & 0x1F),
+                                     bcdToDecimal(regs[DS1307_DATE] & 0x3F),
+                                     hour,
+                                     bcdToDecimal(regs[DS1307_MINUTES] & 0x7F),
+                                     bcdToDecimal(regs[DS1307_SECONDS] & 0x7F))
+        except ValueError:
+            return None
+
+    def now(self):
+        """ current RTC time from the cache, re-reading the chip when it is older than maxAge """
+        age = monotonic() - self.cachedAt
+        if self.cached is None or age > self.maxAge:
+            stamp = self.readTime()
+            if stamp is None:
+                return None
+            self.cached = stamp
+            self.cachedAt = monotonic()
+            age = 0
+        return self.cached + datetime.timedelta(seconds=age)
+
     def setMode(self, aMode):
         self.mode = aMode;
         h = self.i2c.readU8(DS1307_HOURS)
         if self.mode == RTCMode.H12:
-            h |= (1<<6)
+            h |= HOUR_12
         else:
-            h &= ~(1<<6)
+            h &= ~HOUR_12
         self.i2c.write8(DS1307_HOURS,h)
-        
-    def setTime(self,h,m,s):
-        self.i2c.write8(DS1307_SECONDS,self.decimalToBCD(h) | CH)
-        self.i2c.write8(DS1307_MINUTES,self.decimalToBCD(m))
-        self.i2c.write8(DS1307_HOURS,self.decimalToBCD(h) & (1<<6))
-         
-    def decimalToBCD(self,dec):
-        msb = dec / 10
-        lsb = dec - 10 * msb
-        return (msb << 4) | lsb
-        
\ No newline at end of file
+
+    def setTime(self, stamp):
+        """ set the RTC from a UTC datetime in one block write, 24 hour format; this
+        also clears the clock halt bit """
+        regs = [decimalToBCD(stamp.second), decimalToBCD(stamp.minute), decimalToBCD(stamp.hour),
+                stamp.isoweekday() % 7 + 1, decimalToBCD(stamp.day), decimalToBCD(stamp.month),
+                decimalToBCD(stamp.year % 100)]
+        if self.i2c.writeList(DS1307_SECONDS,regs) == -1:
+            return -1
+        self.mode = RTCMode.H24
+        self.cached = stamp
+        self.cachedAt = monotonic()
+        return 0
@@ -2,8 +2,25 @@
 
 import time
 from os import system
+from os import path
 from protocols import i2c
 
+W1_DEVICES_PATH = '/sys/bus/w1/devices'
+W1_MASTER_PATH = '/sys/bus/w1/devices/w1_bus_master1'
+CONVERSION_TIME = 0.75          # seconds, 12 bit resolution
+CONVERSION_POLL = 0.05
+
+_modulesLoaded = False
+
+def loadModules():
+    """ load the 1-Wire GPIO master and thermometer drivers, once per process """
+    global _modulesLoaded
+    if _modulesLoaded:
+        return
+    system('sudo modprobe w1-gpio')
+    system('sudo modprobe w1-therm')
+    _modulesLoaded = True
+
 class DS18XXFamily:
     (DS18B20,DS1822) = range(2)
     
@@ -17,10 +34,9 @@ class DS18XX:
         else:
             print "ERROR"
             return
-        self.path = """/sys/bus/w1/devices/%s-%s/w1_slave""" % (familyCode,serial)
+        self.path = """%s/%s-%s/w1_slave""" % (W1_DEVICES_PATH,familyCode,serial)
         
-        system('sudo modprobe w1-gpio')
-        system('sudo modprobe w1-therm')
+        loadModules()
     
     def read(self):
         tempFile = open(self.path)
@@ -30,4 +46,76 @@ class DS18XX:
         temperatureData = tempText.split("\n")[1].split(" ")[9]
         temperature = float(temperatureData[2:]) / 1000.0
         
-        return temperature
\ No newline at end of file
+        return temperature
+
+class DS18XXBus:
+    """ all the thermometers on one bus master, converted together
+
+    Writing 'trigger' to the master's therm_bulk_read sends one Skip ROM +
+    Convert T, so every sensor converts at once; reading each w1_slave
+    afterwards returns that conversion's scratchpad instead of starting a
+    new one.  Kernels without therm_bulk_read fall back to one conversion
+    per sensor.
+    """
+    def __init__(self, sensors, master=W1_MASTER_PATH):
+        loadModules()
+        self.sensors = sensors
+        self.bulkPath = '%s/therm_bulk_read' % master
+        self.conversions = 0
+        self.timeouts = 0
+
+    def bulkAvailable(self):
+        return path.exists(self.bulkPath)
+
+    def _bulkStatus(self):
+        """ -1 while a conversion is running, 1 when done, 0 if none was triggered;
+        an unreadable status counts as done, since the full conversion time has passed """
+        try:
+            f = open(self.bulkPath)
+            try:
+                return int(f.read().strip())
+            finally:
+                f.close()
+        except (IOError, ValueError):
+            return 1
+
+    def convertAll(self):
+        """ start a conversion on every sensor; returns False if the kernel can't """
+        if not self.bulkAvailable():
+            return False
+        try:
+            f = open(self.bulkPath, 'w')
+            try:
+                f.write('trigger\n')
+            finally:
+                f.close()
+        except IOError, e:
+            print "WARN | 1-Wire bulk conversion failed: %s" % e
+            return False
+        self.conversions += 1
+        return True
+
+    def waitForConversion(self, timeout=2 * CONVERSION_TIME):
+        """ sleep through the conversion, then poll the status until it is done """
+        time.sleep(CONVERSION_TIME)
+        deadline = time.time() + timeout - CONVERSION_TIME
+        while self._bulkStatus() < 0:
+            if time.time() > deadline:
+                self.timeouts += 1
+                return False
+            time.sleep(CONVERSION_POLL)
+        return True
+
+    def readAll(self):
+        """ (timestamp, [temperature C per sensor, None where the read failed]) from one conversion """
+        if self.convertAll():
+            self.waitForConversion()
+        stamp = time.time()
+        temperatures = []
+        for sensor in self.sensors:
+            try:
+                temperatures.append(sensor.read())
+            except (IOError, IndexError, ValueError), e:
+                print "WARN | 1-Wire read of %s failed: %s" % (sensor.path, e)
+                temperatures.append(None)
+        return (stamp, temperatures)
\ No newline at end of file
@@ -1,9 +1,21 @@
 #!/usr/bin/env python
 
-import serial
+import errno
+import os
 import re
+import select
+import termios
+import threading
+import time
+from collections import deque
 from datetime import tzinfo, timedelta, datetime
 
+GPS_DEVICE = '/dev/ttyAMA0'
+GPS_VMIN = 64				# characters per wakeup when the GPS is talking
+GPS_POLL_TIMEOUT = 0.25		# seconds; collects the tail of a burst shorter than GPS_VMIN
+GPS_RING_SIZE = 64			# sentences
+GPS_MAX_SENTENCE = 128		# NMEA allows 82
+
 """ GPSMesage corresponds to an NMEA sentence """
 """	This class is not a full implementation of an NMEA parser
 	Rather, it is intended to parse key data from the following high altitude
@@ -47,9 +59,9 @@ class GPSMessage:
 	""" parse a ZDA message: date/time """
 	def _parseZDA(self):
 		rawTime = self.list[1]
-		hh = int(rawTime[0:1])
-		mm = int(rawTime[2:3])
-		ss = int(rawTime[4:5])
+		hh = int(rawTime[0:2])
+		mm = int(rawTime[2:4])
+		ss = int(rawTime[4:6])
 		
 		day = int(self.list[2])
 		month = int(self.list[3])
@@ -136,16 +148,155 @@ class GPSLongitude(GPSFixComponent):
 			return GPSFixComponent.value.fget(self)
 		
 class GPS:
-	def __init__(self):
-		self.port = serial.Serial("/dev/ttyAMA0", 4800, timeout=2.0)
+	""" Serial reader on its own thread
+
+		The tty is opened non-blocking in raw mode and the thread sleeps in
+		epoll until input arrives, so nothing else ever waits on the serial
+		port.  VMIN lets a wakeup cover a batch of characters rather than
+		one; at 4800 baud a full batch is ~130 ms.  After a read that got
+		data the thread waits with a timeout, to pick up the short tail at
+		the end of a burst; otherwise it sleeps until the GPS talks again.  Bytes are assembled
+		into sentences, checked against their NMEA checksum and appended to
+		a ring (a bounded deque, which is safe for one producer and one
+		consumer without a lock).  Each good GGA, VTG, RMC or ZDA updates
+		the latest state, published by swapping in a new dict, so latest()
+		is always a consistent copy.
+	"""
+	def __init__(self, device=GPS_DEVICE, baud=termios.B4800):
+		self.fd = os.open(device, os.O_RDONLY | os.O_NOCTTY | os.O_NONBLOCK)
+		attrs = termios.tcgetattr(self.fd)
+		attrs[0] = termios.IGNBRK | termios.IGNPAR					# iflag
+		attrs[1] = 0												# oflag
+		attrs[2] = termios.CS8 | termios.CREAD | termios.CLOCAL		# cflag
+		attrs[3] = 0												# lflag: no canonical mode, no echo
+		attrs[4] = attrs[5] = baud
+		attrs[6][termios.VMIN] = GPS_VMIN
+		attrs[6][termios.VTIME] = 0
+		termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+		termios.tcflush(self.fd, termios.TCIFLUSH)
+
+		self.ring = deque(maxlen=GPS_RING_SIZE)
 		self.lastMessage = None
-		
-	def readline(self):
-		gpsline = self.port.readline()
-		msg = GPSMessage(gpsline)
-		msg.parse()
+		self.time = None
+		self.state = {'sentences': 0, 'gga': None, 'vtg': None, 'time': None}
+		self.partial = ''
+		self.counters = {'bytes': 0, 'wakeups': 0, 'sentences': 0, 'checksumErrors': 0,
+					  'parseErrors': 0, 'overflows': 0}
+
+		(self.wakeRead, self.wakeWrite) = os.pipe()
+		self.running = True
+		self.thread = threading.Thread(target=self._run, name='gps')
+		self.thread.daemon = True
+		self.thread.start()
+
+	def latest(self):
+		""" the newest state: 'gga' is (stamp, latitude, longitude, altitude, quality, satellites),
+		'vtg' is (stamp, trueTrack, magneticTrack, knots), 'time' the last GPS UTC time; each is
+		None until its sentence has been seen.  stamp is time.time() on arrival. """
+		return self.state
+
+	def sentences(self):
+		""" take the raw sentences received since the last call, as (stamp, text) """
+		taken = []
+		while True:
+			try:
+				taken.append(self.ring.popleft())
+			except IndexError:
+				return taken
+
+	def stats(self):
+		return dict(self.counters)
+
+	def close(self, timeout=None):
+		self.running = False
+		os.write(self.wakeWrite, 'x')
+		self.thread.join(timeout)
+		os.close(self.fd)
+		os.close(self.wakeRead)
+		os.close(self.wakeWrite)
+
+	def _run(self):
+		poller = select.epoll()
+		poller.register(self.fd, select.EPOLLIN)
+		poller.register(self.wakeRead, select.EPOLLIN)
+		timeout = -1
+		while self.running:
+			poller.poll(timeout)
+			if not self.running:
+				break
+			self.counters['wakeups'] += 1
+			try:
+				data = os.read(self.fd, 1024)
+			except OSError, e:
+				if e.errno in (errno.EAGAIN, errno.EINTR):
+					timeout = -1
+					continue
+				print "ERROR | GPS serial read failed: %s" % e
+				time.sleep(1)
+				continue
+			if not data:
+				timeout = -1
+				continue
+			self.counters['bytes'] += len(data)
+			timeout = GPS_POLL_TIMEOUT
+			self._assemble(data)
+		poller.close()
+
+	def _assemble(self, data):
+		""" split the byte stream into sentences; a sentence starts at '$' and ends at a newline """
+		buf = self.partial + data
+		lines = buf.split('\n')
+		self.partial = lines.pop()
+		if len(self.partial) > GPS_MAX_SENTENCE:
+			""" no newline for too long: line noise, or the mux switched mid-sentence """
+			self.counters['overflows'] += 1
+			self.partial = ''
+		for line in lines:
+			start = line.rfind('$')
+			if start < 0:
+				continue
+			self._accept(line[start:].rstrip('\r'))
+
+	def _accept(self, text):
+		if not checksumValid(text):
+			self.counters['checksumErrors'] += 1
+			return
+		stamp = time.time()
+		self.counters['sentences'] += 1
+		self.ring.append((stamp, text))
+
+		msg = GPSMessage(text[:text.index('*')])
+		try:
+			msg.parse()
+		except (ValueError, IndexError):
+			""" empty fields before the receiver has a fix """
+			self.counters['parseErrors'] += 1
+			return
 		self.lastMessage = msg
-		if msg.sentenceType == 'ZDA':
+		state = dict(self.state)
+		state['sentences'] += 1
+		if msg.sentenceType == 'GGA':
+			state['gga'] = (stamp, msg.fix.latitude, msg.fix.longitude, msg.altitude, msg.quality, msg.satelliteCount)
+		elif msg.sentenceType == 'VTG':
+			state['vtg'] = (stamp, msg.trueTrack, msg.magneticTrack, msg.groundSpeedKnots)
+		elif msg.sentenceType == 'ZDA':
 			self.time = msg.time
-		
-	
\ No newline at end of file
+			state['time'] = msg.time
+		elif msg.sentenceType == 'RMC':
+			state['time'] = msg.date.time
+		else:
+			return
+		self.state = state
+
+def checksumValid(text):
+	""" the XOR of everything between '$' and '*' against the two hex digits after it """
+	star = text.find('*')
+	if not text.startswith('$') or star < 0 or len(text) < star + 3:
+		return False
+	check = 0
+	for c in text[1:star]:
+		check ^= ord(c)
+	try:
+		return check == int(text[star + 1:star + 3], 16)
+	except ValueError:
+		return False
@@ -0,0 +1,94 @@
+#!/usr/bin/python
+
+import mmap
+import os
+import struct
+import time
+
+""" HIH-4030 humidity sensor
+
+                scripts/read_humidity takes a burst of conversions of the sensor's
+                channel on the ADC bridge every few seconds, works the mean, the
+                datasheet transfer function and the correction for the exterior
+                temperature (from our telemetry snapshot) in fixed point, and
+                publishes a smoothed RH with its 1 sigma uncertainty to a ring in
+                /dev/shm/hab_humidity (layout in scripts/humidity.h).  This reads
+                the newest record from that ring, so the flight software never puts
+                the sensor on its own I2C schedule.
+"""
+
+HUMIDITY_SHM_PATH = '/dev/shm/hab_humidity'
+HUMIDITY_MAGIC = 0x48494831             # 'HIH1'
+HUMIDITY_RING_SIZE = 64
+
+HEADER = struct.Struct('<8I')           # magic size burst interval_ms overruns errors head reserved
+RECORD = struct.Struct('<QffIIhBBHH')   # timestamp rh confidence mean_q8 burst_us temperature known saturated samples errors
+HEAD_OFFSET = 24
+RING_BYTES = HEADER.size + HUMIDITY_RING_SIZE * RECORD.size
+
+class HIH4030:
+    def __init__(self, path=HUMIDITY_SHM_PATH, staleAfter=30):
+        """ staleAfter: seconds without a new record before read() gives up on the sampler """
+        self.path = path
+        self.staleAfter = staleAfter
+        self.shm = None
+        self.lastHead = None
+        self.lastChange = 0
+
+    def _open(self):
+        try:
+            fd = os.open(self.path, os.O_RDONLY)
+        except OSError:
+            return False
+        try:
+            if os.fstat(fd).st_size < RING_BYTES:
+                return False
+            shm = mmap.mmap(fd, RING_BYTES, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        (magic, size) = HEADER.unpack_from(shm, 0)[:2]
+        if magic != HUMIDITY_MAGIC or size != HUMIDITY_RING_SIZE:
+            shm.close()
+            return False
+        self.shm = shm
+        return True
+
+    def isavailable(self):
+        return self.shm is not None or self._open()
+
+    def stats(self):
+        """ the sampler's settings and error counters, None if it isn't running """
+        if not self.isavailable():
+            return None
+        (magic, size, burst, intervalMs, overruns, errors, head, reserved) = HEADER.unpack_from(self.shm, 0)
+        return {'burst': burst, 'intervalMs': intervalMs, 'overruns': overruns, 'errors': errors, 'records': head}
+
+    def record(self):
+        """ the newest record as a dict, None if there is no sampler or it has stopped publishing """
+        if not self.isavailable():
+            return None
+        while True:
+            head = struct.unpack_from('<I', self.shm, HEAD_OFFSET)[0]
+            if head == 0:
+                return None
+            offset = HEADER.size + ((head - 1) % HUMIDITY_RING_SIZE) * RECORD.size
+            values = RECORD.unpack_from(self.shm, offset)
+            """ the slot is only reused a whole ring later; retry if that happened under us """
+            if (struct.unpack_from('<I', self.shm, HEAD_OFFSET)[0] - head) & 0xffffffff < HUMIDITY_RING_SIZE - 1:
+                break
+        now = time.time()
+        if head != self.lastHead:
+            self.lastHead = head
+            self.lastChange = now
+        elif now - self.lastChange > self.staleAfter:
+            return None
+        return {'rh': values[1], 'confidence': values[2], 'meanCounts': values[3] / 256.0,
+                'burstUs': values[4], 'temperature': values[5] / 10.0, 'temperatureKnown': bool(values[6]),
+                'saturated': bool(values[7]), 'samples': values[8], 'errors': values[9]}
+
+    def read(self):
+        """ the smoothed (rh, confidence) in % RH; (None, None) without a running sampler """
+        record = self.record()
+        if record is None:
+            return (None, None)
+        return (record['rh'], record['confidence'])
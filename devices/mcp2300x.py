@@ -45,64 +45,87 @@ class MCP230XXDirection:
     (OUTPUT,INPUT) = range(2)
     
 class MCP23017:
-    
+    """ IODIR, GPPU and OLAT are kept in shadow copies, so changing a pin costs one
+    register write and nothing when the pin is already in that state.  With IOCON
+    at its reset value (BANK=0, SEQOP=0) each A/B register pair is adjacent and
+    the address pointer increments, so both ports go out in a single transaction.
+    A shadow is only updated once its write succeeds; refresh() reloads them all
+    from the device, e.g. after a brown-out reset. """
+
     def __init__(self, address):
         self.i2c = i2c.I2C(address = address)
         self.address = address
-        
-        self.i2c.write8(MCP23017_IODIRA, 0xFF)  # all inputs on PORTA
-        self.i2c.write8(MCP23017_IODIRB, 0xFF)  # all inputs on PORTB
-        
-        """ read directions """
-        self.iodira = self.i2c.readU8(MCP23017_IODIRA)
-        self.iodirb = self.i2c.readU8(MCP23017_IODIRB)
-        
-        """ disable pullups """
-        self.i2c.write8(MCP23017_GPPUA, 0x00)
-        self.i2c.write8(MCP23017_GPPUB, 0x00)
-        
+        self.iodir = [0xFF, 0xFF]
+        self.gppu = [0x00, 0x00]
+        self.olat = [0x00, 0x00]
+
+        """ adopt the directions, pullups and latches the device already holds, so a
+        restart (or a second instance, as switch.py makes) leaves the pins alone;
+        only when it can't be read is the reset state written: all inputs, pullups
+        disabled """
+        if self.refresh() == -1:
+            self._writePair(MCP23017_IODIRA, self.iodir, [0xFF, 0xFF], force=True)
+            self._writePair(MCP23017_GPPUA, self.gppu, [0x00, 0x00], force=True)
+
+    def _port(self, bank):
+        return 0 if bank == 'A' else 1
+
+    def _writePair(self, reg, shadow, values, force=False):
+        """ write one port's register, or both in one transaction, if it changes """
+        values = [v & 0xFF for v in values]
+        if values == shadow and not force:
+            return 0
+        if force or (values[0] != shadow[0] and values[1] != shadow[1]):
+            ret = self.i2c.writeList(reg, values)
+        elif values[0] != shadow[0]:
+            ret = self.i2c.write8(reg, values[0])
+        else:
+            ret = self.i2c.write8(reg + 1, values[1])
+        if ret == -1:
+            return -1
+        shadow[:] = values
+        return 0
+
+    def _update(self, reg, shadow, bank, mask, value):
+        values = list(shadow)
+        port = self._port(bank)
+        values[port] = (values[port] & ~mask) | (value & mask)
+        return self._writePair(reg, shadow, values)
+
+    def refresh(self):
+        """ reload every shadow register from the device """
+        for (reg, shadow) in ((MCP23017_IODIRA, self.iodir), (MCP23017_GPPUA, self.gppu),
+                              (MCP23017_OLATA, self.olat)):
+            values = self.i2c.readList(reg, 2)
+            if values == -1:
+                return -1
+            shadow[:] = list(values)
+        return 0
+
     def config(self, bank, pin, mode):
-        """ read the current value of the direction registers """
-        self.iodira = self.i2c.readU8(MCP23017_IODIRA)
-        self.iodirb = self.i2c.readU8(MCP23017_IODIRB)
         if mode == MCP230XXDirection.INPUT:
-            if bank == 'A':
-                self.iodira |= 1 << pin
-            else:
-                self.iodirb |= 1 << pin
-        else:
-            if bank == 'A':
-                self.iodira &= ~(1 << pin)
-            else:
-                self.iodirb &= ~(1 << pin)
-        """ write the new configuration """
-        if bank == 'A':
-            self.i2c.write8(MCP23017_IODIRA, self.iodira)
-        else:
-            self.i2c.write8(MCP23017_IODIRB, self.iodirb)
-        
+            return self._update(MCP23017_IODIRA, self.iodir, bank, 1 << pin, 0xFF)
+        return self._update(MCP23017_IODIRA, self.iodir, bank, 1 << pin, 0x00)
+
+    def configPorts(self, iodira, iodirb):
+        """ set every pin's direction at once; a 1 bit is an input """
+        return self._writePair(MCP23017_IODIRA, self.iodir, [iodira, iodirb])
+
+    def pullup(self, bank, pin, enable):
+        return self._update(MCP23017_GPPUA, self.gppu, bank, 1 << pin, 0xFF if enable else 0x00)
+
     def output(self, bank, pin, value):
         if pin > 7:
             return
-        
-        """ get current value for the bank """
-        if bank == 'A':
-            self.gpioa = self.i2c.readU8(MCP23017_GPIOA)
-            """ alter with current value """
-            if value == 1:
-                self.gpioa |= 1 << pin
-            else:
-                self.gpioa &= ~(1 << pin)
-            """ write new value """
-            self.i2c.write8(MCP23017_GPIOA,self.gpioa)
-        else:
-            self.gpiob = self.i2c.readU8(MCP23017_GPIOB)
-            if value == 1:
-                self.gpiob |= (1 << pin)
-            else:
-                self.gpiob &= ~(1 << pin)
-            """ write new value """
-            self.i2c.write8(MCP23017_GPIOB,self.gpiob)
+        return self._update(MCP23017_OLATA, self.olat, bank, 1 << pin, 0xFF if value == 1 else 0x00)
+
+    def outputMask(self, bank, mask, value):
+        """ drive the pins in mask to the matching bits of value in one write """
+        return self._update(MCP23017_OLATA, self.olat, bank, mask, value)
+
+    def outputPorts(self, gpioa, gpiob):
+        return self._writePair(MCP23017_OLATA, self.olat, [gpioa, gpiob])
+
     def input(self, bank, pin):
         if pin > 7:
             return
@@ -0,0 +1,194 @@
+#!/usr/bin/python
+
+""" radio module """
+
+""" Client for radiod, the resident SRB-MX146LV control daemon (scripts/radiod.c)
+
+                Rather than running srbmx145 for every command, the flight loop keeps
+                one connection to the daemon and sends it fixed size binary requests.
+                Requests can be pipelined: send() returns an id immediately and the
+                reply can be collected later with reply(id).  The blocking helpers
+                (setFrequency, query, ...) simply send and wait.
+
+                The record layouts must match scripts/radiod.h
+
+                RadioStatus reads the status cache radiod publishes in shared memory
+                (scripts/srb_status.h) without a round trip to the daemon or the radio.
+"""
+import mmap
+import os
+import socket
+import struct
+import time
+
+RADIOD_SOCKET_PATH = '/var/run/radiod.sock'
+RADIOD_TIMEOUT     = 5.0        # seconds; a full command queue drains well inside this
+
+RADIOD_OP_SET_FREQUENCY = 'B'
+RADIOD_OP_MEMORY_RECALL = 'M'
+RADIOD_OP_MEMORY_STORE  = 'm'
+RADIOD_OP_QUERY         = 'Q'
+RADIOD_OP_PLAN_CHANNEL  = 'P'
+
+RADIOD_OK       = 0
+RADIOD_EINVAL   = -1
+RADIOD_EBUSY    = -2
+RADIOD_EIO      = -3
+
+REQUEST_FORMAT  = '<HBBI'       # id, op, arg, value
+REPLY_FORMAT    = '<HBb22s'     # id, op, status, response frame
+REPLY_SIZE      = struct.calcsize(REPLY_FORMAT)
+
+APRS_FREQUENCY  = 144390000
+
+STATUS_SHM_PATH         = '/dev/shm/hab_radio_status'
+STATUS_MAGIC            = 0x53524231
+STATUS_QUERIES          = 'NDV#TF'                  # field order in the cache
+STATUS_HEADER_FORMAT    = '<IIII'                   # magic, fields, sequence, reserved
+STATUS_ENTRY_FORMAT     = '<QIIi22s6x'              # updated_us, refreshes, failures, result, frame
+STATUS_HEADER_SIZE      = struct.calcsize(STATUS_HEADER_FORMAT)
+STATUS_ENTRY_SIZE       = struct.calcsize(STATUS_ENTRY_FORMAT)
+STATUS_SIZE             = STATUS_HEADER_SIZE + STATUS_ENTRY_SIZE * len(STATUS_QUERIES)
+
+class RadioError(Exception):
+    pass
+
+class Radio:
+    def __init__(self, path=RADIOD_SOCKET_PATH, timeout=RADIOD_TIMEOUT):
+        """ every socket operation gives up after timeout seconds with a RadioError """
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        self.sock.settimeout(timeout)
+        self.sock.connect(path)
+        self.nextid = 0
+        self.replies = {}
+
+    def close(self):
+        self.sock.close()
+
+    def send(self, op, arg=0, value=0):
+        """ queue a request with the daemon and return its id without waiting """
+        reqid = self.nextid
+        self.nextid = (self.nextid + 1) & 0xFFFF
+        if isinstance(arg, str):
+            arg = ord(arg)
+        try:
+            self.sock.send(struct.pack(REQUEST_FORMAT, reqid, ord(op), arg, value))
+        except socket.timeout:
+            raise RadioError('radiod is not accepting requests')
+        except socket.error, e:
+            raise RadioError('radiod connection lost: %s' % e)
+        return reqid
+
+    def reply(self, reqid):
+        """ block until the reply for reqid arrives; returns the response frame """
+        while reqid not in self.replies:
+            try:
+                packet = self.sock.recv(REPLY_SIZE)
+            except socket.timeout:
+                raise RadioError('no reply from radiod')
+            except socket.error, e:
+                raise RadioError('radiod connection lost: %s' % e)
+            if len(packet) != REPLY_SIZE:
+                raise RadioError('radiod closed the connection')
+            (rid, op, status, data) = struct.unpack(REPLY_FORMAT, packet)
+            self.replies[rid] = (status, data)
+        (status, data) = self.replies.pop(reqid)
+        if status != RADIOD_OK:
+            raise RadioError(status)
+        return data
+
+    def setFrequency(self, hz):
+        """ the daemon recalls a memory channel instead if one holds hz """
+        self.reply(self.send(RADIOD_OP_SET_FREQUENCY, value=hz))
+
+    def recallChannel(self, channel):
+        self.reply(self.send(RADIOD_OP_MEMORY_RECALL, channel))
+
+    def storeChannel(self, channel):
+        self.reply(self.send(RADIOD_OP_MEMORY_STORE, channel))
+
+    def planChannel(self, channel, hz):
+        """ make a memory channel hold hz; the radio is only written if it differs """
+        self.reply(self.send(RADIOD_OP_PLAN_CHANNEL, channel, hz))
+
+    def planChannels(self, plan):
+        """ pipeline a whole plan, {channel: hz}, then wait for every reply """
+        for reqid in [self.send(RADIOD_OP_PLAN_CHANNEL, ch, hz) for (ch, hz) in sorted(plan.items())]:
+            self.reply(reqid)
+
+    def query(self, letter):
+        """ run a Q query ('N','D','V','#','T','F') and return the response frame """
+        return self.reply(self.send(RADIOD_OP_QUERY, letter))
+
+    def queryText(self, letter):
+        """ text queries (name, date code, version, serial): error code, length, text """
+        frame = self.query(letter)
+        length = min(ord(frame[1]), len(frame) - 2)
+        return frame[2:2 + length]
+
+class RadioStatus:
+    """ lock-free reader for the status cache; values may be None until radiod has fetched them """
+    def __init__(self, path=STATUS_SHM_PATH):
+        fd = os.open(path, os.O_RDONLY)
+        try:
+            self.shm = mmap.mmap(fd, STATUS_SIZE, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        (magic, fields, sequence, reserved) = struct.unpack_from(STATUS_HEADER_FORMAT, self.shm, 0)
+        if magic != STATUS_MAGIC or fields != len(STATUS_QUERIES):
+            raise RadioError('bad status cache')
+
+    def close(self):
+        self.shm.close()
+
+    def entry(self, letter):
+        """ (updated, frame) for a query letter, retrying while radiod is mid-update """
+        offset = STATUS_HEADER_SIZE + STATUS_ENTRY_SIZE * STATUS_QUERIES.index(letter)
+        while True:
+            begin = struct.unpack_from('<I', self.shm, 8)[0]
+            (updated_us, refreshes, failures, result, frame) = struct.unpack_from(STATUS_ENTRY_FORMAT, self.shm, offset)
+            end = struct.unpack_from('<I', self.shm, 8)[0]
+            if begin == end and not begin & 1:
+                break
+        if updated_us == 0:
+            return (None, None)
+        return (updated_us / 1e6, frame)
+
+    def age(self, letter):
+        """ seconds since the field was last fetched """
+        (updated, frame) = self.entry(letter)
+        if updated is None:
+            return None
+        return time.time() - updated
+
+    def text(self, letter):
+        (updated, frame) = self.entry(letter)
+        if frame is None:
+            return None
+        return frame[2:2 + ord(frame[1])]
+
+    def name(self):
+        return self.text('N')
+
+    def dateCode(self):
+        return self.text('D')
+
+    def version(self):
+        return self.text('V')
+
+    def serial(self):
+        return self.text('#')
+
+    def temperature(self):
+        """ degrees C """
+        (updated, frame) = self.entry('T')
+        if frame is None:
+            return None
+        return struct.unpack('<b', frame[2])[0]
+
+    def frequencyRange(self):
+        """ (min, max, step) in Hz """
+        (updated, frame) = self.entry('F')
+        if frame is None:
+            return None
+        return struct.unpack('<III', frame[2:14])
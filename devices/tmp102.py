@@ -1,5 +1,8 @@
 #!/usr/bin/python
 
+import os
+import select
+import threading
 import time
 from protocols import i2c
 
@@ -9,21 +12,225 @@ TMP102_CONFIG   = 0x01    #   R/W
 TMP102_TLOW     = 0x02    #   R/W
 TMP102_THIGH    = 0x03    #   R/W
 
+""" Configuration register, as the 16 bit value sent MSB first """
+TMP102_CONFIG_OS        = 0x8000    # one-shot: write 1 in shutdown to convert once; reads 1 when done
+TMP102_CONFIG_RESOLUTION = 0x6000   # read only, 12 bit
+TMP102_CONFIG_FAULTS    = 0x1800    # consecutive faults before ALERT changes
+TMP102_CONFIG_POL       = 0x0400    # ALERT active high
+TMP102_CONFIG_TM        = 0x0200    # interrupt mode rather than comparator
+TMP102_CONFIG_SD        = 0x0100    # shutdown between conversions
+TMP102_CONFIG_RATE      = 0x00C0    # continuous conversion rate
+TMP102_CONFIG_AL        = 0x0020    # read only, comparator state
+TMP102_CONFIG_EM        = 0x0010    # 13 bit extended mode
+
+class TMP102Rate:
+    """ conversions per second in continuous mode """
+    (QUARTER_HZ,ONE_HZ,FOUR_HZ,EIGHT_HZ) = range(4)
+
+TMP102_ONESHOT_TIME     = 0.035     # seconds; 26 ms typical conversion
+GPIO_SYSFS_PATH         = '/sys/class/gpio'
+
 class TMP102:
     def __init__(self, address):
         self.i2c = i2c.I2C(address = address)
         self.address = address
-        
+        self.config = TMP102Rate.FOUR_HZ << 6     # power-on default
+
+    def _readRegister(self, reg):
+        """ registers are two bytes from the pointer, MSB first; None if the read failed """
+        data = self.i2c.readList(reg,2)
+        if data == -1:
+            return None
+        return (data[0] << 8) | data[1]
+
+    def _writeRegister(self, reg, value):
+        return self.i2c.writeList(reg,[(value >> 8) & 0xFF, value & 0xFF])
+
+    def _toCelsius(self, raw):
+        """ 12 bit two's complement in the top of the word, 0.0625 C per count """
+        val = raw >> 4
+        if val & 0x800:
+            val -= 0x1000
+        return val * 0.0625
+
+    def _fromCelsius(self, celsius):
+        val = int(round(celsius / 0.0625))
+        val = max(-0x800, min(0x7FF, val))
+        return (val & 0xFFF) << 4
+
     def readTemp(self):
-        rawtemp = self.i2c.readU16(TMP102_TEMP)
-        msb = rawtemp >> 8
-        lsb = rawtemp & ~(0xF0)
-        
-        val = msb
-        if msb & 0x80 > 0:
-            val |= 0x0F00
-        val <<= 4
-        val |= (lsb >> 4)
-        convertedTemp = val * 0.0625
-        
-        return convertedTemp
\ No newline at end of file
+        raw = self._readRegister(TMP102_TEMP)
+        if raw is None:
+            return None
+        return self._toCelsius(raw)
+
+    def readConfig(self):
+        return self._readRegister(TMP102_CONFIG)
+
+    def setThresholds(self, low, high):
+        """ in interrupt mode ALERT fires when the temperature rises to high, then
+        not again until it falls below low; in comparator mode it is held active
+        from high down to low """
+        if self._writeRegister(TMP102_TLOW,self._fromCelsius(low)) == -1:
+            return -1
+        return self._writeRegister(TMP102_THIGH,self._fromCelsius(high))
+
+    def configure(self, rate=TMP102Rate.FOUR_HZ, faults=0, interrupt=False, activeHigh=False, shutdown=False):
+        """ faults: 0-3 for 1, 2, 4 or 6 consecutive out-of-limit conversions before ALERT changes """
+        config = (rate & 3) << 6 | (faults & 3) << 11
+        if interrupt:
+            config |= TMP102_CONFIG_TM
+        if activeHigh:
+            config |= TMP102_CONFIG_POL
+        if shutdown:
+            config |= TMP102_CONFIG_SD
+        self.config = config
+        return self._writeRegister(TMP102_CONFIG,config)
+
+    def shutdown(self):
+        """ stop converting; only oneShot() conversions happen from here on """
+        return self.configure(shutdown=True)
+
+    def oneShot(self):
+        """ one conversion from shutdown, for when the part only wakes to be read;
+        the thresholds are checked against it as well """
+        config = self.config | TMP102_CONFIG_SD
+        if self._writeRegister(TMP102_CONFIG,config | TMP102_CONFIG_OS) == -1:
+            return None
+        time.sleep(TMP102_ONESHOT_TIME)
+        return self.readTemp()
+
+class SysfsGPIO:
+    """ an input pin with edge detection through sysfs; the value file signals
+    POLLPRI on the configured edge, so a thread can sleep in poll() until it moves """
+
+    def __init__(self, pin, edge='falling'):
+        self.pin = pin
+        path = '%s/gpio%d' % (GPIO_SYSFS_PATH,pin)
+        if not os.path.exists(path):
+            with open(GPIO_SYSFS_PATH + '/export','w') as f:
+                f.write(str(pin))
+        with open(path + '/direction','w') as f:
+            f.write('in')
+        with open(path + '/edge','w') as f:
+            f.write(edge)
+        self.fd = os.open(path + '/value', os.O_RDONLY)
+        self.read()
+
+    def read(self):
+        """ current level; this also acknowledges a pending edge """
+        os.lseek(self.fd, 0, os.SEEK_SET)
+        return int(os.read(self.fd, 2)[0])
+
+    def close(self):
+        os.close(self.fd)
+
+class TMP102Alert:
+    """ Over-temperature watch on the ALERT pin
+
+                The TMP102 is put in interrupt mode at its slowest conversion rate
+                with the thresholds programmed, and a thread sleeps in poll() on the
+                ALERT pin.  Consumers are called back only when the temperature
+                crosses a threshold: onCrossing(True, temp) when it reaches high and
+                onCrossing(False, temp) when it drops back below low.  The read
+                that finds the temperature also clears ALERT.  Every confirmInterval
+                seconds without an edge the thread reads the temperature anyway, to
+                catch a missed edge or a sensor that was reset and lost its setup.
+
+                With gpio None there is no ALERT line: the part is shut down and
+                the confirmation reads are one-shot conversions instead.
+    """
+
+    def __init__(self, sensor, low, high, onCrossing, gpio=None, confirmInterval=60.0, faults=1):
+        self.sensor = sensor
+        self.low = low
+        self.high = high
+        self.onCrossing = onCrossing
+        self.confirmInterval = confirmInterval
+        self.faults = faults
+        self.hot = False
+        self.temperature = None
+        self.alerts = 0
+        self.confirmations = 0
+        self.errors = 0
+
+        self.pin = None
+        if gpio is not None:
+            """ ALERT is open drain and active low """
+            self.pin = SysfsGPIO(gpio, 'falling')
+        (self.wakeRead, self.wakeWrite) = os.pipe()
+        self.running = True
+        self._setup()
+        self.thread = threading.Thread(target=self._run, name='tmp102')
+        self.thread.daemon = True
+        self.thread.start()
+
+    def _setup(self):
+        self.sensor.setThresholds(self.low, self.high)
+        if self.pin is not None:
+            self.sensor.configure(rate=TMP102Rate.QUARTER_HZ, faults=self.faults, interrupt=True)
+        else:
+            self.sensor.configure(faults=self.faults, shutdown=True)
+
+    def _check(self, temp):
+        """ track the hysteresis state and tell the consumer when it changes """
+        if temp is None:
+            self.errors += 1
+            return
+        self.temperature = temp
+        if not self.hot and temp >= self.high:
+            self.hot = True
+        elif self.hot and temp < self.low:
+            self.hot = False
+        else:
+            return
+        try:
+            self.onCrossing(self.hot, temp)
+        except Exception, e:
+            print "ERROR | TMP102 crossing handler failed: %s" % e
+
+    def _confirm(self):
+        self.confirmations += 1
+        if self.pin is None:
+            self._check(self.sensor.oneShot())
+            return
+        config = self.sensor.readConfig()
+        if config is None or not config & TMP102_CONFIG_TM:
+            """ power-on defaults: the part was reset, program it again """
+            print "WARN | TMP102 lost its alert configuration, restoring it"
+            self._setup()
+        self._check(self.sensor.readTemp())
+
+    def _run(self):
+        poller = select.poll()
+        poller.register(self.wakeRead, select.POLLIN)
+        if self.pin is not None:
+            poller.register(self.pin.fd, select.POLLPRI | select.POLLERR)
+        """ the first reading establishes the state; in interrupt mode it also clears
+        an ALERT left over from before we started """
+        self._confirm()
+        while self.running:
+            events = poller.poll(self.confirmInterval * 1000)
+            if not self.running:
+                break
+            if not events:
+                self._confirm()
+                continue
+            for (fd, event) in events:
+                if self.pin is not None and fd == self.pin.fd:
+                    self.pin.read()
+                    self.alerts += 1
+                    self._check(self.sensor.readTemp())
+
+    def stats(self):
+        return {'hot': self.hot, 'temperature': self.temperature, 'alerts': self.alerts,
+                'confirmations': self.confirmations, 'errors': self.errors}
+
+    def close(self, timeout=None):
+        self.running = False
+        os.write(self.wakeWrite, 'x')
+        self.thread.join(timeout)
+        if self.pin is not None:
+            self.pin.close()
+        os.close(self.wakeRead)
+        os.close(self.wakeWrite)
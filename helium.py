@@ -4,10 +4,17 @@ from protocols  import i2c
 from devices import bmp085
 from devices import mcp2300x
 from devices import ds18xx
+from devices import tmp102
 from devices import adc
+from devices import accel
+from devices import hih4030
 from devices import gps
 from devices import camera
-import threading
+from services import scheduler
+from services import workers
+from services import telemetry
+from services import flightlog
+from services import snapshot
 import os
 import re
 import sqlite3 as sql
@@ -23,6 +30,17 @@ DEBUG                   = 1
 I2C_ADDRESS_BMP085      = 0x77
 I2C_ADDRESS_MCP23017    = 0x20
 I2C_ADDRESS_ADC             = 0x26
+I2C_ADDRESS_TMP102      = 0x48
+
+""" TMP102 board temperature watch; ALERT is assumed on BCM GPIO 17 (P1-11) """
+TMP102_ALERT_GPIO       = 17
+BOARD_TEMP_HIGH         = 50    # C, warn at or above
+BOARD_TEMP_LOW          = 45    # C, clear again below
+
+""" MCP23017 port B pins 6 and 7 select where the GPS serial goes """
+GPS_MUX_MASK            = 0xC0
+GPS_MUX_CPU             = 0x40
+GPS_MUX_APRS            = 0x00
 
 """ DS18B20 identifiers """
 DS18B20_ID_INTERNAL     = '0000025edf21'
@@ -41,23 +59,23 @@ class Hardware:
             print """INFO | initializing external GPIO (MCP23017 @ 0x%x""" % (I2C_ADDRESS_MCP23017,)
         self.gpio = mcp2300x.MCP23017(I2C_ADDRESS_MCP23017)
         
-        """ configure the external GPIO """
-        MCP23017Direction = mcp2300x.MCP230XXDirection.OUTPUT
-        for pin in range(8):
-            self.gpio.config('A',pin,MCP23017Direction)
-            self.gpio.config('B',pin,MCP23017Direction)
+        """ configure the external GPIO, every pin an output """
+        self.gpio.configPorts(0x00, 0x00)
             
         if DEBUG:
             print """INFO | set GPS serial redirect to APSR"""
-        self.gpio.output('B',6,0)
-        self.gpio.output('B',7,0)
+        self.routeGPS(GPSRedirect.APRS)
 
         """ configure 1-wire temp sensors """
         if DEBUG:
             print "INFO | initializing 1-Wire devices"
+        ds18xx.loadModules()
         DSDeviceFamily = ds18xx.DS18XXFamily.DS18B20
         self.extTemp = ds18xx.DS18XX(DSDeviceFamily,DS18B20_ID_EXTERNAL)
         self.intTemp = ds18xx.DS18XX(DSDeviceFamily,DS18B20_ID_INTERNAL)
+        self.thermometers = ds18xx.DS18XXBus([self.extTemp,self.intTemp])
+        if not self.thermometers.bulkAvailable():
+            print "WARN | no 1-Wire bulk conversion, thermometers will be converted one at a time"
 
         
 
@@ -66,6 +84,16 @@ class Hardware:
             print "INFO | initializing the ADC"
         self.adc = adc.ADC(0x26);
 
+        """ the humidity sensor is burst-sampled and compensated by scripts/read_humidity; we only read its records """
+        self.humidity = hih4030.HIH4030()
+        if not self.humidity.isavailable():
+            print "WARN | humidity sampler (read_humidity) is not running"
+
+        """ the accelerometer is sampled by scripts/read_accel through the ADC; we only read its records """
+        self.accel = accel.ADXL335()
+        if not self.accel.isavailable():
+            print "WARN | accelerometer sampler (read_accel) is not running"
+
         """     configure the GPS """
         if DEBUG:
             print "INFO | initializing the GPS"
@@ -93,6 +121,13 @@ class Hardware:
             print "WARN | Camera is not available"
 
 
+    def routeGPS(self, redirect):
+        """ switch the GPS serial multiplexer; both select pins change in one write """
+        if redirect == GPSRedirect.CPU:
+            self.gpio.outputMask('B',GPS_MUX_MASK,GPS_MUX_CPU)
+        else:
+            self.gpio.outputMask('B',GPS_MUX_MASK,GPS_MUX_APRS)
+
     def readAltitude(self):
         return self.bmp.readAltitude()
 
@@ -108,11 +143,14 @@ class Hardware:
     def readInternalTemp(self):
         return self.intTemp.read()
 
+    def readTemperatures(self):
+        """ (timestamp, exterior, interior) from one bus-wide conversion """
+        (stamp, (ext, inside)) = self.thermometers.readAll()
+        return (stamp, ext, inside)
+
     def readHumidity(self):
-        rawADC = self.adc.readChannel(2)
-        #print rawADC
-        volts = 3.3 * float(rawADC)/1023.0
-        return volts/0.03068
+        """ (smoothed % RH, uncertainty in % RH), compensated for the exterior temperature """
+        return self.humidity.read()
 
 class CPU:
     def readCPUTemp(self):
@@ -183,13 +221,16 @@ cputemp = 0             #       temperature of RPi CPU
 adctemp = 0             #       temperature of ADC chip
 extemp = 0              #       exterior temperature
 intemp = 0              #       interior payload temperature
+temptime = 0            #       when both were converted
 bmptemp = 0             #       temperature from the BMP085 sensor
 humid = 0               #       % relative humidity
+humidconf = 0           #       uncertainty of humid, % RH
 bmp = 0                 #       barometric pressure
 slp = 0                 #       sea-level pressure
 accelx = 0              #       acceleration X-axis
 accely = 0              #       acceleration Y-axis
 accelz = 0              #       acceleration Z-axis
+sensortime = 0          #       when the BMP085 was last read
 
 """     local GPS data"""
 latitude = 0
@@ -201,6 +242,9 @@ trkmag = 0
 gpstime = utcclock.datetime.today()
 satcount = 0
 quality = 0
+fixtime = 0
+ggatime = 0             #       arrival of the last GGA taken from the reader
+vtgtime = 0             #       and of the last VTG
 
 
 """ MENU HANDLERS """
@@ -219,21 +263,32 @@ def printCPUTemp():
 def printADCTemp():
     print hw.adc.readChannel(0x3F)
 def printRelativeHumidity():
-    print "%0.2f" % hw.readHumidity()
+    record = hw.humidity.record()
+    if record is None:
+        print "ERROR | humidity sampler (read_humidity) is not running"
+    else:
+        print "%0.2f +/- %0.2f (compensated at %0.1f C%s)" % (record['rh'], record['confidence'],
+            record['temperature'], '' if record['temperatureKnown'] else ', assumed')
 def printSQLiteVersion():
     db.connect()
     print db.getVersion()
 def captureTestImage():
-    ImageCaptureThread = threading.Thread(target=hw.camera.captureimage())
-    ImageCaptureThread.start()
+    if not pool.submit('camera', hw.camera.captureimage):
+        print "WARN | camera is still busy with the last capture"
 def startLaunch():
     print "Starting run sequence"
     global mode
     mode = HeliumMode.ModeStart
+    tasks.restart()
+    publishTelemetry()
 
 def printVersion():
     print HELIUM_VERSION
 def exitApp():
+    hw.gps.close(1)
+    boardwatch.close(1)
+    recorder.close()
+    blackbox.close()
     exit(1)
 
 optionVectors = {
@@ -253,110 +308,172 @@ optionVectors = {
         'quit': exitApp
 }
 
-def measureExtTemp():
-    global extemp
-    extemp = hw.readExternalTemp()
-
-def measureIntTemp():
-    global intemp
-    intemp = hw.readInternalTemp()
+def measureTemps():
+    """ a failed read keeps the last good value """
+    global extemp,intemp,temptime
+    (stamp, ext, inside) = hw.readTemperatures()
+    if ext is not None:
+        extemp = ext
+    if inside is not None:
+        intemp = inside
+    temptime = stamp
 
 now = utcclock.datetime.now()
 ept = (time.mktime(now.timetuple()))
 epochtime = 0
-gpslistentime = 0
 
 
 
-def extTempMonitorService():
-    """     service the exterior temperature monitor """
-    ReadExtTempThread = threading.Thread(target=measureExtTemp)
-    ReadExtTempThread.start()
-
+""" slow device reads (1-Wire conversions take ~750 ms, a gphoto2 capture several
+seconds) run on a small pool of worker threads so they never hold up the flight
+loop; each device has its own lane and a tick that finds the previous read still
+busy is skipped rather than queued behind it
+"""
+pool = workers.WorkerPool(workers=2)
 
-def intTempMonitorService():
-    """ service the interior temperature monitor """
-    ReadIntTempThread = threading.Thread(target=measureIntTemp)
-    ReadIntTempThread.start()
+def tempMonitorService():
+    """ service the exterior and interior temperature monitors; both DS18B20s convert
+    together, so this costs one 750 ms conversion rather than two """
+    pool.submit('onewire', measureTemps)
 
 def cpuTempMonitorService():
     """ service the CPU temperature monitor """
+    global cputemp
     cputemp = float( cpu.readCPUTemp())/1000.0
 
 def humidityMonitorService():
-    """ service the humidity sensor """
-    humidity = hw.readHumidity()
+    """ pick up the newest humidity; read_humidity compensates it with the extemp we publish """
+    global humid,humidconf
+    (rh, confidence) = hw.readHumidity()
+    if rh is not None:
+        (humid, humidconf) = (rh, confidence)
+
+def accelMonitorService():
+    """ pick up the newest filtered acceleration; the values hold if the sampler stops """
+    global accelx,accely,accelz
+    record = hw.accel.read()
+    if record is not None:
+        (accelx,accely,accelz) = record['g']
 
 def bmpMonitorService():
     """ service the barometric pressure sensor """
-    global currentalt,bmp,bmptemp,sersoralts,slp
-    currentalt = hw.readAltitude()
-    bmp = hw.readPressure()
-    bmptemp = hw.readBMPTemp()
+    global currentalt,bmp,bmptemp,sersoralts,slp,sensortime
+    """ one temperature + pressure conversion pair gives all three """
+    (bmptemp,bmp,currentalt) = hw.bmp.readSample()
+    sensortime = time.time()
     sensoralts.append(currentalt)
     if len(sensoralts) > ALTITUDE_STACK_SIZE:
         sensoralts.popleft()
     slp = menu.calculateSLP(bmp,currentalt,extemp)
 
+def boardTempCrossing(hot, temp):
+    """ called from the TMP102 watch only when the board crosses its limits """
+    if hot:
+        print "WARN | board temperature %0.1f C is at or above %d C" % (temp, BOARD_TEMP_HIGH)
+    else:
+        print "INFO | board temperature back down to %0.1f C" % temp
+
+""" the TMP102 compares against its thresholds itself and raises ALERT on a crossing,
+so nothing polls it but a confirmation read once a minute """
+try:
+    boardwatch = tmp102.TMP102Alert(tmp102.TMP102(I2C_ADDRESS_TMP102), BOARD_TEMP_LOW, BOARD_TEMP_HIGH,
+                                    boardTempCrossing, gpio=TMP102_ALERT_GPIO)
+except (OSError, IOError), e:
+    print "WARN | no TMP102 ALERT line (%s), using one-shot reads" % e
+    boardwatch = tmp102.TMP102Alert(tmp102.TMP102(I2C_ADDRESS_TMP102), BOARD_TEMP_LOW, BOARD_TEMP_HIGH,
+                                    boardTempCrossing)
+
+""" rows are queued to the telemetry writer, which batches them into the db on its own thread """
+recorder = telemetry.TelemetryWriter('/var/www/webpy/data/helium.db')
+
+""" every row also goes to the binary flight recorder first, which doesn't depend on
+sqlite; export it with 'python -m services.flightlog export' after landing """
+blackbox = flightlog.FlightLog('/var/www/webpy/data/flightlog')
+
 def saveSensorData():
     """ dump accumulated sensor data to sqlite db"""
     if len(sensoralts) > 0:
-        query = """INSERT INTO sensors(time,oat,iat,cput,bmpt,rh,accelx,accely,accelz,alt,bp,slp) \
-        VALUES('%s','%0.1f', '%0.1f', '%0.1f', '%0.1f', '%0.1f', '%0.1f', '%0.1f', '%0.1f', '%0.1f', '%0.1f', '%0.1f')""" % \
-        (utcclock.datetime.now(),extemp,intemp,cputemp,bmptemp,humid,accelx,accely,accelz,sensoralts[-1],bmp,slp)
-        #print query
-        try:
-            con = sql.connect('/var/www/webpy/data/helium.db')
-            cursor = con.cursor()
-            cursor.execute(query)
-            con.commit()
-        except sql.Error, e:
-            print "Error %s:" % e.args[0]
-            sys.exit(1)
-        finally:
-            if con:
-                con.close()
+        stamp = time.time()
+        blackbox.logSensors(extemp,intemp,cputemp,bmptemp,humid,accelx,accely,accelz,sensoralts[-1],bmp,slp,stamp=stamp)
+        recorder.saveSensors(flightlog.rowTime(stamp),
+                             round(extemp,1),round(intemp,1),round(cputemp,1),round(bmptemp,1),round(humid,1),
+                             round(accelx,1),round(accely,1),round(accelz,1),round(sensoralts[-1],1),
+                             round(bmp,1),round(slp,1))
 
 def saveGPSData():
     """ dump accumulated position data to sqlite db """
-    query = "INSERT INTO fixes(latitude,longitude,altitude,kts,trkangle,trkmag,time,quality,satcount) \
-                    VALUES('%0.6f','%0.6f','%0.1f' , '%0.1f' ,'%0.1f' , '%0.1f' ,'%s' , '%d' , '%d')" % \
-                    (latitude,longitude,altitude,kts,trkangle,trkmag,utcclock.datetime.now(),quality,satcount)
-    try:
-        con = sql.connect('/var/www/webpy/data/helium.db')
-        cursor = con.cursor()
-        cursor.execute(query)
-        con.commit()
-    except sql.Error, e:
-        print "Error %s:" % e.args[0]
-        sys.exit(1)
-    finally:
-        con.close()
+    stamp = time.time()
+    blackbox.logFix(latitude,longitude,altitude,kts,trkangle,trkmag,quality,satcount,stamp=stamp)
+    recorder.saveFix(round(latitude,6),round(longitude,6),round(altitude,1),round(kts,1),
+                     round(trkangle,1),round(trkmag,1),flightlog.rowTime(stamp),int(quality),int(satcount))
         
 def listenToGPS():
-    self.gpio.output('B',6,1)
-    self.gpio.output('B',7,0)
+    global gpsredirect
+    hw.routeGPS(GPSRedirect.CPU)
+    gpsredirect = GPSRedirect.CPU
     """ we'll listen for 2 seconds then allow the APRS tracker to listen for the remaining 8 seconds """
-    gpslistentime = epochtime
-
-""" capture image from the camera and store on USB stick in separate thread """
+    tasks.once(2, stopListeningToGPS)
+
+def stopListeningToGPS():
+    """ switch the multiplexer back to the APRS """
+    global gpsredirect
+    gpsredirect = GPSRedirect.APRS
+    hw.routeGPS(GPSRedirect.APRS)
+
+def gpsMonitorService():
+    """ pick up the latest sentences from the GPS reader thread; this never waits on the serial port """
+    global latitude,longitude,altitude,quality,satcount,kts,trkangle,trkmag,fixtime,ggatime,vtgtime
+    state = hw.gps.latest()
+    gga = state['gga']
+    if gga is not None and gga[0] != ggatime:
+        (ggatime,latitude,longitude,altitude,quality,satcount) = gga
+        gpsalts.append(altitude)
+        if len(gpsalts) > ALTITUDE_STACK_SIZE:
+            gpsalts.popleft()
+    vtg = state['vtg']
+    if vtg is not None and vtg[0] != vtgtime:
+        (vtgtime,trkangle,trkmag,kts) = vtg
+    fixtime = max(ggatime,vtgtime)
+
+""" publish the latest values to shared memory so the web front end and other readers
+never have to go to the sensors themselves """
+try:
+    snap = snapshot.SnapshotWriter()
+except (OSError, IOError), e:
+    print "WARN | cannot publish the telemetry snapshot: %s" % e
+    snap = None
+
+def publishTelemetry():
+    if snap is None:
+        return
+    alt = sensoralts[-1] if len(sensoralts) > 0 else 0
+    snap.publish(sensorTime=sensortime, tempTime=temptime, extemp=extemp, intemp=intemp, cputemp=cputemp, bmptemp=bmptemp,
+                 humidity=humid, humidityConfidence=humidconf, pressure=bmp, slp=slp, altitude=alt,
+                 accelx=accelx, accely=accely, accelz=accelz,
+                 fixTime=fixtime, latitude=latitude, longitude=longitude, gpsAltitude=altitude,
+                 kts=kts, trkangle=trkangle, trkmag=trkmag, mode=mode, quality=quality, satcount=satcount)
+
+""" capture image from the camera and store on USB stick on the worker pool """
 def captureImage():
-    ImageCaptureThread = threading.Thread(target=hw.camera.captureimage())
-    ImageCaptureThread.start()
+    pool.submit('camera', hw.camera.captureimage)
 
-""" since we need not perform every task on each trip through the run loop, this structure
-sets up a mechanism for launching tasks at intervals
+""" since we need not perform every task on each trip through the run loop, the
+scheduler launches each service at its own interval; the phase (seconds after the
+flight starts) staggers them so they don't all land on the same pass
 """
-serviceevents = [ {'interval':15, 'time':0,     'vector' : extTempMonitorService},
-                                  {'interval':15, 'time':ept+1, 'vector' : intTempMonitorService},
-                                  {'interval':15, 'time':ept+2, 'vector' : cpuTempMonitorService},
-                                  {'interval':15, 'time':ept+3, 'vector' : humidityMonitorService},
-                                  {'interval':15, 'time':ept+4, 'vector' : bmpMonitorService},
-                                  {'interval':60, 'time':0,     'vector' : captureImage},
-                                  {'interval':12, 'time':ept+5, 'vector' : saveSensorData},
-                                  {'interval':5,  'time':ept+2, 'vector' : saveGPSData,
-                                   'interval':10, 'time':ept+6, 'vector' : listenToGPS,}
-                                ]
+tasks = scheduler.Scheduler()
+tasks.every(15, tempMonitorService,      phase=0)
+tasks.every(15, cpuTempMonitorService,   phase=2)
+tasks.every(15, humidityMonitorService,  phase=3)
+tasks.every(15, bmpMonitorService,       phase=4)
+tasks.every(1,  accelMonitorService,     phase=0.25)
+tasks.every(60, captureImage,            phase=0)
+tasks.every(12, saveSensorData,          phase=5)
+tasks.every(5,  saveGPSData,             phase=2)
+tasks.every(10, listenToGPS,             phase=6)
+tasks.every(1,  gpsMonitorService,       phase=0.75)
+tasks.every(1,  publishTelemetry,        phase=0.5)
+tasks.every(30, blackbox.sync,           phase=7, name='flightlogSync')
 
 while 1:
     now = utcclock.datetime.now()
@@ -382,32 +499,10 @@ while 1:
                     else:
                         vector()
     else:
-        """     in some flight mode """
-        for event in serviceevents:
-            if epochtime - event['time'] > event['interval']:
-                event['vector']()
-                event['time'] = epochtime
-
-        """ service the GPS every pass through the run loop"""
-        if gpsredirect == GPSRedirect.CPU:
-            """ we're listening to the GPS serial currently"""
-            hw.gps.readline()
-            if hw.gps.lastMessage.sentenceType == 'VTG':
-                trkangle = hw.gps.lastMessage.trueTrack
-                trkmag = hw.gps.lastMessage.magneticTrack
-                kts = hw.gps.lastMessage.groundSpeedKnots
-            elif hw.gps.lastMessage.sentenceType == 'GGA':
-                latitude = hw.gps.lastMessage.fix.latitude
-                longitude = hw.gps.lastMessage.fix.longitude
-                altitude = hw.gps.lastMessage.altitude
-                gpsalts.append(altitude)
-                if len(gpsalts) > ALTITUDE_STACK_SIZE:
-                    gpsalts.popleft()
-            if epochtime - gpslistentime > 2:
-                """ if we've already listened for two seconds then redirect back to APRS"""
-                gpsredirect = GPSRedirect.APRS
-                """ switch the multiplexer to the APRS """
-                hw.gpio.output('B',6,0)
-                hw.gpio.outout('B',7,0)
-
-            #adctemp = hw.adc.readChannel(0x3F)
+        """     in some flight mode; run whatever is due, then sleep until the next
+        service; the GPS is read on its own thread, so nothing here waits on serial """
+        wait = tasks.runPending()
+        if wait:
+            time.sleep(wait)
+
+        #adctemp = hw.adc.readChannel(0x3F)
@@ -52,7 +52,8 @@ class I2C:
                 print results
             return results
         except IOError, err:
-            return self.errMsg()
+            self._printWarning(reg)
+            return -1
   
     def readU8(self, reg):
         "Read an unsigned byte from the I2C device"
@@ -0,0 +1,157 @@
+/*
+ *  accel.c
+ *
+ *  ADXL335 decimator and record ring, see accel.h
+ */
+
+#include "accel.h"
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+_Static_assert(sizeof(accel_record_t) == 64, "accel_record_t layout is shared with devices/accel.py");
+
+accel_ring_t *accel_ring_create(void)
+{
+    int fd = shm_open(ACCEL_SHM_NAME, O_RDWR | O_CREAT, 0644);
+    if( fd < 0 )
+        return NULL;
+    if( ftruncate(fd, sizeof(accel_ring_t)) < 0 ) {
+        close(fd);
+        return NULL;
+    }
+    accel_ring_t *ring = mmap(NULL, sizeof(accel_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if( ring == MAP_FAILED )
+        return NULL;
+    memset(ring, 0, sizeof(accel_ring_t));
+    ring->size = ACCEL_RING_SIZE;
+    __atomic_store_n(&ring->magic, ACCEL_MAGIC, __ATOMIC_RELEASE);
+    return ring;
+}
+
+const accel_ring_t *accel_ring_open(void)
+{
+    int fd = shm_open(ACCEL_SHM_NAME, O_RDONLY, 0);
+    if( fd < 0 )
+        return NULL;
+    const accel_ring_t *ring = mmap(NULL, sizeof(accel_ring_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if( ring == MAP_FAILED )
+        return NULL;
+    if( __atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != ACCEL_MAGIC ||
+            ring->size != ACCEL_RING_SIZE ) {
+        munmap((void *)ring, sizeof(accel_ring_t));
+        return NULL;
+    }
+    return ring;
+}
+
+static void accel_reset_window(accel_decimator_t *dec)
+{
+    dec->count = 0;
+    for(uint8_t a = 0; a < ACCEL_AXES; a++ ) {
+        dec->min[a] = INFINITY;
+        dec->max[a] = -INFINITY;
+        dec->sumsq[a] = 0;
+    }
+}
+
+/*
+ *  Hamming-windowed sinc low-pass with its cutoff at 0.35 of the output
+ *  rate, ACCEL_FIR_SUPPORT output periods long at every decimation, and
+ *  unity gain at DC.  That puts the transition band below the output
+ *  Nyquist frequency: a tone at 0.55 of the output rate is down about
+ *  45 dB, and one at 0.1 passes at 0.95.  The tap count is rounded up
+ *  to a multiple of 4 with zero taps at the old end, so the dot product
+ *  has no tail.
+ */
+void accel_decimator_init(accel_decimator_t *dec, uint8_t decimation)
+{
+    memset(dec, 0, sizeof(*dec));
+    if( decimation < 1 )
+        decimation = 1;
+    if( decimation > ACCEL_MAX_DECIMATION )
+        decimation = ACCEL_MAX_DECIMATION;
+    dec->decimation = decimation;
+
+    uint32_t length = ACCEL_FIR_SUPPORT * decimation + 1;
+    dec->taps = (uint16_t)((length + 3) & ~3u);
+    uint16_t pad = dec->taps - length;
+
+    double cutoff = 0.35 / decimation;          //  cycles per raw sample
+    double sum = 0;
+    for(uint32_t i = 0; i < length; i++ ) {
+        double m = i - (length - 1) / 2.0;
+        double sinc = m == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * m) / (M_PI * m);
+        double window = length > 1 ? 0.54 - 0.46 * cos(2 * M_PI * i / (length - 1)) : 1;
+        dec->coefficients[pad + i] = (float)(sinc * window);
+        sum += sinc * window;
+    }
+    for(uint32_t i = 0; i < length; i++ )
+        dec->coefficients[pad + i] = (float)(dec->coefficients[pad + i] / sum);
+    accel_reset_window(dec);
+}
+
+#ifndef ACCEL_SCALAR
+typedef float accel_v4f __attribute__((vector_size(16)));
+
+static inline accel_v4f accel_load(const float *p)
+{
+    accel_v4f v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+#endif
+
+static inline float accel_dot(const float *h, const float *x, uint16_t taps)
+{
+#ifndef ACCEL_SCALAR
+    accel_v4f acc = { 0, 0, 0, 0 };
+    for(uint16_t i = 0; i < taps; i += 4 )
+        acc += accel_load(h + i) * accel_load(x + i);
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#else
+    float acc = 0;
+    for(uint16_t i = 0; i < taps; i++ )
+        acc += h[i] * x[i];
+    return acc;
+#endif
+}
+
+/*
+ *  Add one raw 3-axis sample (in g).  Every decimation samples this
+ *  fills in *out and returns 1; otherwise it returns 0.
+ */
+int accel_decimator_push(accel_decimator_t *dec, const float *g, uint64_t timestamp, accel_record_t *out)
+{
+    uint16_t taps = dec->taps;
+    for(uint8_t a = 0; a < ACCEL_AXES; a++ ) {
+        float x = g[a];
+        dec->history[a][dec->pos] = x;
+        dec->history[a][dec->pos + taps] = x;
+        if( x < dec->min[a] )
+            dec->min[a] = x;
+        if( x > dec->max[a] )
+            dec->max[a] = x;
+        dec->sumsq[a] += x * x;
+    }
+    //  the window of the last taps samples, oldest first, starts just after pos
+    uint16_t oldest = dec->pos + 1;
+    dec->pos = oldest == taps ? 0 : oldest;
+    if( ++dec->count < dec->decimation )
+        return 0;
+
+    out->timestamp = timestamp;
+    out->samples = dec->count;
+    out->reserved = 0;
+    for(uint8_t a = 0; a < ACCEL_AXES; a++ ) {
+        out->g[a] = accel_dot(dec->coefficients, &dec->history[a][oldest], taps);
+        out->min[a] = dec->min[a];
+        out->max[a] = dec->max[a];
+        out->rms[a] = sqrtf(dec->sumsq[a] / dec->count);
+    }
+    accel_reset_window(dec);
+    return 1;
+}
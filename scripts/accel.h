@@ -0,0 +1,109 @@
+/*
+ *  accel.h
+ *
+ *  ADXL335 3-axis accelerometer, sampled through the ATtiny ADC bridge
+ *  (I2C 0x26) by read_accel and published as decimated records.
+ *
+ *  The sampler reads the three axes at a fixed raw rate and feeds them
+ *  to a decimator: a windowed-sinc FIR low-pass, evaluated only once
+ *  per output sample, plus the min, max and RMS of the raw samples in
+ *  each output window.  The filtered value is what goes into the
+ *  sensors table; min/max/RMS keep the shocks and vibration bursts that
+ *  the filter and the low output rate would otherwise hide, without
+ *  storing the raw stream.  The FIR dot products run four taps at a
+ *  time with GCC vector extensions (-DACCEL_SCALAR for the plain loop).
+ *
+ *  Records go into a ring buffer in POSIX shared memory; there is a
+ *  single writer and readers pull batches with accel_ring_read(), as
+ *  with read_adc.h.  devices/accel.py reads the newest record.
+ */
+
+#ifndef ACCEL_H
+#define ACCEL_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define ACCEL_SHM_NAME          "/hab_accel"
+#define ACCEL_MAGIC             0x41434331      //  'ACC1'
+#define ACCEL_RING_SIZE         1024            //  must be a power of 2
+#define ACCEL_AXES              3
+#define ACCEL_MAX_DECIMATION    64
+#define ACCEL_FIR_SUPPORT       8               //  raw samples of filter per output sample
+#define ACCEL_MAX_TAPS          (ACCEL_FIR_SUPPORT * ACCEL_MAX_DECIMATION + 4)     //  multiple of 4
+
+//  64 bytes; devices/accel.py unpacks this layout
+typedef struct {
+    uint64_t timestamp;                 //  system timer (us) of the last raw sample in the window
+    float g[ACCEL_AXES];                //  low-pass filtered, in g
+    float min[ACCEL_AXES];              //  raw extremes over the window
+    float max[ACCEL_AXES];
+    float rms[ACCEL_AXES];              //  raw RMS over the window, including gravity
+    uint32_t samples;                   //  raw samples in the window
+    uint32_t reserved;
+} accel_record_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t raw_hz;
+    uint32_t output_hz;
+    uint32_t overruns;                  //  raw samples that started late
+    uint32_t errors;                    //  failed bus reads
+    volatile uint32_t head;             //  total records ever written
+    uint32_t reserved;
+    accel_record_t records[ACCEL_RING_SIZE];
+} accel_ring_t;
+
+typedef struct {
+    uint8_t decimation;
+    uint8_t count;                      //  raw samples in the current window
+    uint16_t taps;
+    uint16_t pos;
+    float coefficients[ACCEL_MAX_TAPS];         //  oldest sample's tap first
+    //  each history is doubled, so the last taps samples are always contiguous
+    float history[ACCEL_AXES][2 * ACCEL_MAX_TAPS];
+    float min[ACCEL_AXES];
+    float max[ACCEL_AXES];
+    float sumsq[ACCEL_AXES];
+} accel_decimator_t;
+
+accel_ring_t *accel_ring_create(void);
+const accel_ring_t *accel_ring_open(void);
+void accel_decimator_init(accel_decimator_t *dec, uint8_t decimation);
+int accel_decimator_push(accel_decimator_t *dec, const float *g, uint64_t timestamp, accel_record_t *out);
+
+/*
+ *  Copy up to max records newer than *cursor into out and advance the
+ *  cursor; the same lapping rules as read_adc_ring_read().
+ */
+static inline uint32_t accel_ring_read(const accel_ring_t *ring, uint32_t *cursor,
+        accel_record_t *out, uint32_t max)
+{
+    const uint32_t window = ACCEL_RING_SIZE - 1;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = *cursor;
+    if( head - tail > window )
+        tail = head - window;
+    uint32_t n = head - tail;
+    if( n > max )
+        n = max;
+    for(uint32_t i = 0; i < n; i++ )
+        out[i] = ring->records[(tail + i) & (ACCEL_RING_SIZE - 1)];
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t now = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t lost = 0;
+    if( now - tail > window )
+        lost = (now - tail) - window;
+    if( lost >= n ) {
+        *cursor = now - window;
+        return 0;
+    }
+    if( lost )
+        memmove(out, out + lost, (n - lost) * sizeof(accel_record_t));
+    *cursor = tail + n;
+    return n - lost;
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ *  altitude.c
+ *
+ *  Pressure to altitude kernels, see altitude.h
+ */
+
+#include "altitude.h"
+#include <string.h>
+
+#define ALTITUDE_EXPONENT           0.19029495718363465f    //  1 / 5.255
+#define ALTITUDE_SLP_EXPONENT       -5.257f
+#define ALTITUDE_SCALE_M            44330.0f
+
+//  adding 1.5 * 2^23 leaves a small integer in the low mantissa bits
+#define ALTITUDE_MAGIC              12582912.0f
+#define ALTITUDE_MAGIC_BITS         0x4B400000
+#define ALTITUDE_SQRT_HALF_BITS     0x3F3504F3             //  0.70710678f
+
+/*
+ *  log2(x):  x = m * 2^e with m in [sqrt(1/2), sqrt(2)), and
+ *  log2(m) = 2/ln(2) * atanh(s), s = (m - 1) / (m + 1), |s| < 0.172,
+ *  to the s^7 term.
+ *  exp2(f):  f = n + r with n = round(f), |r| <= 1/2, 2^r to the r^6
+ *  Taylor term, then n is added to the exponent field.
+ *
+ *  ALTITUDE_KERNELS() writes both out for a float type F and the
+ *  matching int32 type I, given bit casts between the two, so the
+ *  scalar and vector paths are the same arithmetic.
+ */
+#define ALTITUDE_KERNELS(suffix, F, I, AS_INT, AS_FLOAT)                        \
+static inline F altitude_log2_##suffix(F x)                                    \
+{                                                                               \
+    I bits = AS_INT(x);                                                         \
+    I e = (bits - ALTITUDE_SQRT_HALF_BITS) >> 23;                               \
+    F m = AS_FLOAT(bits - e * (1 << 23));                                       \
+    F ef = AS_FLOAT(e + ALTITUDE_MAGIC_BITS) - ALTITUDE_MAGIC;                  \
+    F s = (m - 1.0f) / (m + 1.0f);                                              \
+    F s2 = s * s;                                                               \
+    F p = s2 * (1.0f / 7.0f) + 1.0f / 5.0f;                                     \
+    p = p * s2 + 1.0f / 3.0f;                                                   \
+    p = p * s2 + 1.0f;                                                          \
+    return ef + 2.8853900817779268f * s * p;                                    \
+}                                                                               \
+                                                                                \
+static inline F altitude_exp2_##suffix(F f)                                    \
+{                                                                               \
+    F t = f + ALTITUDE_MAGIC;                                                   \
+    I n = AS_INT(t) - ALTITUDE_MAGIC_BITS;                                      \
+    F r = f - (t - ALTITUDE_MAGIC);                                             \
+    F p = r * 1.5403530393381606e-4f + 1.3333558146428443e-3f;                  \
+    p = p * r + 9.6181291076284772e-3f;                                         \
+    p = p * r + 5.5504108664821580e-2f;                                         \
+    p = p * r + 2.4022650695910071e-1f;                                         \
+    p = p * r + 6.9314718055994531e-1f;                                         \
+    p = p * r + 1.0f;                                                           \
+    return AS_FLOAT(AS_INT(p) + n * (1 << 23));                                 \
+}                                                                               \
+                                                                                \
+static inline F altitude_pow_##suffix(F x, float y)                            \
+{                                                                               \
+    return altitude_exp2_##suffix(altitude_log2_##suffix(x) * y);              \
+}                                                                               \
+                                                                                \
+static inline F altitude_from_pressure_##suffix(F p, float inverse_p0)         \
+{                                                                               \
+    return ALTITUDE_SCALE_M * (1.0f - altitude_pow_##suffix(p * inverse_p0, ALTITUDE_EXPONENT)); \
+}                                                                               \
+                                                                                \
+static inline F altitude_slp_##suffix(F p, F h, F t)                           \
+{                                                                               \
+    F scaled = 0.0065f * h;                                                     \
+    F inner = 1.0f - scaled / (t + scaled + 273.15f);                           \
+    return p * altitude_pow_##suffix(inner, ALTITUDE_SLP_EXPONENT);             \
+}
+
+static inline int32_t altitude_as_int(float x)
+{
+    int32_t i;
+    memcpy(&i, &x, sizeof(i));
+    return i;
+}
+
+static inline float altitude_as_float(int32_t i)
+{
+    float x;
+    memcpy(&x, &i, sizeof(x));
+    return x;
+}
+
+ALTITUDE_KERNELS(scalar, float, int32_t, altitude_as_int, altitude_as_float)
+
+#ifndef ALTITUDE_SCALAR
+typedef float altitude_v4f __attribute__((vector_size(16)));
+typedef int32_t altitude_v4i __attribute__((vector_size(16)));
+#define ALTITUDE_V4I(x)     ((altitude_v4i)(x))
+#define ALTITUDE_V4F(x)     ((altitude_v4f)(x))
+
+ALTITUDE_KERNELS(v4, altitude_v4f, altitude_v4i, ALTITUDE_V4I, ALTITUDE_V4F)
+
+//  unaligned loads and stores; memcpy compiles to a single vector move
+static inline altitude_v4f altitude_load(const float *p)
+{
+    altitude_v4f v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void altitude_store(float *p, altitude_v4f v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+#endif
+
+float altitude_pow(float x, float y)
+{
+    return altitude_pow_scalar(x, y);
+}
+
+float altitude_from_pressure(float pressure_pa, float sea_level_pa)
+{
+    return altitude_from_pressure_scalar(pressure_pa, 1.0f / sea_level_pa);
+}
+
+float altitude_sea_level_pressure(float pressure_pa, float altitude_m, float temperature_c)
+{
+    return altitude_slp_scalar(pressure_pa, altitude_m, temperature_c);
+}
+
+void altitude_from_pressure_batch(const float *pressure_pa, float *altitude_m, uint32_t count,
+        float sea_level_pa)
+{
+    float inverse_p0 = 1.0f / sea_level_pa;
+    uint32_t i = 0;
+#ifndef ALTITUDE_SCALAR
+    for(; i + 4 <= count; i += 4 )
+        altitude_store(altitude_m + i, altitude_from_pressure_v4(altitude_load(pressure_pa + i), inverse_p0));
+#endif
+    for(; i < count; i++ )
+        altitude_m[i] = altitude_from_pressure_scalar(pressure_pa[i], inverse_p0);
+}
+
+void altitude_sea_level_pressure_batch(const float *pressure_pa, const float *altitude_m,
+        const float *temperature_c, float *slp_pa, uint32_t count)
+{
+    uint32_t i = 0;
+#ifndef ALTITUDE_SCALAR
+    for(; i + 4 <= count; i += 4 )
+        altitude_store(slp_pa + i, altitude_slp_v4(altitude_load(pressure_pa + i),
+                altitude_load(altitude_m + i), altitude_load(temperature_c + i)));
+#endif
+    for(; i < count; i++ )
+        slp_pa[i] = altitude_slp_scalar(pressure_pa[i], altitude_m[i], temperature_c[i]);
+}
@@ -0,0 +1,46 @@
+/*
+ *  altitude.h
+ *
+ *  Batch pressure to altitude and sea level pressure conversion.
+ *
+ *  Both formulas are powers of a pressure or temperature ratio, which
+ *  the kernels work out as exp2(y * log2(x)) with short polynomials on
+ *  the float's mantissa instead of calling pow().  There are no
+ *  branches or table lookups, so the batch functions run four samples
+ *  at a time with GCC vector extensions (NEON on ARM, SSE on x86) and
+ *  finish the tail with the same arithmetic in scalar form.  Building
+ *  with -DALTITUDE_SCALAR uses the scalar path throughout.
+ *
+ *  Accuracy, against double precision pow(), measured by altitude_test
+ *  over 1..1100 hPa in 0.05 hPa steps:
+ *      altitude                    within ALTITUDE_MAX_ERROR_M
+ *      sea level pressure          within ALTITUDE_MAX_SLP_ERROR (relative), for
+ *                                  altitudes 0..40 km and -90..+60 C
+ *  Most of that is float rounding of the inputs; the polynomials alone
+ *  are good to about 2e-7.
+ */
+
+#ifndef ALTITUDE_H
+#define ALTITUDE_H
+
+#include <stdint.h>
+
+#define ALTITUDE_SEA_LEVEL_PA       101325.0f
+#define ALTITUDE_MAX_ERROR_M        0.02f
+#define ALTITUDE_MAX_SLP_ERROR      2e-6f
+
+//  x^y for x > 0 (normal floats), y * log2(x) within +-126
+float altitude_pow(float x, float y);
+
+//  international barometric formula, 44330 * (1 - (p / p0)^(1 / 5.255))
+float altitude_from_pressure(float pressure_pa, float sea_level_pa);
+
+//  the same reduction Menu.calculateSLP() in helium.py does
+float altitude_sea_level_pressure(float pressure_pa, float altitude_m, float temperature_c);
+
+void altitude_from_pressure_batch(const float *pressure_pa, float *altitude_m, uint32_t count,
+        float sea_level_pa);
+void altitude_sea_level_pressure_batch(const float *pressure_pa, const float *altitude_m,
+        const float *temperature_c, float *slp_pa, uint32_t count);
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ *  altitude_test.c
+ *
+ *  Checks the altitude.c kernels against double precision pow() over
+ *  1..1100 hPa and fails if the error goes past the bounds documented
+ *  in altitude.h, then times the batch kernels against a pow() loop.
+ *
+ *  To compile:
+ *  gcc -O2 altitude_test.c altitude.c -o altitude_test -std=gnu99 -lm
+ *  (add -mfpu=neon on a Pi 2 or later; -DALTITUDE_SCALAR for the scalar path)
+ *
+ */
+
+#include "altitude.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+static uint32_t count = 1000000;
+static int failures = 0;
+
+static void print_usage(const char *prog)
+{
+    printf("Checks and times the altitude kernels\n");
+    printf("Usage: %s [-n]\n", prog);
+    puts(   "-n --count\tsamples per benchmark run (default 1000000), 0 to skip\n");
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "count",      required_argument,  NULL,   'n'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "n:", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'n':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static double reference_altitude(double p)
+{
+    return 44330.0 * (1.0 - pow(p / ALTITUDE_SEA_LEVEL_PA, 1.0 / 5.255));
+}
+
+static double reference_slp(double p, double h, double t)
+{
+    double scaled = 0.0065 * h;
+    return p * pow(1.0 - scaled / (t + scaled + 273.15), -5.257);
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check_accuracy(void)
+{
+    //  1..1100 hPa in 5 Pa steps, through the batch path and its scalar tail
+    enum { N = (110000 - 100) / 5 + 1 };
+    static float p[N], alt[N], h[N], t[N], slp[N];
+    for(uint32_t i = 0; i < N; i++ )
+        p[i] = 100.0f + 5.0f * i;
+    altitude_from_pressure_batch(p, alt, N, ALTITUDE_SEA_LEVEL_PA);
+
+    double worst = 0, worst_p = 0;
+    for(uint32_t i = 0; i < N; i++ ) {
+        double e = fabs(alt[i] - reference_altitude(p[i]));
+        double s = fabs(altitude_from_pressure(p[i], ALTITUDE_SEA_LEVEL_PA) - reference_altitude(p[i]));
+        if( s > e )
+            e = s;
+        if( e > worst ) {
+            worst = e;
+            worst_p = p[i];
+        }
+    }
+    printf("altitude: max error %.4f m at %.0f Pa (bound %.2f m)\n", worst, worst_p, ALTITUDE_MAX_ERROR_M);
+    if( worst > ALTITUDE_MAX_ERROR_M ) {
+        printf("FAIL | altitude error out of bounds\n");
+        failures++;
+    }
+
+    //  sea level pressure over a grid of altitude and temperature
+    worst = 0;
+    for(uint32_t i = 0; i < N; i++ ) {
+        h[i] = (i * 7919u % 40001u);
+        t[i] = -90.0f + (i * 104729u % 1501u) / 10.0f;
+    }
+    altitude_sea_level_pressure_batch(p, h, t, slp, N);
+    for(uint32_t i = 0; i < N; i++ ) {
+        double ref = reference_slp(p[i], h[i], t[i]);
+        double e = fabs(slp[i] - ref) / ref;
+        if( e > worst )
+            worst = e;
+    }
+    printf("sea level pressure: max relative error %.2e (bound %.0e)\n", worst, ALTITUDE_MAX_SLP_ERROR);
+    if( worst > ALTITUDE_MAX_SLP_ERROR ) {
+        printf("FAIL | sea level pressure error out of bounds\n");
+        failures++;
+    }
+}
+
+static void bench(void)
+{
+    float *p = malloc(count * sizeof(float));
+    float *alt = malloc(count * sizeof(float));
+    if( p == NULL || alt == NULL ) {
+        perror("malloc");
+        exit(1);
+    }
+    for(uint32_t i = 0; i < count; i++ )
+        p[i] = 100.0f + (i % 109901);
+
+    double a = now_s();
+    for(uint32_t i = 0; i < count; i++ )
+        alt[i] = (float)(44330.0 * (1.0 - pow(p[i] / ALTITUDE_SEA_LEVEL_PA, 0.1903)));
+    double b = now_s();
+    for(uint32_t i = 0; i < count; i++ )
+        alt[i] = 44330.0f * (1.0f - powf(p[i] / ALTITUDE_SEA_LEVEL_PA, 0.1903f));
+    double c = now_s();
+    altitude_from_pressure_batch(p, alt, count, ALTITUDE_SEA_LEVEL_PA);
+    double d = now_s();
+
+    printf("pow():  %6.1f ns/sample\n", (b - a) * 1e9 / count);
+    printf("powf(): %6.1f ns/sample\n", (c - b) * 1e9 / count);
+    printf("kernel: %6.1f ns/sample (%.1fx pow())\n", (d - c) * 1e9 / count, (b - a) / (d - c));
+    free(p);
+    free(alt);
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    check_accuracy();
+    if( count )
+        bench();
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
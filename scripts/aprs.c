@@ -0,0 +1,314 @@
+/*
+ *  aprs.c
+ *
+ *  AX.25 UI frames, HDLC line coding and AFSK-1200 for APRS
+ */
+
+#include "aprs.h"
+#include <stdio.h>
+#include <string.h>
+
+//  CRC-16/X.25, reflected polynomial 0x8408
+static const uint16_t fcs_table[256] = {
+    0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
+    0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
+    0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
+    0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
+    0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
+    0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
+    0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
+    0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
+    0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
+    0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
+    0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
+    0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
+    0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
+    0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
+    0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
+    0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
+    0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
+    0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
+    0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
+    0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
+    0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
+    0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
+    0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
+    0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
+    0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
+    0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
+    0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
+    0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
+    0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
+    0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
+    0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
+    0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78,
+};
+
+//  one cycle of APRS_AMPLITUDE * sin(), indexed by the top APRS_SINE_BITS of the phase
+static const int16_t sine_table[1 << APRS_SINE_BITS] = {
+         0,    402,    804,   1205,   1606,   2005,   2404,   2801,
+      3196,   3590,   3981,   4370,   4756,   5139,   5519,   5896,
+      6270,   6639,   7005,   7366,   7723,   8075,   8423,   8765,
+      9102,   9433,   9759,  10079,  10393,  10701,  11002,  11297,
+     11585,  11865,  12139,  12405,  12664,  12915,  13159,  13394,
+     13622,  13841,  14052,  14255,  14449,  14634,  14810,  14977,
+     15136,  15285,  15425,  15556,  15678,  15790,  15892,  15985,
+     16068,  16142,  16206,  16260,  16304,  16339,  16363,  16378,
+     16383,  16378,  16363,  16339,  16304,  16260,  16206,  16142,
+     16068,  15985,  15892,  15790,  15678,  15556,  15425,  15285,
+     15136,  14977,  14810,  14634,  14449,  14255,  14052,  13841,
+     13622,  13394,  13159,  12915,  12664,  12405,  12139,  11865,
+     11585,  11297,  11002,  10701,  10393,  10079,   9759,   9433,
+      9102,   8765,   8423,   8075,   7723,   7366,   7005,   6639,
+      6270,   5896,   5519,   5139,   4756,   4370,   3981,   3590,
+      3196,   2801,   2404,   2005,   1606,   1205,    804,    402,
+         0,   -402,   -804,  -1205,  -1606,  -2005,  -2404,  -2801,
+     -3196,  -3590,  -3981,  -4370,  -4756,  -5139,  -5519,  -5896,
+     -6270,  -6639,  -7005,  -7366,  -7723,  -8075,  -8423,  -8765,
+     -9102,  -9433,  -9759, -10079, -10393, -10701, -11002, -11297,
+    -11585, -11865, -12139, -12405, -12664, -12915, -13159, -13394,
+    -13622, -13841, -14052, -14255, -14449, -14634, -14810, -14977,
+    -15136, -15285, -15425, -15556, -15678, -15790, -15892, -15985,
+    -16068, -16142, -16206, -16260, -16304, -16339, -16363, -16378,
+    -16383, -16378, -16363, -16339, -16304, -16260, -16206, -16142,
+    -16068, -15985, -15892, -15790, -15678, -15556, -15425, -15285,
+    -15136, -14977, -14810, -14634, -14449, -14255, -14052, -13841,
+    -13622, -13394, -13159, -12915, -12664, -12405, -12139, -11865,
+    -11585, -11297, -11002, -10701, -10393, -10079,  -9759,  -9433,
+     -9102,  -8765,  -8423,  -8075,  -7723,  -7366,  -7005,  -6639,
+     -6270,  -5896,  -5519,  -5139,  -4756,  -4370,  -3981,  -3590,
+     -3196,  -2801,  -2404,  -2005,  -1606,  -1205,   -804,   -402,
+};
+
+uint16_t aprs_fcs(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for(size_t i = 0; i < length; i++ )
+        crc = (crc >> 8) ^ fcs_table[(crc ^ data[i]) & 0xFF];
+    return crc ^ 0xFFFF;
+}
+
+/*
+ *  Write the 7 byte AX.25 form of an address: the callsign shifted left
+ *  one bit and padded with spaces, then the SSID byte.  last marks the
+ *  final address of the header.  Returns 7, or -1 for a bad callsign.
+ */
+int aprs_encode_address(const aprs_address_t *address, uint8_t last, uint8_t *out)
+{
+    size_t length = strnlen(address->callsign, sizeof(address->callsign));
+    if( length == 0 || length > 6 || address->ssid > 15 )
+        return -1;
+    for(uint8_t i = 0; i < 6; i++ ) {
+        char c = i < length ? address->callsign[i] : ' ';
+        if( !((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == ' ') )
+            return -1;
+        out[i] = (uint8_t)c << 1;
+    }
+    out[6] = 0x60 | (address->ssid << 1) | (last ? 0x01 : 0x00);
+    return 7;
+}
+
+/*
+ *  Build a UI frame: addresses (destination first, then source and any
+ *  digipeaters), control 0x03, PID 0xF0 (no layer 3), the information
+ *  field and the FCS, low byte first.  Returns the frame length or -1.
+ */
+int aprs_build_frame(const aprs_address_t *addresses, uint8_t count,
+                     const uint8_t *info, size_t info_length,
+                     uint8_t *frame, size_t size)
+{
+    if( count < 2 || count > APRS_MAX_ADDRESSES || info_length > APRS_MAX_INFO )
+        return -1;
+    size_t length = (size_t)count * 7 + 2 + info_length;
+    if( size < length + 2 )
+        return -1;
+
+    uint8_t *p = frame;
+    for(uint8_t i = 0; i < count; i++ ) {
+        if( aprs_encode_address(&addresses[i], i == count - 1, p) < 0 )
+            return -1;
+        p += 7;
+    }
+    frame[6] |= 0x80;       //  command frame: C bit on the destination
+    *p++ = 0x03;
+    *p++ = 0xF0;
+    memcpy(p, info, info_length);
+
+    uint16_t fcs = aprs_fcs(frame, length);
+    frame[length] = fcs & 0xFF;
+    frame[length + 1] = fcs >> 8;
+    return length + 2;
+}
+
+//  degrees to hundredths of a minute, rounded once so 59.995' carries into the degrees
+static uint32_t aprs_hundredth_minutes(double degrees)
+{
+    if( degrees < 0 )
+        degrees = -degrees;
+    return (uint32_t)(degrees * 6000.0 + 0.5);
+}
+
+/*
+ *  Uncompressed position without timestamp:
+ *  !DDMM.mmN/DDDMM.mmWO/A=aaaaaacomment
+ *  Returns the length written (excluding the NUL) or -1.
+ */
+int aprs_format_position(const aprs_position_t *position, char *buf, size_t size)
+{
+    if( position->latitude < -90.0 || position->latitude > 90.0 ||
+            position->longitude < -180.0 || position->longitude > 180.0 )
+        return -1;
+
+    uint32_t lat = aprs_hundredth_minutes(position->latitude);
+    uint32_t lon = aprs_hundredth_minutes(position->longitude);
+    int32_t feet = (int32_t)(position->altitude_m * 3.28084 + (position->altitude_m < 0 ? -0.5 : 0.5));
+    if( feet > 999999 )
+        feet = 999999;
+    if( feet < -99999 )
+        feet = -99999;
+
+    int n = snprintf(buf, size, "!%02u%02u.%02u%c%c%03u%02u.%02u%c%c/A=%06d%s",
+                     lat / 6000, (lat % 6000) / 100, lat % 100,
+                     position->latitude < 0 ? 'S' : 'N',
+                     position->symbol_table,
+                     lon / 6000, (lon % 6000) / 100, lon % 100,
+                     position->longitude < 0 ? 'W' : 'E',
+                     position->symbol,
+                     feet,
+                     position->comment ? position->comment : "");
+    if( n < 0 || (size_t)n >= size || n > APRS_MAX_INFO )
+        return -1;
+    return n;
+}
+
+/*
+ *  Telemetry report: T#sss,aaa,aaa,aaa,aaa,aaa,bbbbbbbb
+ *  Returns the length written (excluding the NUL) or -1.
+ */
+int aprs_format_telemetry(const aprs_telemetry_t *telemetry, char *buf, size_t size)
+{
+    char digital[9];
+    for(uint8_t i = 0; i < 8; i++ )
+        digital[i] = (telemetry->digital & (0x80 >> i)) ? '1' : '0';
+    digital[8] = '\0';
+
+    int n = snprintf(buf, size, "T#%03u,%03u,%03u,%03u,%03u,%03u,%s",
+                     telemetry->sequence % 1000,
+                     telemetry->analog[0], telemetry->analog[1], telemetry->analog[2],
+                     telemetry->analog[3], telemetry->analog[4], digital);
+    if( n < 0 || (size_t)n >= size )
+        return -1;
+    return n;
+}
+
+/*
+ *  Line coder state.  Bits are packed LSB first, which is also the
+ *  order AX.25 sends each byte in.
+ */
+typedef struct {
+    uint8_t *bits;
+    size_t size;            //  capacity in bits
+    size_t count;
+    uint8_t level;          //  NRZI line level, 1 = mark
+    uint8_t ones;           //  consecutive ones, for stuffing
+} aprs_line_t;
+
+//  NRZI: a 0 changes the tone, a 1 keeps it
+static void aprs_line_put(aprs_line_t *line, uint8_t bit)
+{
+    if( !bit )
+        line->level ^= 1;
+    uint8_t mask = 1 << (line->count & 7);
+    if( line->level )
+        line->bits[line->count >> 3] |= mask;
+    else
+        line->bits[line->count >> 3] &= ~mask;
+    line->count++;
+}
+
+static void aprs_line_flags(aprs_line_t *line, uint8_t n)
+{
+    for(uint8_t i = 0; i < n; i++ ) {
+        for(uint8_t b = 0; b < 8; b++ )
+            aprs_line_put(line, (APRS_FLAG >> b) & 1);
+    }
+    line->ones = 0;
+}
+
+/*
+ *  Flags, the bit-stuffed frame, then flags again, NRZI coded into
+ *  bits[] (size bytes).  Returns the number of line bits, or 0 when
+ *  the output is too small; APRS_MAX_LINE_BITS() gives a safe size.
+ */
+size_t aprs_hdlc_encode(const uint8_t *frame, size_t length,
+                        uint8_t preamble, uint8_t postamble,
+                        uint8_t *bits, size_t size)
+{
+    aprs_line_t line = { bits, size * 8, 0, 1, 0 };
+    if( line.size < APRS_MAX_LINE_BITS(length, preamble + postamble) )
+        return 0;
+
+    aprs_line_flags(&line, preamble);
+    for(size_t i = 0; i < length; i++ ) {
+        for(uint8_t b = 0; b < 8; b++ ) {
+            uint8_t bit = (frame[i] >> b) & 1;
+            aprs_line_put(&line, bit);
+            if( bit && ++line.ones == 5 ) {
+                aprs_line_put(&line, 0);
+                line.ones = 0;
+            } else if( !bit ) {
+                line.ones = 0;
+            }
+        }
+    }
+    aprs_line_flags(&line, postamble);
+    return line.count;
+}
+
+/*
+ *  Phase steps are fixed point fractions of a cycle, so any sample rate
+ *  works; the bit clock accumulates APRS_BAUD per sample and moves to
+ *  the next bit each time it passes the sample rate, which keeps
+ *  1200 baud exact at rates such as 44100 Hz that aren't a multiple.
+ *  To send another packet with the same settings just zero ->bit.
+ */
+void aprs_afsk_init(aprs_afsk_t *afsk, uint32_t sample_rate)
+{
+    afsk->sample_rate = sample_rate;
+    afsk->mark_step = (uint32_t)(((uint64_t)APRS_MARK_HZ << 32) / sample_rate);
+    afsk->space_step = (uint32_t)(((uint64_t)APRS_SPACE_HZ << 32) / sample_rate);
+    afsk->phase = 0;
+    afsk->bit_clock = 0;
+    afsk->bit = 0;
+}
+
+/*
+ *  Synthesize up to count samples of the line bits, continuing from
+ *  where the previous call stopped.  The phase is continuous across
+ *  tone changes.  Returns the number of samples written; fewer than
+ *  count (or 0) means the packet is finished.
+ */
+size_t aprs_afsk_modulate(aprs_afsk_t *afsk, const uint8_t *bits, size_t nbits,
+                          int16_t *samples, size_t count)
+{
+    size_t n = 0;
+    uint32_t phase = afsk->phase;
+    uint32_t bit_clock = afsk->bit_clock;
+    size_t bit = afsk->bit;
+
+    while( n < count && bit < nbits ) {
+        uint32_t step = (bits[bit >> 3] >> (bit & 7)) & 1 ? afsk->mark_step : afsk->space_step;
+        samples[n++] = sine_table[phase >> (32 - APRS_SINE_BITS)];
+        phase += step;
+        bit_clock += APRS_BAUD;
+        if( bit_clock >= afsk->sample_rate ) {
+            bit_clock -= afsk->sample_rate;
+            bit++;
+        }
+    }
+
+    afsk->phase = phase;
+    afsk->bit_clock = bit_clock;
+    afsk->bit = bit;
+    return n;
+}
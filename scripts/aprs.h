@@ -0,0 +1,91 @@
+/*
+ *  aprs.h
+ *
+ *  APRS transmit pipeline for the SRB-MX146LV (tuned with srbmx145 --aprs).
+ *
+ *      position / telemetry text
+ *          -> AX.25 UI frame with FCS          aprs_build_frame()
+ *          -> HDLC flags, bit stuffing, NRZI   aprs_hdlc_encode()
+ *          -> AFSK-1200 samples                aprs_afsk_modulate()
+ *
+ *  Every stage writes into caller storage; nothing is allocated after
+ *  aprs_afsk_init().  The modulator keeps its position between calls so
+ *  a PWM or audio buffer can be refilled in chunks of any size.
+ *
+ *  No hardware is touched here, so the whole pipeline can be tested and
+ *  benchmarked on any machine (see aprs_test.c).
+ */
+
+#ifndef APRS_H
+#define APRS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define APRS_MAX_ADDRESSES      4       //  destination, source, two digipeaters
+#define APRS_MAX_INFO           256     //  AX.25 allows 256 bytes of information
+#define APRS_MAX_FRAME          (APRS_MAX_ADDRESSES * 7 + 2 + APRS_MAX_INFO + 2)
+
+#define APRS_FLAG               0x7E
+#define APRS_PREAMBLE_FLAGS     32      //  ~213 ms at 1200 baud for the radio to key up
+#define APRS_POSTAMBLE_FLAGS    3
+
+//  worst case line bits: every fifth bit stuffed, plus the flags
+#define APRS_MAX_LINE_BITS(frame_length, flags) \
+    (((frame_length) * 8 * 6 + 4) / 5 + (flags) * 8)
+#define APRS_MAX_LINE_BYTES(frame_length, flags) \
+    ((APRS_MAX_LINE_BITS(frame_length, flags) + 7) / 8)
+
+#define APRS_BAUD               1200
+#define APRS_MARK_HZ            1200
+#define APRS_SPACE_HZ           2200
+#define APRS_SINE_BITS          8       //  256 entry sine table
+#define APRS_AMPLITUDE          16383   //  half scale, leaves headroom for PWM filters
+
+typedef struct {
+    char callsign[7];           //  up to six characters, NUL terminated
+    uint8_t ssid;               //  0-15
+} aprs_address_t;
+
+typedef struct {
+    double latitude;            //  degrees, north positive
+    double longitude;           //  degrees, east positive
+    int32_t altitude_m;         //  sent as /A= in feet
+    char symbol_table;          //  '/' primary, '\\' alternate
+    char symbol;                //  'O' is a balloon
+    const char *comment;        //  optional, may be NULL
+} aprs_position_t;
+
+typedef struct {
+    uint16_t sequence;          //  0-999
+    uint8_t analog[5];
+    uint8_t digital;            //  bit 7 is sent first
+} aprs_telemetry_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint32_t mark_step;         //  phase increments, 2^32 per cycle
+    uint32_t space_step;
+    uint32_t phase;
+    uint32_t bit_clock;         //  advances by APRS_BAUD per sample
+    size_t bit;                 //  next line bit to send
+} aprs_afsk_t;
+
+uint16_t aprs_fcs(const uint8_t *data, size_t length);
+int aprs_encode_address(const aprs_address_t *address, uint8_t last, uint8_t *out);
+int aprs_build_frame(const aprs_address_t *addresses, uint8_t count,
+                     const uint8_t *info, size_t info_length,
+                     uint8_t *frame, size_t size);
+
+int aprs_format_position(const aprs_position_t *position, char *buf, size_t size);
+int aprs_format_telemetry(const aprs_telemetry_t *telemetry, char *buf, size_t size);
+
+size_t aprs_hdlc_encode(const uint8_t *frame, size_t length,
+                        uint8_t preamble, uint8_t postamble,
+                        uint8_t *bits, size_t size);
+
+void aprs_afsk_init(aprs_afsk_t *afsk, uint32_t sample_rate);
+size_t aprs_afsk_modulate(aprs_afsk_t *afsk, const uint8_t *bits, size_t nbits,
+                          int16_t *samples, size_t count);
+
+#endif
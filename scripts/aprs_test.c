@@ -0,0 +1,324 @@
+/*
+ *  aprs_test.c
+ *
+ *  Exercises the APRS pipeline without the radio.  By default it checks
+ *  the FCS, address, report, frame and line coding against known-good
+ *  vectors, then demodulates the AFSK output and decodes the HDLC
+ *  stream to make sure the original frame comes back.  --bench times
+ *  the whole pipeline, and --write saves a packet as raw 16-bit PCM,
+ *  e.g. for "multimon-ng -t raw -a AFSK1200" at -r 22050.
+ *
+ *  To compile:
+ *  gcc aprs_test.c aprs.c -o aprs_test -std=gnu99 -O2 -lm
+ *
+ */
+
+#include "aprs.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#define CHUNK   1024    //  samples per refill, as a PWM/DMA buffer would take them
+
+static uint32_t sample_rate = 48000;
+static uint32_t bench_iterations = 0;
+static const char *wav_path = NULL;
+static int failures = 0;
+
+static const aprs_address_t path[] = {
+    { "APRS", 0 },
+    { "N0CALL", 11 },
+    { "WIDE2", 1 },
+};
+
+static void print_usage(const char *prog)
+{
+    printf("Tests the APRS / AFSK-1200 pipeline\n");
+    printf("Usage: %s [-rbw]\n", prog);
+    puts(   "-r --rate\tsample rate in Hz (default 48000)\n"
+            "-b --bench\ttime this many packets through the whole pipeline\n"
+            "-w --write\twrite a test packet to this file as raw s16le PCM\n"
+         );
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "rate",   required_argument,  NULL,   'r'},
+            { "bench",  required_argument,  NULL,   'b'},
+            { "write",  required_argument,  NULL,   'w'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "r:b:w:", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'r':
+                sample_rate = strtoul(optarg, NULL, 10);
+                if( sample_rate < 8000 )
+                    print_usage(argv[0]);
+                break;
+            case 'b':
+                bench_iterations = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                wav_path = optarg;
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static void check(int ok, const char *what)
+{
+    if( !ok ) {
+        printf("FAIL | %s\n", what);
+        failures++;
+    }
+}
+
+static uint8_t get_bit(const uint8_t *bits, size_t i)
+{
+    return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+/*
+ *  Reference receiver: mark/space energy over each bit period.  The
+ *  modulator starts every bit on a sample boundary, so no clock
+ *  recovery is needed here.
+ */
+static size_t demodulate(const int16_t *samples, size_t count, uint8_t *bits, size_t size)
+{
+    size_t nbits = 0;
+    for(size_t start = 0; start < count && nbits < size * 8; nbits++ ) {
+        size_t end = (size_t)(((uint64_t)(nbits + 1) * sample_rate + APRS_BAUD - 1) / APRS_BAUD);
+        if( end > count )
+            end = count;
+        double mi = 0, mq = 0, si = 0, sq = 0;
+        for(size_t n = start; n < end; n++ ) {
+            double t = (double)n / sample_rate;
+            mi += samples[n] * cos(2 * M_PI * APRS_MARK_HZ * t);
+            mq += samples[n] * sin(2 * M_PI * APRS_MARK_HZ * t);
+            si += samples[n] * cos(2 * M_PI * APRS_SPACE_HZ * t);
+            sq += samples[n] * sin(2 * M_PI * APRS_SPACE_HZ * t);
+        }
+        uint8_t mask = 1 << (nbits & 7);
+        if( mi * mi + mq * mq > si * si + sq * sq )
+            bits[nbits >> 3] |= mask;
+        else
+            bits[nbits >> 3] &= ~mask;
+        start = end;
+    }
+    return nbits;
+}
+
+//  NRZI decode, drop stuffed zeros and return the first frame between flags
+static int hdlc_decode(const uint8_t *bits, size_t nbits, uint8_t *frame, size_t size)
+{
+    uint8_t level = 1, ones = 0;
+    size_t count = 0;
+    for(size_t i = 0; i < nbits; i++ ) {
+        uint8_t bit = get_bit(bits, i) == level;
+        level = get_bit(bits, i);
+        if( bit ) {
+            ones++;
+        } else if( ones == 5 ) {
+            ones = 0;
+            continue;
+        } else if( ones == 6 ) {
+            //  the flag's leading 0 and six 1s have already been stored
+            ones = 0;
+            if( count > 7 && (count - 7) % 8 == 0 )
+                return (count - 7) / 8;
+            count = 0;
+            continue;
+        } else {
+            ones = 0;
+        }
+        if( count / 8 >= size )
+            return -1;
+        if( count % 8 == 0 )
+            frame[count / 8] = 0;
+        frame[count / 8] |= bit << (count % 8);
+        count++;
+    }
+    return -1;
+}
+
+static void test_vectors(void)
+{
+    char text[APRS_MAX_INFO + 1];
+    uint8_t frame[APRS_MAX_FRAME];
+    uint8_t address[7];
+
+    check(aprs_fcs((const uint8_t *)"123456789", 9) == 0x906E, "FCS check value");
+
+    static const uint8_t n0call_9[] = { 0x9C, 0x60, 0x86, 0x82, 0x98, 0x98, 0x73 };
+    static const aprs_address_t a = { "N0CALL", 9 };
+    check(aprs_encode_address(&a, 1, address) == 7 &&
+          memcmp(address, n0call_9, sizeof(address)) == 0, "address N0CALL-9");
+    static const aprs_address_t lower = { "n0call", 0 };
+    check(aprs_encode_address(&lower, 1, address) < 0, "reject lower case callsign");
+    static const aprs_address_t ssid = { "N0CALL", 16 };
+    check(aprs_encode_address(&ssid, 1, address) < 0, "reject SSID 16");
+
+    aprs_position_t p = { 49.0583333, -72.0291667, 0, '/', '>', NULL };
+    check(aprs_format_position(&p, text, sizeof(text)) > 0 &&
+          strcmp(text, "!4903.50N/07201.75W>/A=000000") == 0, "position");
+    aprs_position_t balloon = { -33.8688, 151.2093, 30480, '/', 'O', " HAB" };
+    check(aprs_format_position(&balloon, text, sizeof(text)) > 0 &&
+          strcmp(text, "!3352.13S/15112.56EO/A=100000 HAB") == 0, "balloon position");
+    aprs_position_t carry = { 10.99999999, 0, 0, '/', 'O', NULL };
+    check(aprs_format_position(&carry, text, sizeof(text)) > 0 &&
+          strncmp(text, "!1100.00N", 9) == 0, "minutes carry into degrees");
+    check(aprs_format_position(&p, text, 10) < 0, "reject short position buffer");
+
+    aprs_telemetry_t t = { 5, { 199, 0, 255, 73, 123 }, 0x69 };
+    check(aprs_format_telemetry(&t, text, sizeof(text)) > 0 &&
+          strcmp(text, "T#005,199,000,255,073,123,01101001") == 0, "telemetry");
+
+    static const uint8_t golden[] = {
+        0x82, 0xA0, 0xA4, 0xA6, 0x40, 0x40, 0xE0, 0x9C,
+        0x60, 0x86, 0x82, 0x98, 0x98, 0x76, 0xAE, 0x92,
+        0x88, 0x8A, 0x64, 0x40, 0x63, 0x03, 0xF0, 0x21,
+        0x34, 0x39, 0x30, 0x33, 0x2E, 0x35, 0x30, 0x4E,
+        0x2F, 0x30, 0x37, 0x32, 0x30, 0x31, 0x2E, 0x37,
+        0x35, 0x57, 0x3E, 0xEF, 0x60,
+    };
+    static const char *info = "!4903.50N/07201.75W>";
+    check(aprs_build_frame(path, 3, (const uint8_t *)info, strlen(info), frame, sizeof(frame)) == sizeof(golden) &&
+          memcmp(frame, golden, sizeof(golden)) == 0, "UI frame");
+    check(aprs_build_frame(path, 3, (const uint8_t *)info, strlen(info), frame, sizeof(golden) - 1) < 0,
+          "reject short frame buffer");
+    check(aprs_build_frame(path, 1, (const uint8_t *)info, strlen(info), frame, sizeof(frame)) < 0,
+          "reject frame without source");
+
+    //  0xFF needs a stuffed zero after the fifth one
+    static const uint8_t ones[] = { 0xFF };
+    static const uint8_t ones_line[] = { 0x80, 0x1F, 0xFE, 0x00 };
+    uint8_t bits[APRS_MAX_LINE_BYTES(1, 2)] = { 0 };
+    check(aprs_hdlc_encode(ones, 1, 1, 1, bits, sizeof(bits)) == 25 &&
+          memcmp(bits, ones_line, sizeof(ones_line)) == 0, "HDLC stuffing and NRZI");
+    check(aprs_hdlc_encode(golden, sizeof(golden), 1, 1, bits, sizeof(bits)) == 0, "reject short line buffer");
+}
+
+static void test_round_trip(void)
+{
+    static uint8_t bits[APRS_MAX_LINE_BYTES(APRS_MAX_FRAME, APRS_PREAMBLE_FLAGS + APRS_POSTAMBLE_FLAGS)];
+    static uint8_t received[sizeof(bits)];
+    static int16_t samples[200000];
+    static int16_t chunked[200000];
+    uint8_t frame[APRS_MAX_FRAME], decoded[APRS_MAX_FRAME];
+    char info[APRS_MAX_INFO + 1];
+
+    aprs_position_t p = { 51.4778, -0.0014, 12345, '/', 'O', " round trip" };
+    int info_length = aprs_format_position(&p, info, sizeof(info));
+    int length = aprs_build_frame(path, 3, (const uint8_t *)info, info_length, frame, sizeof(frame));
+    size_t nbits = aprs_hdlc_encode(frame, length, 4, 2, bits, sizeof(bits));
+    check(nbits > 0, "encode round trip frame");
+
+    aprs_afsk_t afsk;
+    aprs_afsk_init(&afsk, sample_rate);
+    size_t count = aprs_afsk_modulate(&afsk, bits, nbits, samples, sizeof(samples) / sizeof(samples[0]));
+    check(count == (nbits * sample_rate + APRS_BAUD - 1) / APRS_BAUD, "sample count");
+
+    //  refilling in odd sized chunks must give the same waveform
+    size_t total = 0, n;
+    aprs_afsk_init(&afsk, sample_rate);
+    while( (n = aprs_afsk_modulate(&afsk, bits, nbits, chunked + total, 37)) > 0 )
+        total += n;
+    check(total == count && memcmp(samples, chunked, count * sizeof(samples[0])) == 0, "chunked modulation");
+
+    size_t rbits = demodulate(samples, count, received, sizeof(received));
+    uint32_t errors = 0;
+    for(size_t i = 0; i < nbits && i < rbits; i++ )
+        errors += get_bit(bits, i) != get_bit(received, i);
+    check(rbits == nbits && errors == 0, "AFSK demodulates to the line bits");
+
+    int dlength = hdlc_decode(received, rbits, decoded, sizeof(decoded));
+    check(dlength == length && memcmp(decoded, frame, length) == 0, "HDLC decodes to the frame");
+    check(dlength > 2 && aprs_fcs(decoded, dlength - 2) == (decoded[dlength - 2] | (decoded[dlength - 1] << 8)),
+          "decoded FCS");
+}
+
+static void write_packet(const char *file)
+{
+    static uint8_t bits[APRS_MAX_LINE_BYTES(APRS_MAX_FRAME, APRS_PREAMBLE_FLAGS + APRS_POSTAMBLE_FLAGS)];
+    int16_t samples[CHUNK];
+    uint8_t frame[APRS_MAX_FRAME];
+    char info[APRS_MAX_INFO + 1];
+
+    aprs_position_t p = { 49.0583333, -72.0291667, 1000, '/', 'O', " aprs_test" };
+    int info_length = aprs_format_position(&p, info, sizeof(info));
+    int length = aprs_build_frame(path, 3, (const uint8_t *)info, info_length, frame, sizeof(frame));
+    size_t nbits = aprs_hdlc_encode(frame, length, APRS_PREAMBLE_FLAGS, APRS_POSTAMBLE_FLAGS, bits, sizeof(bits));
+
+    FILE *f = fopen(file, "wb");
+    if( f == NULL ) {
+        perror(file);
+        failures++;
+        return;
+    }
+    aprs_afsk_t afsk;
+    aprs_afsk_init(&afsk, sample_rate);
+    size_t n;
+    while( (n = aprs_afsk_modulate(&afsk, bits, nbits, samples, CHUNK)) > 0 )
+        fwrite(samples, sizeof(samples[0]), n, f);
+    fclose(f);
+    printf("wrote %s: %s at %u Hz\n", file, info, sample_rate);
+}
+
+static void bench(uint32_t iterations)
+{
+    static uint8_t bits[APRS_MAX_LINE_BYTES(APRS_MAX_FRAME, APRS_PREAMBLE_FLAGS + APRS_POSTAMBLE_FLAGS)];
+    int16_t samples[CHUNK];
+    uint8_t frame[APRS_MAX_FRAME];
+    char info[APRS_MAX_INFO + 1];
+    volatile int32_t sink = 0;
+    uint64_t total = 0;
+    struct timespec t0, t1;
+    aprs_afsk_t afsk;
+
+    aprs_afsk_init(&afsk, sample_rate);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(uint32_t i = 0; i < iterations; i++ ) {
+        aprs_position_t p = { 40.0 + i * 1e-6, -105.0, (int32_t)(i % 30000), '/', 'O', NULL };
+        int info_length = aprs_format_position(&p, info, sizeof(info));
+        int length = aprs_build_frame(path, 3, (const uint8_t *)info, info_length, frame, sizeof(frame));
+        size_t nbits = aprs_hdlc_encode(frame, length, APRS_PREAMBLE_FLAGS, APRS_POSTAMBLE_FLAGS, bits, sizeof(bits));
+        size_t n;
+        afsk.bit = 0;
+        while( (n = aprs_afsk_modulate(&afsk, bits, nbits, samples, CHUNK)) > 0 ) {
+            sink += samples[n - 1];
+            total += n;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("bench: %u packets, %llu samples in %.3f s: %.1f us/packet, %.0fx real time at %u Hz\n",
+           iterations, (unsigned long long)total, s, s * 1e6 / iterations,
+           total / (double)sample_rate / s, sample_rate);
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    test_vectors();
+    test_round_trip();
+    if( wav_path )
+        write_packet(wav_path);
+    if( bench_iterations )
+        bench(bench_iterations);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
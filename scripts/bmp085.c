@@ -0,0 +1,223 @@
+/*
+ *  bmp085.c
+ *
+ *  BMP085 driver, see bmp085.h
+ */
+
+#include "bmp085.h"
+#include "altitude.h"
+#include <bcm2835.h>
+#include <string.h>
+#include <time.h>
+
+#define BMP085_REG_CALIBRATION      0xAA
+#define BMP085_REG_CONTROL          0xF4
+#define BMP085_REG_DATA             0xF6
+#define BMP085_CMD_TEMPERATURE      0x2E
+#define BMP085_CMD_PRESSURE         0x34
+#define BMP085_TEMPERATURE_US       4500
+
+enum {
+    BMP085_PHASE_IDLE,
+    BMP085_PHASE_TEMPERATURE,
+    BMP085_PHASE_PRESSURE,
+};
+
+//  datasheet maximum conversion times for oss 0..3
+static const uint32_t bmp085_pressure_us[4] = { 4500, 7500, 13500, 25500 };
+
+uint32_t bmp085_conversion_us(uint8_t oss)
+{
+    return bmp085_pressure_us[oss & 3];
+}
+
+static int bmp085_write_reg(uint8_t reg, uint8_t value)
+{
+    char buf[2] = { (char)reg, (char)value };
+    bcm2835_i2c_setSlaveAddress(BMP085_ADDRESS);
+    return bcm2835_i2c_write(buf, sizeof(buf)) == BCM2835_I2C_REASON_OK ? 0 : BMP085_EIO;
+}
+
+//  register address then a repeated start, so the read is one transaction
+static int bmp085_read_regs(uint8_t reg, uint8_t *buf, uint32_t length)
+{
+    char addr = (char)reg;
+    bcm2835_i2c_setSlaveAddress(BMP085_ADDRESS);
+    return bcm2835_i2c_read_register_rs(&addr, (char *)buf, length) == BCM2835_I2C_REASON_OK ? 0 : BMP085_EIO;
+}
+
+static int bmp085_fail(bmp085_t *dev, int err)
+{
+    dev->phase = BMP085_PHASE_IDLE;
+    dev->errors++;
+    return err;
+}
+
+int bmp085_init(bmp085_t *dev, uint8_t oss, uint8_t burst, int32_t sea_level_pa)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->oss = oss & 3;
+    dev->burst = burst == 0 ? 1 : burst > BMP085_MAX_BURST ? BMP085_MAX_BURST : burst;
+    dev->sea_level_pa = sea_level_pa ? sea_level_pa : BMP085_SEA_LEVEL_PA;
+
+    //  pins to ALT0 only; the bus clock is left at whatever the kernel set it to
+    bcm2835_i2c_begin();
+
+    //  AC1..MD are eleven big-endian words starting at 0xAA
+    uint8_t e[22];
+    if( bmp085_read_regs(BMP085_REG_CALIBRATION, e, sizeof(e)) < 0 )
+        return BMP085_EIO;
+    uint16_t w[11];
+    for(uint8_t i = 0; i < 11; i++ ) {
+        w[i] = (uint16_t)(e[2 * i] << 8 | e[2 * i + 1]);
+        if( w[i] == 0x0000 || w[i] == 0xFFFF )
+            return BMP085_ECALIBRATION;
+    }
+    bmp085_calibration_t *c = &dev->cal;
+    c->ac1 = (int16_t)w[0];
+    c->ac2 = (int16_t)w[1];
+    c->ac3 = (int16_t)w[2];
+    c->ac4 = w[3];
+    c->ac5 = w[4];
+    c->ac6 = w[5];
+    c->b1 = (int16_t)w[6];
+    c->b2 = (int16_t)w[7];
+    c->mb = (int16_t)w[8];
+    c->mc = (int16_t)w[9];
+    c->md = (int16_t)w[10];
+    return 0;
+}
+
+int bmp085_start(bmp085_t *dev)
+{
+    if( bmp085_write_reg(BMP085_REG_CONTROL, BMP085_CMD_TEMPERATURE) < 0 )
+        return bmp085_fail(dev, BMP085_EIO);
+    dev->phase = BMP085_PHASE_TEMPERATURE;
+    dev->collected = 0;
+    dev->ready_at = bcm2835_st_read() + BMP085_TEMPERATURE_US;
+    return BMP085_BUSY;
+}
+
+static int bmp085_start_pressure(bmp085_t *dev)
+{
+    if( bmp085_write_reg(BMP085_REG_CONTROL, BMP085_CMD_PRESSURE | dev->oss << 6) < 0 )
+        return bmp085_fail(dev, BMP085_EIO);
+    dev->phase = BMP085_PHASE_PRESSURE;
+    dev->ready_at = bcm2835_st_read() + bmp085_pressure_us[dev->oss];
+    return BMP085_BUSY;
+}
+
+//  microseconds until bmp085_poll() has something to do
+uint32_t bmp085_wait_us(const bmp085_t *dev)
+{
+    if( dev->phase == BMP085_PHASE_IDLE )
+        return 0;
+    uint64_t now = bcm2835_st_read();
+    return now >= dev->ready_at ? 0 : (uint32_t)(dev->ready_at - now);
+}
+
+/*
+ *  Advance the conversion sequence.  Never waits: returns BMP085_BUSY
+ *  while a conversion is still running (or one was just started), and
+ *  BMP085_READY once the burst is complete and *sample holds its mean.
+ *  dev->raw and dev->samples then hold each conversion of the burst
+ *  (without altitudes; one is only worked out for the mean).
+ */
+int bmp085_poll(bmp085_t *dev, bmp085_sample_t *sample)
+{
+    if( dev->phase == BMP085_PHASE_IDLE )
+        return BMP085_IDLE;
+    if( bcm2835_st_read() < dev->ready_at )
+        return BMP085_BUSY;
+
+    uint8_t d[3];
+    if( dev->phase == BMP085_PHASE_TEMPERATURE ) {
+        if( bmp085_read_regs(BMP085_REG_DATA, d, 2) < 0 )
+            return bmp085_fail(dev, BMP085_EIO);
+        int32_t ut = d[0] << 8 | d[1];
+        for(uint8_t i = 0; i < dev->burst; i++ )
+            dev->raw[i].ut = ut;
+        return bmp085_start_pressure(dev);
+    }
+
+    if( bmp085_read_regs(BMP085_REG_DATA, d, 3) < 0 )
+        return bmp085_fail(dev, BMP085_EIO);
+    dev->raw[dev->collected++].up = (d[0] << 16 | d[1] << 8 | d[2]) >> (8 - dev->oss);
+    dev->conversions++;
+    if( dev->collected < dev->burst )
+        return bmp085_start_pressure(dev);
+
+    dev->phase = BMP085_PHASE_IDLE;
+    bmp085_compensate(&dev->cal, dev->oss, dev->raw, dev->burst, 0, dev->samples);
+    int32_t sum = 0;
+    for(uint8_t i = 0; i < dev->burst; i++ )
+        sum += dev->samples[i].pressure;
+    sample->temperature = dev->samples[0].temperature;
+    sample->pressure = (sum + dev->burst / 2) / dev->burst;
+    sample->altitude = bmp085_altitude(sample->pressure, dev->sea_level_pa);
+    return BMP085_READY;
+}
+
+//  blocking convenience: start a sample and sleep through its conversions
+int bmp085_read(bmp085_t *dev, bmp085_sample_t *sample)
+{
+    int ret = bmp085_start(dev);
+    while( ret == BMP085_BUSY ) {
+        uint32_t us = bmp085_wait_us(dev);
+        if( us ) {
+            struct timespec t = { 0, 1000 * (long)us };
+            nanosleep(&t, NULL);
+        }
+        ret = bmp085_poll(dev, sample);
+    }
+    return ret == BMP085_READY ? 0 : ret;
+}
+
+/*
+ *  Datasheet integer compensation over count raw samples.  The
+ *  temperature-dependent terms (B5 through B4) are only recomputed when
+ *  UT changes, so a burst sharing one temperature costs a division and
+ *  a handful of multiplies per pressure.  Altitudes are only worked
+ *  out when sea_level_pa is non-zero.
+ */
+void bmp085_compensate(const bmp085_calibration_t *cal, uint8_t oss, const bmp085_raw_t *raw,
+        uint32_t count, int32_t sea_level_pa, bmp085_sample_t *out)
+{
+    int32_t ut = 0, t = 0, b3 = 0;
+    uint32_t b4 = 0;
+    for(uint32_t i = 0; i < count; i++ ) {
+        if( i == 0 || raw[i].ut != ut ) {
+            ut = raw[i].ut;
+            int32_t x1 = ((ut - cal->ac6) * cal->ac5) >> 15;
+            int32_t x2 = ((int32_t)cal->mc * 2048) / (x1 + cal->md);
+            int32_t b5 = x1 + x2;
+            t = (b5 + 8) >> 4;
+
+            int32_t b6 = b5 - 4000;
+            x1 = (cal->b2 * ((b6 * b6) >> 12)) >> 11;
+            x2 = (cal->ac2 * b6) >> 11;
+            int32_t x3 = x1 + x2;
+            b3 = ((((int32_t)cal->ac1 * 4 + x3) << oss) + 2) / 4;
+            x1 = (cal->ac3 * b6) >> 13;
+            x2 = (cal->b1 * ((b6 * b6) >> 12)) >> 16;
+            x3 = ((x1 + x2) + 2) >> 2;
+            b4 = (cal->ac4 * (uint32_t)(x3 + 32768)) >> 15;
+        }
+
+        uint32_t b7 = ((uint32_t)raw[i].up - b3) * (50000 >> oss);
+        int32_t p = b7 < 0x80000000 ? (int32_t)((b7 * 2) / b4) : (int32_t)((b7 / b4) * 2);
+        int32_t x1 = (p >> 8) * (p >> 8);
+        x1 = (x1 * 3038) >> 16;
+        int32_t x2 = (-7357 * p) >> 16;
+
+        out[i].temperature = t;
+        out[i].pressure = p + ((x1 + x2 + 3791) >> 4);
+        out[i].altitude = sea_level_pa ? bmp085_altitude(out[i].pressure, sea_level_pa) : 0;
+    }
+}
+
+//  international barometric formula, through the altitude.c kernel
+float bmp085_altitude(int32_t pressure_pa, int32_t sea_level_pa)
+{
+    return altitude_from_pressure((float)pressure_pa, (float)sea_level_pa);
+}
@@ -0,0 +1,94 @@
+/*
+ *  bmp085.h
+ *
+ *  Bosch BMP085 barometric pressure sensor on the BCM2835's BSC1 I2C
+ *  master (the bus devices/bmp085.py reaches through smbus).
+ *
+ *  A sample is one temperature conversion followed by one or more
+ *  pressure conversions (a burst), and is taken without blocking:
+ *  bmp085_start() kicks off the temperature conversion and
+ *  bmp085_poll() advances the conversion sequence whenever it is called
+ *  after bmp085_wait_us() has run out, so the caller is free to do
+ *  other work (or sleep) in between.  The whole burst shares the one
+ *  temperature reading, so the compensation terms that depend on it are
+ *  worked out once and each extra pressure conversion only costs its
+ *  own few multiplies.  The calibration EEPROM is read in one 22 byte
+ *  transfer.
+ *
+ *  Compensation is the integer algorithm from the datasheet and needs
+ *  neither the bus nor the library, so it can be run over saved raw
+ *  samples as well.
+ *
+ *  The bus side drives the BSC controller directly and must not run
+ *  alongside the kernel's I2C driver: stop helium (or anything else on
+ *  /dev/i2c-1) first, or the two will corrupt each other's transfers.
+ *  It leaves the pins in their I2C function and the bus clock as it
+ *  found it, so the kernel driver works again once it exits.
+ */
+
+#ifndef BMP085_H
+#define BMP085_H
+
+#include <stdint.h>
+
+#define BMP085_ADDRESS              0x77
+#define BMP085_MAX_BURST            16
+#define BMP085_SEA_LEVEL_PA         101325
+
+#define BMP085_OSS_ULTRALOWPOWER    0
+#define BMP085_OSS_STANDARD         1
+#define BMP085_OSS_HIGHRES          2
+#define BMP085_OSS_ULTRAHIGHRES     3
+
+//  bmp085_poll() results; errors are negative
+#define BMP085_IDLE                 0       //  nothing started
+#define BMP085_BUSY                 1       //  a conversion is running, poll again after bmp085_wait_us()
+#define BMP085_READY                2       //  the sample has been filled in
+#define BMP085_EIO                  -1      //  the bus transfer failed
+#define BMP085_ECALIBRATION         -2      //  calibration EEPROM reads as 0x0000 or 0xFFFF
+
+typedef struct {
+    int16_t ac1, ac2, ac3;
+    uint16_t ac4, ac5, ac6;
+    int16_t b1, b2, mb, mc, md;
+} bmp085_calibration_t;
+
+typedef struct {
+    int32_t ut;                             //  raw temperature
+    int32_t up;                             //  raw pressure, already shifted by 8 - oss
+} bmp085_raw_t;
+
+typedef struct {
+    int32_t temperature;                    //  0.1 C
+    int32_t pressure;                       //  Pa
+    float altitude;                         //  m, against the sea level pressure given to bmp085_init()
+} bmp085_sample_t;
+
+typedef struct {
+    bmp085_calibration_t cal;
+    uint8_t oss;
+    uint8_t burst;                          //  pressure conversions per sample
+    int32_t sea_level_pa;
+    uint8_t phase;                          //  private: where the conversion sequence is
+    uint8_t collected;                      //  pressure conversions done so far
+    uint64_t ready_at;                      //  system timer (us) when the running conversion ends
+    bmp085_raw_t raw[BMP085_MAX_BURST];     //  the last burst, for callers that want each conversion
+    bmp085_sample_t samples[BMP085_MAX_BURST];
+    uint32_t conversions;
+    uint32_t errors;
+} bmp085_t;
+
+//  bus side; bcm2835_init() must have been called
+int bmp085_init(bmp085_t *dev, uint8_t oss, uint8_t burst, int32_t sea_level_pa);
+int bmp085_start(bmp085_t *dev);
+int bmp085_poll(bmp085_t *dev, bmp085_sample_t *sample);
+uint32_t bmp085_wait_us(const bmp085_t *dev);
+int bmp085_read(bmp085_t *dev, bmp085_sample_t *sample);
+
+//  pure computation
+uint32_t bmp085_conversion_us(uint8_t oss);
+void bmp085_compensate(const bmp085_calibration_t *cal, uint8_t oss, const bmp085_raw_t *raw,
+        uint32_t count, int32_t sea_level_pa, bmp085_sample_t *out);
+float bmp085_altitude(int32_t pressure_pa, int32_t sea_level_pa);
+
+#endif
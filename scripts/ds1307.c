@@ -0,0 +1,112 @@
+/*
+ *  ds1307.c
+ *
+ *  DS1307 driver, see ds1307.h
+ */
+
+#include "ds1307.h"
+#include <string.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define DS1307_REG_SECONDS      0x00
+#define DS1307_CLOCK_HALT       0x80
+#define DS1307_HOUR_12          0x40
+#define DS1307_HOUR_PM          0x20
+
+static inline uint8_t ds1307_from_bcd(uint8_t b)
+{
+    return (uint8_t)((b >> 4) * 10 + (b & 0x0F));
+}
+
+static inline uint8_t ds1307_to_bcd(uint8_t d)
+{
+    return (uint8_t)((d / 10) << 4 | d % 10);
+}
+
+static inline int ds1307_bcd_ok(uint8_t b)
+{
+    return (b & 0x0F) <= 9 && (b >> 4) <= 9;
+}
+
+//  a descriptor on the bus for ds1307_read() and ds1307_write(), or -1
+int ds1307_open(void)
+{
+    return open(DS1307_I2C_DEVICE, O_RDWR);
+}
+
+int ds1307_decode(const uint8_t *regs, struct tm *tm)
+{
+    if( regs[0] & DS1307_CLOCK_HALT )
+        return DS1307_EHALTED;
+    uint8_t seconds = regs[0] & 0x7F;
+    uint8_t hours = regs[2];
+    for(uint8_t i = 0; i < DS1307_TIME_REGISTERS; i++ )
+        if( !ds1307_bcd_ok(i == 0 ? seconds : i == 2 ? hours & 0x3F : regs[i]) )
+            return DS1307_ERANGE;
+
+    memset(tm, 0, sizeof(*tm));
+    tm->tm_sec = ds1307_from_bcd(seconds);
+    tm->tm_min = ds1307_from_bcd(regs[1]);
+    if( hours & DS1307_HOUR_12 ) {
+        uint8_t h = ds1307_from_bcd(hours & 0x1F);
+        if( h < 1 || h > 12 )
+            return DS1307_ERANGE;
+        tm->tm_hour = h % 12 + (hours & DS1307_HOUR_PM ? 12 : 0);
+    } else {
+        tm->tm_hour = ds1307_from_bcd(hours & 0x3F);
+    }
+    tm->tm_mday = ds1307_from_bcd(regs[4]);
+    tm->tm_mon = ds1307_from_bcd(regs[5]) - 1;
+    tm->tm_year = ds1307_from_bcd(regs[6]) + 100;
+    if( tm->tm_sec > 59 || tm->tm_min > 59 || tm->tm_hour > 23 ||
+            tm->tm_mday < 1 || tm->tm_mday > 31 || tm->tm_mon < 0 || tm->tm_mon > 11 )
+        return DS1307_ERANGE;
+
+    //  normalise through timegm() to fill in the weekday and catch 31 April
+    struct tm check = *tm;
+    time_t t = timegm(&check);
+    if( t == (time_t)-1 || check.tm_mday != tm->tm_mday )
+        return DS1307_ERANGE;
+    *tm = check;
+    return 0;
+}
+
+//  24 hour format with the oscillator running; years 2000-2099
+void ds1307_encode(const struct tm *tm, uint8_t *regs)
+{
+    regs[0] = ds1307_to_bcd((uint8_t)tm->tm_sec);
+    regs[1] = ds1307_to_bcd((uint8_t)tm->tm_min);
+    regs[2] = ds1307_to_bcd((uint8_t)tm->tm_hour);
+    regs[3] = (uint8_t)(tm->tm_wday + 1);
+    regs[4] = ds1307_to_bcd((uint8_t)tm->tm_mday);
+    regs[5] = ds1307_to_bcd((uint8_t)(tm->tm_mon + 1));
+    regs[6] = ds1307_to_bcd((uint8_t)(tm->tm_year % 100));
+}
+
+//  register pointer, repeated start, seven bytes: one I2C_RDWR transaction
+int ds1307_read(int fd, struct tm *tm)
+{
+    uint8_t reg = DS1307_REG_SECONDS;
+    uint8_t regs[DS1307_TIME_REGISTERS];
+    struct i2c_msg msgs[2] = {
+        { .addr = DS1307_ADDRESS, .flags = 0,        .len = 1,            .buf = &reg },
+        { .addr = DS1307_ADDRESS, .flags = I2C_M_RD, .len = sizeof(regs), .buf = regs },
+    };
+    struct i2c_rdwr_ioctl_data xfer = { msgs, 2 };
+    if( ioctl(fd, I2C_RDWR, &xfer) != 2 )
+        return DS1307_EIO;
+    return ds1307_decode(regs, tm);
+}
+
+//  all seven registers in one write, which also clears the clock halt bit
+int ds1307_write(int fd, const struct tm *tm)
+{
+    uint8_t buf[1 + DS1307_TIME_REGISTERS] = { DS1307_REG_SECONDS };
+    ds1307_encode(tm, buf + 1);
+    struct i2c_msg msg = { .addr = DS1307_ADDRESS, .flags = 0, .len = sizeof(buf), .buf = buf };
+    struct i2c_rdwr_ioctl_data xfer = { &msg, 1 };
+    return ioctl(fd, I2C_RDWR, &xfer) == 1 ? 0 : DS1307_EIO;
+}
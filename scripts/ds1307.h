@@ -0,0 +1,39 @@
+/*
+ *  ds1307.h
+ *
+ *  DS1307 real time clock on I2C bus 1, through i2c-dev.
+ *
+ *  The seven time registers are read in one transfer (register pointer,
+ *  repeated start, seven bytes), so they come from the DS1307's single
+ *  buffered copy and can't tear across a seconds rollover the way
+ *  register-at-a-time reads can.  The clock holds UTC; both 12 and 24
+ *  hour register formats are decoded, and writes use 24 hour format.
+ *
+ *  Transfers go through the kernel's I2C driver with I2C_RDWR, so they
+ *  are serialised with helium's smbus traffic on the same bus and leave
+ *  its pins and clock alone; the DS1307 is a 100 kHz part, which is the
+ *  Pi's default bus speed.  Don't bind rtc-ds1307 to the chip as well:
+ *  hwclock and this driver must not share it.
+ */
+
+#ifndef DS1307_H
+#define DS1307_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define DS1307_ADDRESS          0x68
+#define DS1307_I2C_DEVICE       "/dev/i2c-1"
+#define DS1307_TIME_REGISTERS   7
+
+#define DS1307_EIO              -1      //  the bus transfer failed
+#define DS1307_EHALTED          -2      //  clock halt bit set: the oscillator stopped and the time is lost
+#define DS1307_ERANGE           -3      //  the registers don't hold a valid date
+
+int ds1307_open(void);
+int ds1307_decode(const uint8_t *regs, struct tm *tm);
+void ds1307_encode(const struct tm *tm, uint8_t *regs);
+int ds1307_read(int fd, struct tm *tm);
+int ds1307_write(int fd, const struct tm *tm);
+
+#endif
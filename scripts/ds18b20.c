@@ -0,0 +1,127 @@
+/*
+ *  ds18b20.c
+ *
+ *  DS18B20 over the bit-banged 1-Wire master, see ds18b20.h
+ */
+
+#include "ds18b20.h"
+#include <time.h>
+
+#define DS18B20_READ_TRIES          3
+#define DS18B20_POLL_MS             10
+
+static inline uint8_t ds18b20_clamp_bits(uint8_t bits)
+{
+    return bits < 9 ? 9 : bits > 12 ? 12 : bits;
+}
+
+uint32_t ds18b20_conversion_ms(uint8_t bits)
+{
+    return 750 >> (12 - ds18b20_clamp_bits(bits));
+}
+
+/*
+ *  Write TH, TL and the configuration register.  TH/TL are the alarm
+ *  thresholds, which we don't use; they are written back as read from
+ *  the device when there is one ROM, and as the factory defaults when
+ *  addressing every device.
+ */
+int ds18b20_set_resolution(onewire_t *bus, const uint8_t *rom, uint8_t bits)
+{
+    uint8_t th = 0x4B, tl = 0x46;
+    if( rom != NULL ) {
+        uint8_t sp[DS18B20_SCRATCHPAD_LENGTH];
+        int ret = ds18b20_read_scratchpad(bus, rom, sp);
+        if( ret < 0 )
+            return ret;
+        th = sp[2];
+        tl = sp[3];
+    }
+    int ret = onewire_select(bus, rom);
+    if( ret < 0 )
+        return ret;
+    uint8_t cmd[4] = { DS18B20_CMD_WRITE_SCRATCHPAD, th, tl,
+                       (uint8_t)((ds18b20_clamp_bits(bits) - 9) << 5 | 0x1F) };
+    onewire_write(bus, cmd, sizeof(cmd));
+    return 0;
+}
+
+//  start a conversion on one device, or on all of them if rom is NULL
+int ds18b20_convert(onewire_t *bus, const uint8_t *rom, uint8_t bits)
+{
+    int ret = onewire_select(bus, rom);
+    if( ret < 0 )
+        return ret;
+    onewire_write_byte(bus, DS18B20_CMD_CONVERT);
+    //  parasite powered devices draw their conversion current from the
+    //  bus, so it has to be held high straight after the command
+    if( bus->parasite )
+        onewire_strong_pullup(bus, ds18b20_conversion_ms(bits));
+    return 0;
+}
+
+/*
+ *  Wait for a conversion started by ds18b20_convert().  Externally
+ *  powered devices answer read slots with 0 while converting, so the
+ *  wait ends as soon as the slowest device is done; parasite power has
+ *  already waited the full time under the strong pull-up.
+ */
+int ds18b20_wait(onewire_t *bus, uint8_t bits)
+{
+    if( bus->parasite )
+        return 0;
+    uint32_t limit = ds18b20_conversion_ms(bits) + 2 * DS18B20_POLL_MS;
+    struct timespec t = { 0, DS18B20_POLL_MS * 1000000L };
+    for(uint32_t waited = 0; waited <= limit; waited += DS18B20_POLL_MS ) {
+        nanosleep(&t, NULL);
+        if( onewire_read_bit(bus) )
+            return 0;
+    }
+    return ONEWIRE_ETIMEOUT;
+}
+
+/*
+ *  A good CRC alone isn't enough: a bus held low reads all zeros, whose
+ *  CRC is zero too.  The configuration byte is 0 R1 R0 1 1 1 1 1, so its
+ *  fixed bits rule out both all zeros and the all-ones of a missing device.
+ */
+uint8_t ds18b20_scratchpad_valid(const uint8_t *scratchpad)
+{
+    return onewire_crc8(scratchpad, DS18B20_SCRATCHPAD_LENGTH) == 0 && (scratchpad[4] & 0x9F) == 0x1F;
+}
+
+int ds18b20_read_scratchpad(onewire_t *bus, const uint8_t *rom, uint8_t *scratchpad)
+{
+    int ret = 0;
+    for(uint8_t tries = 0; tries < DS18B20_READ_TRIES; tries++ ) {
+        ret = onewire_select(bus, rom);
+        if( ret < 0 )
+            continue;
+        onewire_write_byte(bus, DS18B20_CMD_READ_SCRATCHPAD);
+        onewire_read(bus, scratchpad, DS18B20_SCRATCHPAD_LENGTH);
+        if( ds18b20_scratchpad_valid(scratchpad) )
+            return 0;
+        bus->crc_errors++;
+        ret = ONEWIRE_ECRC;
+    }
+    return ret;
+}
+
+//  temperature in 0.001 C; bits below the configured resolution are undefined
+int32_t ds18b20_decode(const uint8_t *scratchpad)
+{
+    int16_t raw = (int16_t)(scratchpad[1] << 8 | scratchpad[0]);
+    uint8_t bits = ((scratchpad[4] >> 5) & 3) + 9;
+    raw &= ~((1 << (12 - bits)) - 1);
+    return (int32_t)raw * 625 / 10;
+}
+
+int ds18b20_read(onewire_t *bus, const uint8_t *rom, int32_t *millicelsius)
+{
+    uint8_t sp[DS18B20_SCRATCHPAD_LENGTH];
+    int ret = ds18b20_read_scratchpad(bus, rom, sp);
+    if( ret < 0 )
+        return ret;
+    *millicelsius = ds18b20_decode(sp);
+    return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ *  ds18b20.h
+ *
+ *  DS18B20 thermometers on the onewire.c bus master.
+ *
+ *  Resolution trades conversion time for precision:
+ *      9 bit   0.5 C       94 ms
+ *      10 bit  0.25 C      188 ms
+ *      11 bit  0.125 C     375 ms
+ *      12 bit  0.0625 C    750 ms
+ *  and is set in the scratchpad only (not copied to EEPROM), so it is
+ *  back to the EEPROM setting after a power cycle; set it again at
+ *  startup and whenever the flight phase changes.
+ *
+ *  A reading is ds18b20_convert() on every device at once (Skip ROM),
+ *  ds18b20_wait(), then ds18b20_read() per ROM.
+ */
+
+#ifndef DS18B20_H
+#define DS18B20_H
+
+#include "onewire.h"
+#include <stdint.h>
+
+#define DS18B20_FAMILY              0x28
+#define DS18B20_SCRATCHPAD_LENGTH   9
+#define DS18B20_POWER_ON_MC         85000   //  the scratchpad before any conversion
+
+#define DS18B20_CMD_CONVERT         0x44
+#define DS18B20_CMD_WRITE_SCRATCHPAD 0x4E
+#define DS18B20_CMD_READ_SCRATCHPAD 0xBE
+
+uint32_t ds18b20_conversion_ms(uint8_t bits);
+int ds18b20_set_resolution(onewire_t *bus, const uint8_t *rom, uint8_t bits);
+int ds18b20_convert(onewire_t *bus, const uint8_t *rom, uint8_t bits);
+int ds18b20_wait(onewire_t *bus, uint8_t bits);
+uint8_t ds18b20_scratchpad_valid(const uint8_t *scratchpad);
+int ds18b20_read_scratchpad(onewire_t *bus, const uint8_t *rom, uint8_t *scratchpad);
+int ds18b20_read(onewire_t *bus, const uint8_t *rom, int32_t *millicelsius);
+int32_t ds18b20_decode(const uint8_t *scratchpad);
+
+#endif
@@ -1,10 +1,44 @@
 #include "hab_spi.h"
+#include <stddef.h>
 
-static hab_spi_cs_t _cs = HAB_SPI_CSA;
-static uint8_t _pinA = RPI_V2_GPIO_P1_18;
-static uint8_t _pinB = RPI_V2_GPIO_P1_22;
+static aux_cs_t aux = { .cs = HAB_SPI_CSA, .pinA = RPI_V2_GPIO_P1_18, .pinB = RPI_V2_GPIO_P1_22 };
 
-aux_cs_t aux = { .cs = HAB_SPI_CSA, .pinA = RPI_V2_GPIO_P1_18, .pinB = RPI_V2_GPIO_P1_22 };
+/*
+ *  Registry of virtual devices, indexed by hab_spi_cs_t
+ *  Every slot starts out with the settings the radio has always used
+ *  (mode 0, 61 kHz, active-low CE0) so unregistered devices still work.
+ */
+static hab_spi_device_t devices[HAB_SPI_MAX_DEVICES] = {
+    { .cs = HAB_SPI_CSA, .mode = BCM2835_SPI_MODE0, .divider = BCM2835_SPI_CLOCK_DIVIDER_4096, .polarity = LOW },
+    { .cs = HAB_SPI_CSB, .mode = BCM2835_SPI_MODE0, .divider = BCM2835_SPI_CLOCK_DIVIDER_4096, .polarity = LOW },
+    { .cs = HAB_SPI_CSC, .mode = BCM2835_SPI_MODE0, .divider = BCM2835_SPI_CLOCK_DIVIDER_4096, .polarity = LOW },
+    { .cs = HAB_SPI_CSD, .mode = BCM2835_SPI_MODE0, .divider = BCM2835_SPI_CLOCK_DIVIDER_4096, .polarity = LOW },
+};
+static uint8_t masks_valid = 0;
+static hab_spi_device_t *selected = NULL;
+
+/*
+ *  Compute the decoder pin mask and levels for each device.
+ *  Input A is the low bit of the CS index and input B the high bit,
+ *  so CSA = (LOW,LOW), CSB = (HIGH,LOW), CSC = (LOW,HIGH), CSD = (HIGH,HIGH)
+ */
+static void hab_spi_compute_masks(void) {
+    uint32_t maskA = (uint32_t)1 << aux.pinA;
+    uint32_t maskB = (uint32_t)1 << aux.pinB;
+    for(uint8_t i = 0; i < HAB_SPI_MAX_DEVICES; i++ ) {
+        devices[i].pin_mask = maskA | maskB;
+        devices[i].pin_value = ((i & 0x01) ? maskA : 0) | ((i & 0x02) ? maskB : 0);
+    }
+    masks_valid = 1;
+}
+
+static hab_spi_device_t *hab_spi_device_for_cs(hab_spi_cs_t aCS) {
+    if( (unsigned)aCS >= HAB_SPI_MAX_DEVICES )
+        return NULL;
+    if( !masks_valid )
+        hab_spi_compute_masks();
+    return &devices[aCS];
+}
 
 void hab_spi_set_cs(hab_spi_cs_t aCS) {
     aux.cs = aCS;
@@ -17,7 +51,8 @@ hab_spi_cs_t hab_spi_cs(void) {
 void hab_spi_set_aux_gpio(uint8_t pinA, uint8_t pinB) {
     aux.pinA = pinA;
     aux.pinB = pinB;
-    
+    hab_spi_compute_masks();
+
     //  make these outputs
     bcm2835_gpio_fsel(aux.pinA, BCM2835_GPIO_FSEL_OUTP);
     bcm2835_gpio_fsel(aux.pinB, BCM2835_GPIO_FSEL_OUTP);
@@ -31,33 +66,83 @@ uint8_t hab_spi_aux_gpio_B(void) {
     return aux.pinB;
 }
 
-void hab_spi_lower_cs(void) {
-    uint8_t a,b;
-    switch(_cs) {
-        case HAB_SPI_CSA: {
-            a = b = LOW;
-            break;
-        }
-        case HAB_SPI_CSB: {
-            a = HIGH;
-            b = LOW;
-            break;
-        }
-        case HAB_SPI_CSC: {
-            a = LOW;
-            b = HIGH;
-            break;
-        }
-        case HAB_SPI_CSD: {
-            a = b = HIGH;
-            break;
-        }
+void hab_spi_register_device(hab_spi_cs_t aCS, uint8_t mode, uint16_t divider, uint8_t polarity) {
+    hab_spi_device_t *dev = hab_spi_device_for_cs(aCS);
+    if( dev == NULL )
+        return;
+    dev->mode = mode;
+    dev->divider = divider;
+    dev->polarity = polarity;
+    dev->registered = 1;
+}
+
+const hab_spi_device_t *hab_spi_device(hab_spi_cs_t aCS) {
+    return hab_spi_device_for_cs(aCS);
+}
+
+void hab_spi_reset_device_stats(void) {
+    for(uint8_t i = 0; i < HAB_SPI_MAX_DEVICES; i++ ) {
+        devices[i].selections = 0;
+        devices[i].bus_time = 0;
     }
-    bcm2835_gpio_write(aux.pinA, a);
-    bcm2835_gpio_write(aux.pinB, b);
+}
+
+/*
+ *  Drive the decoder inputs for aCS; a single masked GPIO write
+ *  Switching straight from another device goes to the new levels in
+ *  that one write, without passing through the idle levels, and hands
+ *  the bus time over at one timer read.
+ */
+void hab_spi_select(hab_spi_cs_t aCS) {
+    hab_spi_device_t *dev = hab_spi_device_for_cs(aCS);
+    if( dev == NULL )
+        return;
+    bcm2835_gpio_write_mask(dev->pin_value, dev->pin_mask);
+    if( selected != dev ) {
+        uint64_t now = bcm2835_st_read();
+        if( selected != NULL )
+            selected->bus_time += now - selected->selected_at;
+        dev->selections++;
+        dev->selected_at = now;
+        selected = dev;
+    }
+}
+
+//  return the decoder inputs to their idle levels and account bus time
+void hab_spi_deselect(void) {
+    if( !masks_valid )
+        hab_spi_compute_masks();
+    bcm2835_gpio_write_mask(0, devices[0].pin_mask);
+    if( selected != NULL ) {
+        selected->bus_time += bcm2835_st_read() - selected->selected_at;
+        selected = NULL;
+    }
+}
+
+void hab_spi_lower_cs(void) {
+    hab_spi_select(aux.cs);
 }
 
 void hab_spi_raise_cs(void) {
-    bcm2835_gpio_write(aux.pinA, LOW);
-    bcm2835_gpio_write(aux.pinB, LOW);
-}
\ No newline at end of file
+    hab_spi_deselect();
+}
+
+void hab_spi_begin(hab_spi_cs_t aCS) {
+    hab_spi_device_t *dev = hab_spi_device_for_cs(aCS);
+    if( dev == NULL )
+        return;
+    //  set the aux pins on the 74139 before dropping the RPi *CS
+    hab_spi_select(aCS);
+    bcm2835_spi_begin();
+    bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+    bcm2835_spi_setDataMode(dev->mode);
+    bcm2835_spi_setClockDivider(dev->divider);
+    bcm2835_spi_chipSelect(BCM2835_SPI_CS0);
+    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, dev->polarity);
+}
+
+void hab_spi_end(void) {
+    bcm2835_spi_end();
+    //  restore our aux pins
+    hab_spi_deselect();
+}
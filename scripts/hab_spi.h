@@ -1,3 +1,6 @@
+#ifndef HAB_SPI_H
+#define HAB_SPI_H
+
 #include <bcm2835.h>
 #include <inttypes.h>
 
@@ -8,12 +11,38 @@ typedef enum {
     HAB_SPI_CSD
 } hab_spi_cs_t;
 
+/*
+ *  The 74HC139 gives us four virtual *CS lines, so that is the
+ *  most devices the registry can hold.
+ */
+#define HAB_SPI_MAX_DEVICES 4
+
 typedef struct {
     hab_spi_cs_t cs;
     uint8_t pinA;
     uint8_t pinB;
 } aux_cs_t;
 
+/*
+ *  A virtual SPI device on one of the decoder outputs
+ *
+ *  pin_mask and pin_value are computed when the device is registered
+ *  (or when the aux pins change) so that selecting the device is a
+ *  single masked write to the GPIO set/clear registers.
+ */
+typedef struct {
+    hab_spi_cs_t cs;
+    uint8_t mode;               //  BCM2835_SPI_MODE*
+    uint16_t divider;           //  BCM2835_SPI_CLOCK_DIVIDER_*
+    uint8_t polarity;           //  polarity of CE0 into G of the 74HC139
+    uint8_t registered;         //  set by hab_spi_register_device()
+    uint32_t pin_mask;          //  decoder input pins (A|B)
+    uint32_t pin_value;         //  decoder input levels that select this device
+    uint32_t selections;        //  number of times the device was selected
+    uint64_t bus_time;          //  total microseconds spent selected
+    uint64_t selected_at;       //  system timer value at the last selection
+} hab_spi_device_t;
+
 void hab_spi_set_cs(hab_spi_cs_t aCS);
 void hab_spi_set_aux_gpio(uint8_t pinA, uint8_t pinB);
 void hab_spi_lower_cs(void);
@@ -21,4 +50,17 @@ void hab_spi_raise_cs(void);
 
 hab_spi_cs_t hab_spi_cs(void);
 uint8_t hab_spi_aux_gpio_A(void);
-uint8_t hab_spi_aux_gpio_B(void);
\ No newline at end of file
+uint8_t hab_spi_aux_gpio_B(void);
+
+/*  device registry */
+void hab_spi_register_device(hab_spi_cs_t aCS, uint8_t mode, uint16_t divider, uint8_t polarity);
+const hab_spi_device_t *hab_spi_device(hab_spi_cs_t aCS);
+void hab_spi_reset_device_stats(void);
+void hab_spi_select(hab_spi_cs_t aCS);
+void hab_spi_deselect(void);
+
+/*  bracket a transfer: select, bcm2835_spi_begin() and apply the device's SPI settings */
+void hab_spi_begin(hab_spi_cs_t aCS);
+void hab_spi_end(void);
+
+#endif
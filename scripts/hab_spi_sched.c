@@ -0,0 +1,137 @@
+#include "hab_spi_sched.h"
+#include <stddef.h>
+
+//  the bus under the scheduler, or the model in hab_spi_test.c for host tests
+#ifdef HAB_SPI_SCHED_HOST
+void hab_spi_host_begin(hab_spi_cs_t aCS);
+void hab_spi_host_end(void);
+void hab_spi_host_transfer(hab_spi_request_t *req);
+uint64_t hab_spi_host_now_us(void);
+#define hab_spi_sched_begin(cs)         hab_spi_host_begin(cs)
+#define hab_spi_sched_end()             hab_spi_host_end()
+#define hab_spi_sched_transfer(req)     hab_spi_host_transfer(req)
+#define hab_spi_sched_now_us()          hab_spi_host_now_us()
+#else
+#define hab_spi_sched_begin(cs)         hab_spi_begin(cs)
+#define hab_spi_sched_end()             hab_spi_end()
+#define hab_spi_sched_transfer(req)     bcm2835_spi_transfernb((char *)(req)->tx_buf, (char *)(req)->rx_buf, (req)->length)
+#define hab_spi_sched_now_us()          bcm2835_st_read()
+#endif
+
+typedef struct {
+    hab_spi_request_t *slots[HAB_SPI_SCHED_QUEUE_SIZE];
+    uint8_t head;
+    uint8_t count;
+} hab_spi_queue_t;
+
+static hab_spi_queue_t queues[HAB_SPI_MAX_DEVICES];
+static hab_spi_sched_stats_t stats;
+
+static hab_spi_request_t *hab_spi_queue_pop(hab_spi_queue_t *q) {
+    hab_spi_request_t *req = q->slots[q->head];
+    q->head = (q->head + 1) % HAB_SPI_SCHED_QUEUE_SIZE;
+    q->count--;
+    return req;
+}
+
+//  earliest deadline among the requests queued on one chip select
+static uint64_t hab_spi_queue_deadline(const hab_spi_queue_t *q) {
+    uint64_t earliest = UINT64_MAX;
+    for(uint8_t i = 0; i < q->count; i++ ) {
+        const hab_spi_request_t *req = q->slots[(q->head + i) % HAB_SPI_SCHED_QUEUE_SIZE];
+        if( req->deadline < earliest )
+            earliest = req->deadline;
+    }
+    return earliest;
+}
+
+//  returns 0 on success, -1 if the request is invalid, its chip select has
+//  no registered device, or its queue is full
+int hab_spi_sched_submit(hab_spi_request_t *req) {
+    if( req == NULL )
+        return -1;
+    const hab_spi_device_t *dev = hab_spi_device(req->cs);
+    if( dev == NULL || !dev->registered )
+        return -1;
+    hab_spi_queue_t *q = &queues[req->cs];
+    if( q->count == HAB_SPI_SCHED_QUEUE_SIZE )
+        return -1;
+    q->slots[(q->head + q->count) % HAB_SPI_SCHED_QUEUE_SIZE] = req;
+    q->count++;
+    return 0;
+}
+
+uint32_t hab_spi_sched_pending(void) {
+    uint32_t n = 0;
+    for(uint8_t i = 0; i < HAB_SPI_MAX_DEVICES; i++ )
+        n += queues[i].count;
+    return n;
+}
+
+//  pick the chip select holding the earliest deadline
+static int8_t hab_spi_sched_next_cs(void) {
+    int8_t best = -1;
+    uint64_t best_deadline = UINT64_MAX;
+    for(uint8_t i = 0; i < HAB_SPI_MAX_DEVICES; i++ ) {
+        if( queues[i].count == 0 )
+            continue;
+        uint64_t d = hab_spi_queue_deadline(&queues[i]);
+        if( d < best_deadline ) {
+            best_deadline = d;
+            best = i;
+        }
+    }
+    return best;
+}
+
+//  true if another chip select has a request that is now due
+static uint8_t hab_spi_sched_other_due(int8_t cs, uint64_t now) {
+    for(uint8_t i = 0; i < HAB_SPI_MAX_DEVICES; i++ ) {
+        if( i == cs || queues[i].count == 0 )
+            continue;
+        if( hab_spi_queue_deadline(&queues[i]) <= now )
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ *  Run everything that is queued, one group per chip select
+ *  A group keeps the decoder selection and SPI session while its queue
+ *  drains (completion callbacks may queue follow-up work on the same
+ *  chip select), until another chip select's deadline comes due or the
+ *  batch limit is reached.  Returns the number of transfers performed.
+ */
+uint32_t hab_spi_sched_run(void) {
+    uint32_t transfers = 0;
+    int8_t cs;
+    while( (cs = hab_spi_sched_next_cs()) >= 0 ) {
+        hab_spi_queue_t *q = &queues[cs];
+        uint32_t batch = 0;
+
+        hab_spi_sched_begin((hab_spi_cs_t)cs);
+        stats.groups++;
+        while( q->count && batch < HAB_SPI_SCHED_MAX_BATCH ) {
+            hab_spi_request_t *req = hab_spi_queue_pop(q);
+            hab_spi_sched_transfer(req);
+            req->completed_at = hab_spi_sched_now_us();
+            if( req->completed_at > req->deadline )
+                stats.deadline_misses++;
+            if( req->done != NULL )
+                req->done(req, req->ctx);
+            batch++;
+            if( q->count && hab_spi_sched_other_due(cs, req->completed_at) ) {
+                stats.preemptions++;
+                break;
+            }
+        }
+        hab_spi_sched_end();
+        stats.transfers += batch;
+        transfers += batch;
+    }
+    return transfers;
+}
+
+const hab_spi_sched_stats_t *hab_spi_sched_stats(void) {
+    return &stats;
+}
@@ -0,0 +1,48 @@
+#ifndef HAB_SPI_SCHED_H
+#define HAB_SPI_SCHED_H
+
+#include "hab_spi.h"
+
+/*
+ *  CS-affinity scheduler for queued SPI work
+ *
+ *  Requests are queued per virtual *CS and run in groups so that the
+ *  74HC139 address lines and the SPI setup are changed once per group
+ *  rather than once per transfer.  A request whose deadline comes due
+ *  ends the current group early, so no chip select starves.
+ *
+ *  Requests are owned by the caller and must stay valid until their
+ *  completion callback runs.  Only chip selects with a device set up
+ *  by hab_spi_register_device() accept requests.
+ */
+
+#define HAB_SPI_SCHED_QUEUE_SIZE 16     //  pending requests per chip select
+#define HAB_SPI_SCHED_MAX_BATCH 32      //  most transfers run under one selection
+
+struct hab_spi_request;
+typedef void (*hab_spi_done_t)(struct hab_spi_request *req, void *ctx);
+
+typedef struct hab_spi_request {
+    hab_spi_cs_t cs;
+    uint8_t *tx_buf;
+    uint8_t *rx_buf;
+    uint32_t length;
+    uint64_t deadline;          //  system timer (us) by which the transfer should run
+    hab_spi_done_t done;        //  optional completion callback
+    void *ctx;
+    uint64_t completed_at;      //  system timer (us) when the transfer finished
+} hab_spi_request_t;
+
+typedef struct {
+    uint32_t transfers;         //  requests completed
+    uint32_t groups;            //  decoder selections / SPI sessions used
+    uint32_t preemptions;       //  groups cut short by another CS's deadline
+    uint32_t deadline_misses;   //  requests completed after their deadline
+} hab_spi_sched_stats_t;
+
+int hab_spi_sched_submit(hab_spi_request_t *req);
+uint32_t hab_spi_sched_pending(void);
+uint32_t hab_spi_sched_run(void);
+const hab_spi_sched_stats_t *hab_spi_sched_stats(void);
+
+#endif
@@ -14,9 +14,16 @@
  *  To compile:
  *  gcc hab_spi_test.c hab_spi.c -o b -lbcm2835
  *
+ *  Built with -DHAB_SPI_SCHED_HOST it instead runs the CS-affinity
+ *  scheduler against a model of the bus (a clock that advances
+ *  HOST_TRANSFER_US per transfer) and checks grouping by chip select,
+ *  the batch limit and deadline preemption, without a Raspberry Pi:
+ *  gcc -DHAB_SPI_SCHED_HOST hab_spi_test.c hab_spi.c hab_spi_sched.c -o hab_spi_host_test -std=gnu99 -lbcm2835
+ *
  */
 
 #include "hab_spi.h"
+#include "hab_spi_sched.h"
 #include <stdint.h>
 #include <unistd.h>
 #include <getopt.h>
@@ -126,8 +133,135 @@ static void parse_opts(int argc, char *argv[])
     }
 }
 
+#ifdef HAB_SPI_SCHED_HOST
+#define HOST_TRANSFER_US    100
+#define HOST_LOG_SIZE       64
+
+//  the bus model: every transfer takes HOST_TRANSFER_US and is logged by chip select
+static uint64_t host_now;
+static char host_log[HOST_LOG_SIZE + 1];
+static uint32_t host_logged;
+static uint32_t host_groups;
+static uint32_t host_longest_group;
+static uint32_t host_group_length;
+static int host_in_group = -1;
+
+void hab_spi_host_begin(hab_spi_cs_t aCS) {
+    host_in_group = aCS;
+    host_group_length = 0;
+    host_groups++;
+}
+
+void hab_spi_host_end(void) {
+    host_in_group = -1;
+}
+
+void hab_spi_host_transfer(hab_spi_request_t *req) {
+    if( (int)req->cs != host_in_group )
+        host_log[host_logged++ % HOST_LOG_SIZE] = '!';
+    else if( host_logged < HOST_LOG_SIZE )
+        host_log[host_logged++] = 'A' + req->cs;
+    if( ++host_group_length > host_longest_group )
+        host_longest_group = host_group_length;
+    host_now += HOST_TRANSFER_US;
+}
+
+uint64_t hab_spi_host_now_us(void) {
+    return host_now;
+}
+
+static void host_reset(void) {
+    memset(host_log, 0, sizeof(host_log));
+    host_logged = 0;
+    host_groups = 0;
+    host_longest_group = 0;
+}
+
+static int host_check(int ok, const char *what) {
+    if( !ok )
+        printf("FAIL | %s (transfers %s, %u groups)\n", what, host_log, host_groups);
+    return ok ? 0 : 1;
+}
+
+//  requeues itself until *ctx runs out, to feed more than a queue's worth to one group
+static void host_requeue(hab_spi_request_t *req, void *ctx) {
+    uint32_t *remaining = ctx;
+    if( *remaining ) {
+        (*remaining)--;
+        hab_spi_sched_submit(req);
+    }
+}
+
+static int hab_spi_sched_host_test(void) {
+    int failures = 0;
+    uint8_t tx[1] = { 0 }, rx[1];
+    hab_spi_request_t reqs[HAB_SPI_SCHED_QUEUE_SIZE];
+    memset(reqs, 0, sizeof(reqs));
+    for(uint8_t i = 0; i < HAB_SPI_SCHED_QUEUE_SIZE; i++ ) {
+        reqs[i].tx_buf = tx;
+        reqs[i].rx_buf = rx;
+        reqs[i].length = sizeof(tx);
+    }
+    hab_spi_register_device(HAB_SPI_CSA, BCM2835_SPI_MODE0, BCM2835_SPI_CLOCK_DIVIDER_4096, LOW);
+    hab_spi_register_device(HAB_SPI_CSB, BCM2835_SPI_MODE0, BCM2835_SPI_CLOCK_DIVIDER_4096, LOW);
+
+    //  only registered chip selects take requests
+    reqs[0].cs = HAB_SPI_CSD;
+    failures += host_check(hab_spi_sched_submit(&reqs[0]) < 0, "unregistered CSD accepted");
+    reqs[0].cs = (hab_spi_cs_t)HAB_SPI_MAX_DEVICES;
+    failures += host_check(hab_spi_sched_submit(&reqs[0]) < 0, "out of range CS accepted");
+    failures += host_check(hab_spi_sched_pending() == 0, "rejected requests queued");
+
+    //  interleaved submissions run as one group per chip select, earliest deadline first
+    host_reset();
+    static const hab_spi_cs_t order[5] = { HAB_SPI_CSB, HAB_SPI_CSA, HAB_SPI_CSB, HAB_SPI_CSA, HAB_SPI_CSB };
+    for(uint8_t i = 0; i < 5; i++ ) {
+        reqs[i].cs = order[i];
+        reqs[i].deadline = host_now + 100000 + (order[i] == HAB_SPI_CSA ? 0 : 1000);
+        hab_spi_sched_submit(&reqs[i]);
+    }
+    failures += host_check(hab_spi_sched_run() == 5 && strcmp(host_log, "AABBB") == 0 &&
+                           host_groups == 2, "grouping by chip select");
+
+    //  a group stops at HAB_SPI_SCHED_MAX_BATCH even while its queue refills
+    host_reset();
+    uint32_t remaining = HAB_SPI_SCHED_MAX_BATCH + 7;
+    reqs[0].cs = HAB_SPI_CSA;
+    reqs[0].deadline = host_now + 1000000;
+    reqs[0].done = host_requeue;
+    reqs[0].ctx = &remaining;
+    hab_spi_sched_submit(&reqs[0]);
+    failures += host_check(hab_spi_sched_run() == HAB_SPI_SCHED_MAX_BATCH + 8 && host_groups == 2 &&
+                           host_longest_group == HAB_SPI_SCHED_MAX_BATCH, "batch limit");
+    reqs[0].done = NULL;
+    reqs[0].ctx = NULL;
+
+    //  CSB coming due cuts CSA's group short; CSA resumes afterwards
+    host_reset();
+    uint64_t start = host_now;
+    uint32_t preemptions = hab_spi_sched_stats()->preemptions;
+    for(uint8_t i = 0; i < 10; i++ ) {
+        reqs[i].cs = HAB_SPI_CSA;
+        reqs[i].deadline = host_now + (i == 0 ? HOST_TRANSFER_US : 1000000);
+        hab_spi_sched_submit(&reqs[i]);
+    }
+    reqs[10].cs = HAB_SPI_CSB;
+    reqs[10].deadline = host_now + 4 * HOST_TRANSFER_US;
+    hab_spi_sched_submit(&reqs[10]);
+    failures += host_check(hab_spi_sched_run() == 11 && strcmp(host_log, "AAAABAAAAAA") == 0 &&
+                           host_groups == 3 && hab_spi_sched_stats()->preemptions == preemptions + 1 &&
+                           reqs[10].completed_at == start + 5 * HOST_TRANSFER_US, "deadline preemption");
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
+#endif
+
 int main(int argc, char *argv[]) {
     int ret = 0;
+#ifdef HAB_SPI_SCHED_HOST
+    return hab_spi_sched_host_test();
+#endif
     parse_opts(argc, argv);
     
     uint8_t *rd_buf = malloc(4 * sizeof(uint8_t) );
@@ -139,17 +273,14 @@ int main(int argc, char *argv[]) {
     memset(wr_buf,'*',4);
     
     //  send a random message
-    hab_spi_lower_cs();
-    bcm2835_spi_begin();
-    bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);      // The default
-    bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   // The default
-    bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_4096);
-    bcm2835_spi_chipSelect(BCM2835_SPI_CS0);                      // The default
-    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);      // the default
+    hab_spi_begin(cs);
     //  transfer
     bcm2835_spi_transfernb(wr_buf,rd_buf, 4);
-    bcm2835_spi_end();
-    hab_spi_raise_cs();
+    hab_spi_end();
+    
+    const hab_spi_device_t *dev = hab_spi_device(cs);
+    printf("CS%c: %u selections, %llu us on the bus\n", 'A' + cs,
+            dev->selections, (unsigned long long)dev->bus_time);
     
     return ret;
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+/*
+ *  humidity.c
+ *
+ *  HIH-4030 fixed point stage and record ring, see humidity.h
+ */
+
+#include "humidity.h"
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+_Static_assert(sizeof(humidity_record_t) == 32, "humidity_record_t layout is shared with devices/hih4030.py");
+
+humidity_ring_t *humidity_ring_create(void)
+{
+    int fd = shm_open(HUMIDITY_SHM_NAME, O_RDWR | O_CREAT, 0644);
+    if( fd < 0 )
+        return NULL;
+    if( ftruncate(fd, sizeof(humidity_ring_t)) < 0 ) {
+        close(fd);
+        return NULL;
+    }
+    humidity_ring_t *ring = mmap(NULL, sizeof(humidity_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if( ring == MAP_FAILED )
+        return NULL;
+    memset(ring, 0, sizeof(humidity_ring_t));
+    ring->size = HUMIDITY_RING_SIZE;
+    __atomic_store_n(&ring->magic, HUMIDITY_MAGIC, __ATOMIC_RELEASE);
+    return ring;
+}
+
+const humidity_ring_t *humidity_ring_open(void)
+{
+    int fd = shm_open(HUMIDITY_SHM_NAME, O_RDONLY, 0);
+    if( fd < 0 )
+        return NULL;
+    const humidity_ring_t *ring = mmap(NULL, sizeof(humidity_ring_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if( ring == MAP_FAILED )
+        return NULL;
+    if( __atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != HUMIDITY_MAGIC ||
+            ring->size != HUMIDITY_RING_SIZE ) {
+        munmap((void *)ring, sizeof(humidity_ring_t));
+        return NULL;
+    }
+    return ring;
+}
+
+void humidity_stage_init(humidity_stage_t *stage, uint32_t supply_mv, uint32_t reference_mv, float smoothing)
+{
+    memset(stage, 0, sizeof(*stage));
+    stage->ppm_scale = (int64_t)reference_mv * 1000000;
+    stage->ppm_divisor = (int64_t)HUMIDITY_FULL_SCALE * supply_mv * 256;
+    stage->count_rh = (float)reference_mv / HUMIDITY_FULL_SCALE / supply_mv / 0.0062f;
+    stage->smoothing = smoothing;
+}
+
+//  rounds toward minus infinity, so readings below the 0 % offset stay below it
+static int64_t floor_div(int64_t a, int64_t b)
+{
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+/*
+ *  Mean counts in Q8 and temperature in 0.1 C to true RH in 0.01 %,
+ *  not clamped.
+ */
+int32_t humidity_compensate(const humidity_stage_t *stage, uint32_t mean_q8, int16_t temperature)
+{
+    int64_t ppm = floor_div((int64_t)mean_q8 * stage->ppm_scale, stage->ppm_divisor);
+    int64_t sensor_rh = floor_div(ppm - 160000, 62);
+    int64_t divisor = 10546 - floor_div(216 * (int64_t)temperature + 50, 100);
+    return (int32_t)floor_div(sensor_rh * 10000, divisor);
+}
+
+/*
+ *  Turn one burst into a record and fold it into the smoothed reading.
+ *  Returns 0, leaving out alone, if the burst has no good conversions.
+ */
+int humidity_stage_push(humidity_stage_t *stage, const humidity_burst_t *burst,
+        int16_t temperature, uint8_t temperature_known, humidity_record_t *out)
+{
+    if( burst->samples == 0 )
+        return 0;
+    uint32_t n = burst->samples;
+    uint32_t mean_q8 = (uint32_t)((((uint64_t)burst->sum << 8) + n / 2) / n);
+
+    int32_t centi = humidity_compensate(stage, mean_q8, temperature);
+    if( centi < 0 )
+        centi = 0;
+    if( centi > 10000 )
+        centi = 10000;
+    float rh = centi / 100.0f;
+
+    int64_t spread = (int64_t)burst->sumsq * n - (int64_t)burst->sum * burst->sum;
+    float variance = spread > 0 ? (float)spread / ((float)n * n) : 0;
+    float noise = sqrtf(variance / n) * stage->count_rh;
+    //  d(trueRH)/dT is 0.00216 * trueRH / (1.0546 - 0.00216 T), about 0.2 % of the reading per C
+    float temp_error = temperature_known ? HUMIDITY_TEMP_KNOWN : HUMIDITY_TEMP_ERROR;
+    float temp_term = temp_error * 0.00216f * rh / (1.0546f - 0.00216f * temperature / 10.0f);
+    float confidence = sqrtf(HUMIDITY_ACCURACY * HUMIDITY_ACCURACY + noise * noise + temp_term * temp_term);
+    if( burst->saturated && confidence < 100.0f - rh )
+        confidence = 100.0f - rh;
+
+    if( !stage->primed ) {
+        stage->rh = rh;
+        stage->confidence = confidence;
+        stage->primed = 1;
+    } else {
+        stage->rh += stage->smoothing * (rh - stage->rh);
+        stage->confidence += stage->smoothing * (confidence - stage->confidence);
+    }
+
+    out->rh = stage->rh;
+    out->confidence = stage->confidence;
+    out->mean_q8 = mean_q8;
+    out->temperature = temperature;
+    out->temperature_known = temperature_known;
+    out->saturated = burst->saturated;
+    out->samples = burst->samples;
+    out->errors = burst->errors;
+    return 1;
+}
@@ -0,0 +1,142 @@
+/*
+ *  humidity.h
+ *
+ *  HIH-4030 humidity sensor on channel 2 of the ATtiny ADC bridge
+ *  (I2C 0x26), sampled by read_humidity and published as compensated
+ *  readings.
+ *
+ *  Each reading is a burst of conversions.  They are summed as integers
+ *  while they arrive; the mean, the datasheet transfer function and the
+ *  temperature correction are worked in fixed point once per burst:
+ *
+ *      Vout / Vsupply = 0.0062 * sensorRH + 0.16           (25 C)
+ *      trueRH = sensorRH / (1.0546 - 0.00216 * T)
+ *
+ *  T is the exterior temperature helium.py publishes in its telemetry
+ *  snapshot (telemetry_snapshot.h).  The published value is an
+ *  exponentially smoothed trueRH with a confidence figure: the 1 sigma
+ *  uncertainty in % RH, combining the datasheet accuracy, the noise of
+ *  the burst mean and how well the temperature is known.  A burst that
+ *  touches full scale only gives a lower bound and is reported with the
+ *  headroom as its uncertainty.
+ *
+ *  Records go into a ring buffer in POSIX shared memory with a single
+ *  writer, as with accel.h.  devices/hih4030.py reads the newest record.
+ */
+
+#ifndef HUMIDITY_H
+#define HUMIDITY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define HUMIDITY_SHM_NAME       "/hab_humidity"
+#define HUMIDITY_MAGIC          0x48494831      //  'HIH1'
+#define HUMIDITY_RING_SIZE      64              //  must be a power of 2
+#define HUMIDITY_FULL_SCALE     1023
+#define HUMIDITY_MAX_BURST      4096            //  keeps the sum of squares in 32 bits
+#define HUMIDITY_SUPPLY_MV      4950            //  0.0062 * 4.95 V is the 0.03068 V/%RH we used before
+#define HUMIDITY_REFERENCE_MV   3300
+#define HUMIDITY_ACCURACY       3.5f            //  % RH, datasheet
+#define HUMIDITY_TEMP_ERROR     20.0f           //  C assumed when there is no temperature to compensate with
+#define HUMIDITY_TEMP_KNOWN     0.5f            //  C, DS18B20
+
+//  32 bytes; devices/hih4030.py unpacks this layout
+typedef struct {
+    uint64_t timestamp;                 //  CLOCK_MONOTONIC (us) at the end of the burst
+    float rh;                           //  smoothed true RH, %
+    float confidence;                   //  smoothed 1 sigma uncertainty, % RH
+    uint32_t mean_q8;                   //  burst mean in ADC counts, Q8
+    uint32_t burst_us;                  //  time the burst took, bus included
+    int16_t temperature;                //  0.1 C the burst was compensated at
+    uint8_t temperature_known;          //  0 = no fresh exterior temperature, 25 C assumed
+    uint8_t saturated;                  //  a conversion hit full scale; rh is a lower bound
+    uint16_t samples;                   //  good conversions in the burst
+    uint16_t errors;                    //  failed conversions in the burst
+} humidity_record_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t burst;                     //  conversions per reading
+    uint32_t interval_ms;               //  between readings
+    uint32_t overruns;                  //  readings that started late
+    uint32_t errors;                    //  failed bus reads
+    volatile uint32_t head;             //  total records ever written
+    uint32_t reserved;
+    humidity_record_t records[HUMIDITY_RING_SIZE];
+} humidity_ring_t;
+
+//  integer accumulators for one burst
+typedef struct {
+    uint32_t sum;
+    uint32_t sumsq;
+    uint16_t samples;
+    uint16_t errors;
+    uint8_t saturated;
+} humidity_burst_t;
+
+typedef struct {
+    int64_t ppm_scale;                  //  counts in Q8 to the output ratio in ppm of supply
+    int64_t ppm_divisor;
+    float count_rh;                     //  one count in sensor % RH, for the noise term
+    float smoothing;
+    float rh;
+    float confidence;
+    uint8_t primed;
+} humidity_stage_t;
+
+humidity_ring_t *humidity_ring_create(void);
+const humidity_ring_t *humidity_ring_open(void);
+void humidity_stage_init(humidity_stage_t *stage, uint32_t supply_mv, uint32_t reference_mv, float smoothing);
+int32_t humidity_compensate(const humidity_stage_t *stage, uint32_t mean_q8, int16_t temperature);
+int humidity_stage_push(humidity_stage_t *stage, const humidity_burst_t *burst,
+        int16_t temperature, uint8_t temperature_known, humidity_record_t *out);
+
+static inline void humidity_burst_add(humidity_burst_t *burst, uint16_t counts)
+{
+    if( counts > HUMIDITY_FULL_SCALE ) {
+        burst->errors++;
+        return;
+    }
+    burst->sum += counts;
+    burst->sumsq += (uint32_t)counts * counts;
+    burst->samples++;
+    if( counts == HUMIDITY_FULL_SCALE )
+        burst->saturated = 1;
+}
+
+/*
+ *  Copy up to max records newer than *cursor into out and advance the
+ *  cursor; the same lapping rules as read_adc_ring_read().
+ */
+static inline uint32_t humidity_ring_read(const humidity_ring_t *ring, uint32_t *cursor,
+        humidity_record_t *out, uint32_t max)
+{
+    const uint32_t window = HUMIDITY_RING_SIZE - 1;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = *cursor;
+    if( head - tail > window )
+        tail = head - window;
+    uint32_t n = head - tail;
+    if( n > max )
+        n = max;
+    for(uint32_t i = 0; i < n; i++ )
+        out[i] = ring->records[(tail + i) & (HUMIDITY_RING_SIZE - 1)];
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t now = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t lost = 0;
+    if( now - tail > window )
+        lost = (now - tail) - window;
+    if( lost >= n ) {
+        *cursor = now - window;
+        return 0;
+    }
+    if( lost )
+        memmove(out, out + lost, (n - lost) * sizeof(humidity_record_t));
+    *cursor = tail + n;
+    return n - lost;
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ *  onewire.c
+ *
+ *  1-Wire bus master, see onewire.h
+ */
+
+#include "onewire.h"
+#include <bcm2835.h>
+#include <string.h>
+#include <time.h>
+
+//  standard speed timing (us), Maxim AN126 recommended values
+#define ONEWIRE_RESET_LOW_US        480
+#define ONEWIRE_PRESENCE_SAMPLE_US  70
+#define ONEWIRE_RESET_SLOT_US       960     //  low time + recovery after the presence pulse
+#define ONEWIRE_WRITE1_LOW_US       6
+#define ONEWIRE_WRITE0_LOW_US       60
+#define ONEWIRE_SLOT_US             70
+#define ONEWIRE_READ_LOW_US         6
+#define ONEWIRE_READ_SAMPLE_US      15      //  master samples within 15 us of the falling edge
+
+static inline void onewire_low(onewire_t *bus)
+{
+    bcm2835_gpio_clr(bus->pin);
+    bcm2835_gpio_fsel(bus->pin, BCM2835_GPIO_FSEL_OUTP);
+}
+
+static inline void onewire_release(onewire_t *bus)
+{
+    bcm2835_gpio_fsel(bus->pin, BCM2835_GPIO_FSEL_INPT);
+}
+
+void onewire_init(onewire_t *bus, uint8_t pin, uint8_t parasite)
+{
+    memset(bus, 0, sizeof(*bus));
+    bus->pin = pin;
+    bus->parasite = parasite;
+    onewire_search_reset(bus);
+    bcm2835_gpio_set_pud(pin, BCM2835_GPIO_PUD_OFF);
+    onewire_release(bus);
+}
+
+/*
+ *  Raise the calling thread to the top SCHED_FIFO priority.  Without
+ *  CAP_SYS_NICE this fails quietly and the CRCs have to catch the
+ *  slots that got stretched.
+ */
+void onewire_rt_begin(onewire_t *bus)
+{
+    if( bus->rt_depth++ )
+        return;
+    bus->saved_policy = sched_getscheduler(0);
+    sched_getparam(0, &bus->saved_param);
+    struct sched_param param = { .sched_priority = sched_get_priority_max(SCHED_FIFO) };
+    sched_setscheduler(0, SCHED_FIFO, &param);
+}
+
+void onewire_rt_end(onewire_t *bus)
+{
+    if( bus->rt_depth == 0 || --bus->rt_depth )
+        return;
+    if( bus->saved_policy >= 0 )
+        sched_setscheduler(0, bus->saved_policy, &bus->saved_param);
+}
+
+//  returns 1 if a device answered with a presence pulse
+int onewire_reset(onewire_t *bus)
+{
+    onewire_rt_begin(bus);
+    uint64_t start = bcm2835_st_read();
+    onewire_low(bus);
+    bcm2835_st_delay(start, ONEWIRE_RESET_LOW_US);
+    onewire_release(bus);
+    bcm2835_st_delay(start, ONEWIRE_RESET_LOW_US + ONEWIRE_PRESENCE_SAMPLE_US);
+    uint8_t present = !bcm2835_gpio_lev(bus->pin);
+    bcm2835_st_delay(start, ONEWIRE_RESET_SLOT_US);
+    onewire_rt_end(bus);
+
+    bus->resets++;
+    if( !present )
+        bus->no_presence++;
+    return present;
+}
+
+static void onewire_write_bit(onewire_t *bus, uint8_t bit)
+{
+    uint64_t start = bcm2835_st_read();
+    onewire_low(bus);
+    bcm2835_st_delay(start, bit ? ONEWIRE_WRITE1_LOW_US : ONEWIRE_WRITE0_LOW_US);
+    onewire_release(bus);
+    bcm2835_st_delay(start, ONEWIRE_SLOT_US);
+}
+
+static uint8_t onewire_read_slot(onewire_t *bus)
+{
+    uint64_t start = bcm2835_st_read();
+    onewire_low(bus);
+    bcm2835_st_delay(start, ONEWIRE_READ_LOW_US);
+    onewire_release(bus);
+    bcm2835_st_delay(start, ONEWIRE_READ_SAMPLE_US);
+    uint8_t bit = bcm2835_gpio_lev(bus->pin);
+    bcm2835_st_delay(start, ONEWIRE_SLOT_US);
+    return bit;
+}
+
+uint8_t onewire_read_bit(onewire_t *bus)
+{
+    onewire_rt_begin(bus);
+    uint8_t bit = onewire_read_slot(bus);
+    onewire_rt_end(bus);
+    return bit;
+}
+
+//  bytes go out least significant bit first
+void onewire_write_byte(onewire_t *bus, uint8_t value)
+{
+    onewire_rt_begin(bus);
+    for(uint8_t i = 0; i < 8; i++ )
+        onewire_write_bit(bus, (value >> i) & 1);
+    onewire_rt_end(bus);
+}
+
+uint8_t onewire_read_byte(onewire_t *bus)
+{
+    uint8_t value = 0;
+    onewire_rt_begin(bus);
+    for(uint8_t i = 0; i < 8; i++ )
+        value |= onewire_read_slot(bus) << i;
+    onewire_rt_end(bus);
+    return value;
+}
+
+void onewire_write(onewire_t *bus, const uint8_t *data, uint32_t length)
+{
+    for(uint32_t i = 0; i < length; i++ )
+        onewire_write_byte(bus, data[i]);
+}
+
+void onewire_read(onewire_t *bus, uint8_t *data, uint32_t length)
+{
+    for(uint32_t i = 0; i < length; i++ )
+        data[i] = onewire_read_byte(bus);
+}
+
+/*
+ *  Reset, then address one device by ROM (Match ROM) or every device
+ *  on the bus if rom is NULL (Skip ROM).
+ */
+int onewire_select(onewire_t *bus, const uint8_t *rom)
+{
+    if( !onewire_reset(bus) )
+        return ONEWIRE_ENOPRESENCE;
+    if( rom == NULL ) {
+        onewire_write_byte(bus, ONEWIRE_CMD_SKIP_ROM);
+    } else {
+        onewire_write_byte(bus, ONEWIRE_CMD_MATCH_ROM);
+        onewire_write(bus, rom, ONEWIRE_ROM_LENGTH);
+    }
+    return 0;
+}
+
+//  hold the bus high for parasite powered devices, then let it go
+void onewire_strong_pullup(onewire_t *bus, uint32_t ms)
+{
+    bcm2835_gpio_set(bus->pin);
+    bcm2835_gpio_fsel(bus->pin, BCM2835_GPIO_FSEL_OUTP);
+    struct timespec t = { ms / 1000, (long)(ms % 1000) * 1000000 };
+    while( nanosleep(&t, &t) != 0 )
+        ;
+    onewire_release(bus);
+}
+
+void onewire_search_reset(onewire_t *bus)
+{
+    memset(bus->rom, 0, sizeof(bus->rom));
+    bus->last_discrepancy = -1;
+    bus->last_device = 0;
+}
+
+/*
+ *  Find the next device's ROM (Maxim AN187).  Call onewire_search_reset()
+ *  first; returns 1 with the ROM in rom, 0 when every device has been
+ *  found, or a negative error.  Each search costs a reset and 64 triple
+ *  slots, so callers should keep the ROMs rather than search per read.
+ */
+int onewire_search(onewire_t *bus, uint8_t *rom)
+{
+    if( bus->last_device )
+        return 0;
+    if( !onewire_reset(bus) ) {
+        onewire_search_reset(bus);
+        return ONEWIRE_ENOPRESENCE;
+    }
+
+    int8_t discrepancy = -1;
+    onewire_rt_begin(bus);
+    onewire_write_byte(bus, ONEWIRE_CMD_SEARCH_ROM);
+    for(uint8_t i = 0; i < 64; i++ ) {
+        uint8_t *byte = &bus->rom[i / 8];
+        uint8_t mask = 1 << (i % 8);
+        uint8_t bit = onewire_read_slot(bus);
+        uint8_t complement = onewire_read_slot(bus);
+        if( bit && complement ) {
+            //  nobody answered, the devices went away mid-search
+            onewire_rt_end(bus);
+            onewire_search_reset(bus);
+            return ONEWIRE_ENOPRESENCE;
+        }
+        if( bit == complement ) {
+            //  devices disagree here: repeat the last choice before the
+            //  last discrepancy, take 1 at it, and 0 after it
+            if( i < bus->last_discrepancy )
+                bit = (*byte & mask) != 0;
+            else
+                bit = i == bus->last_discrepancy;
+            if( !bit )
+                discrepancy = i;
+        }
+        if( bit )
+            *byte |= mask;
+        else
+            *byte &= ~mask;
+        onewire_write_bit(bus, bit);
+    }
+    onewire_rt_end(bus);
+
+    if( onewire_crc8(bus->rom, ONEWIRE_ROM_LENGTH) != 0 ) {
+        bus->crc_errors++;
+        onewire_search_reset(bus);
+        return ONEWIRE_ECRC;
+    }
+    bus->last_discrepancy = discrepancy;
+    bus->last_device = discrepancy < 0;
+    memcpy(rom, bus->rom, ONEWIRE_ROM_LENGTH);
+    return 1;
+}
+
+//  Dallas/Maxim CRC8 (x^8 + x^5 + x^4 + 1, reflected); 0 over data plus its CRC
+uint8_t onewire_crc8(const uint8_t *data, uint32_t length)
+{
+    uint8_t crc = 0;
+    for(uint32_t i = 0; i < length; i++ ) {
+        crc ^= data[i];
+        for(uint8_t b = 0; b < 8; b++ )
+            crc = crc & 1 ? (crc >> 1) ^ 0x8C : crc >> 1;
+    }
+    return crc;
+}
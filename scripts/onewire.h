@@ -0,0 +1,75 @@
+/*
+ *  onewire.h
+ *
+ *  Bit-banged 1-Wire bus master on a BCM2835 GPIO, for running the
+ *  DS18B20s without the kernel's w1-gpio driver (unload w1-gpio and
+ *  w1-therm first; they own the same pin).
+ *
+ *  The pin is driven open drain: a 0 is the pin as an output driving
+ *  low, a 1 is the pin as an input with the bus pull-up (4.7k) doing the
+ *  work.  Slots are timed at standard speed against the system timer
+ *  from the slot's falling edge, so the only thing that can stretch one
+ *  is being preempted mid-slot.  To keep that rare, every reset and
+ *  byte runs inside a SCHED_FIFO section (onewire_rt_begin/end nest, so
+ *  a caller can widen the section to a whole transaction); anything
+ *  that gets through is caught by the CRC on ROMs and scratchpads.
+ *
+ *  For parasite powered devices onewire_strong_pullup() drives the bus
+ *  high through the conversion or EEPROM write.
+ */
+
+#ifndef ONEWIRE_H
+#define ONEWIRE_H
+
+#include <stdint.h>
+#include <sched.h>
+
+#define ONEWIRE_DEFAULT_PIN         4       //  RPI_GPIO_P1_07, the w1-gpio default
+#define ONEWIRE_ROM_LENGTH          8
+
+#define ONEWIRE_CMD_SEARCH_ROM      0xF0
+#define ONEWIRE_CMD_READ_ROM        0x33
+#define ONEWIRE_CMD_MATCH_ROM       0x55
+#define ONEWIRE_CMD_SKIP_ROM        0xCC
+
+#define ONEWIRE_ENOPRESENCE         -1      //  nothing answered the reset pulse
+#define ONEWIRE_ECRC                -2      //  CRC8 mismatch
+#define ONEWIRE_ETIMEOUT            -3
+
+typedef struct {
+    uint8_t pin;
+    uint8_t parasite;                       //  devices are parasite powered
+    //  ROM search state, see onewire_search()
+    uint8_t rom[ONEWIRE_ROM_LENGTH];
+    int8_t last_discrepancy;
+    uint8_t last_device;
+    //  real-time section
+    uint8_t rt_depth;
+    int saved_policy;
+    struct sched_param saved_param;
+    //  statistics
+    uint32_t resets;
+    uint32_t no_presence;
+    uint32_t crc_errors;
+} onewire_t;
+
+//  bcm2835_init() must have been called
+void onewire_init(onewire_t *bus, uint8_t pin, uint8_t parasite);
+void onewire_rt_begin(onewire_t *bus);
+void onewire_rt_end(onewire_t *bus);
+
+int onewire_reset(onewire_t *bus);
+uint8_t onewire_read_bit(onewire_t *bus);
+void onewire_write(onewire_t *bus, const uint8_t *data, uint32_t length);
+void onewire_read(onewire_t *bus, uint8_t *data, uint32_t length);
+void onewire_write_byte(onewire_t *bus, uint8_t value);
+uint8_t onewire_read_byte(onewire_t *bus);
+int onewire_select(onewire_t *bus, const uint8_t *rom);
+void onewire_strong_pullup(onewire_t *bus, uint32_t ms);
+
+void onewire_search_reset(onewire_t *bus);
+int onewire_search(onewire_t *bus, uint8_t *rom);
+
+uint8_t onewire_crc8(const uint8_t *data, uint32_t length);
+
+#endif
@@ -96,8 +96,7 @@ static void setup_gpio(void)
 
 /*	Writes data to the radio with array of length */
 static uint8_t write_radio(uint8_t *data, uint8_t *rd_buf, uint8_t length) {
-    uint8_t *wr_buf = malloc(MESSAGE_LENGTH * sizeof(uint8_t));
-    if( wr_buf == NULL ) pabort("unable to allocate memory for write buffer");
+    uint8_t wr_buf[MESSAGE_LENGTH];
     //  pad our message with the required dummy character
     memcpy(memset(wr_buf,0x3F,MESSAGE_LENGTH),data,2);
     
@@ -149,9 +148,9 @@ static uint8_t write_radio(uint8_t *data, uint8_t *rd_buf, uint8_t length) {
         //	for some reason, the message must be sent twice
         ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
         close(fd);
-        free(wr_buf);
         if (ret < 1) pabort("can't send spi message");
     #endif
+    return ret;
 }
 
 static void print_query_results(uint8_t *data) {
@@ -167,21 +166,19 @@ static void print_query_results(uint8_t *data) {
 static void radio_perform_query(char *query) {
     uint8_t data[2];
     memcpy(&data,query,2);      //  all queries are 2 bytes in length
-    uint8_t *rx_buf = malloc(MESSAGE_LENGTH * sizeof(uint8_t));
+    uint8_t rx_buf[MESSAGE_LENGTH];
     write_radio(data,rx_buf,MESSAGE_LENGTH);
     print_query_results(rx_buf);
-    free(rx_buf);
 }
 
 /*  set the frequency to the value specified by f */
 static void radio_set_frequency(uint32_t f) {
     unsigned char *p = (unsigned char *)&f;
-    uint8_t *wr_buf = malloc(5 * sizeof(uint8_t));
-    if( wr_buf == NULL ) pabort("unable to allocate memory for write buffer");
+    uint8_t wr_buf[5];
     wr_buf[0] = 'B';
     memcpy(&wr_buf[1],p,sizeof(f));
     
-    uint8_t *rd_buf = malloc(5 * sizeof(uint8_t));
+    uint8_t rd_buf[5];
     
     bcm2835_spi_begin();
     bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);      // The default
@@ -195,16 +192,14 @@ static void radio_set_frequency(uint32_t f) {
 
 static void radio_perform_memory_operation(uint8_t channel, char op) {
     
-    if( channel > 15 ) pabort("Channel out of range")
+    if( channel > 15 ) pabort("Channel out of range");
     if( (op != 'M') && (op != 'm') )
         pabort("ERROR | channel out of range");
-    unsigned char *p = (unsigned char *)&channel;
-    uint8_t *wr_buf = malloc(2 * sizeof(uint8_t));
-    if( wr_buf == NULL ) pabort("unable to allocate memory for write buffer");
+    uint8_t wr_buf[2];
     wr_buf[0] = op;
-    memcpy(&wr_buf[1],p,sizeof(f));
+    wr_buf[1] = channel;
     
-    uint8_t *rd_buf = malloc(2 * sizeof(uint8_t));
+    uint8_t rd_buf[2];
     
     bcm2835_spi_begin();
     bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);      // The default
@@ -279,13 +274,12 @@ static void parse_opts(int argc, char *argv[])
             {
 				//	temperature as signed 8 bit integer
                 uint8_t data[2] = {0x51, 0x54};
-                uint8_t *rx_buf = malloc(22 * sizeof(uint8_t));
-                write_radio(data,rx_buf,22);
-                for(uint8_t i = 0; i < 22; i++ ) {
+                uint8_t rx_buf[MESSAGE_LENGTH];
+                write_radio(data,rx_buf,MESSAGE_LENGTH);
+                for(uint8_t i = 0; i < MESSAGE_LENGTH; i++ ) {
                     printf("%.2X ",rx_buf[i]);
                 }
                 puts("");
-                free(rx_buf);
                 break;
             }
             case 'D':
@@ -294,14 +288,13 @@ static void parse_opts(int argc, char *argv[])
             case 'r':
             {
                 uint8_t data[2] = {0x51, 0x46};
-                uint8_t *rx_buf = malloc(22 * sizeof(uint8_t));
-                write_radio(data,rx_buf,22);
+                uint8_t rx_buf[MESSAGE_LENGTH];
+                write_radio(data,rx_buf,MESSAGE_LENGTH);
                 uint32_t freql,freqh,freqs;
-                memcpy(&freql,&data[2],sizeof(freql));
-                memcpy(&freqh,&data[6],sizeof(freqh));
-                memcpy(&freqs,&data[10],sizeof(freqs));
-                printf("freq = %d,%d,%d",freql,freqh,freqs);
-                free(rx_buf);
+                memcpy(&freql,&rx_buf[2],sizeof(freql));
+                memcpy(&freqh,&rx_buf[6],sizeof(freqh));
+                memcpy(&freqs,&rx_buf[10],sizeof(freqs));
+                printf("freq = %u,%u,%u\n",freql,freqh,freqs);
                 break;
             }
 		default:
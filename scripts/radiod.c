@@ -0,0 +1,373 @@
+/*
+ *  radiod.c
+ *
+ *  Resident control daemon for the SRB-MX146LV
+ *
+ *  Running srbmx145 for every command costs a process start, a full
+ *  bcm2835_init() and GPIO setup before a single transfer.  radiod does
+ *  that once, then owns the radio's SPI session and serves pipelined
+ *  requests from any number of clients over a Unix socket (see radiod.h).
+ *
+ *  Requests are appended to one command queue in arrival order.  The
+ *  daemon executes one command at a time and keeps accepting requests
+ *  between commands, so a slow query never blocks clients from queueing
+ *  more work.  Each reply goes back to the client that sent the request;
+ *  a reply the client's socket can't take yet waits in a small per-client
+ *  backlog until poll() reports it writable, and a client that lets the
+ *  backlog fill up is dropped rather than stalling the daemon.
+ *
+ *  Frequency changes go through the memory channel plan (srb_channels.h),
+ *  so retuning to a frequency held in a channel is a 2 byte recall and
+ *  RADIOD_OP_PLAN_CHANNEL only writes a channel that actually changes.
+ *
+ *  While the queue is empty the daemon keeps the status cache in
+ *  shared memory up to date (srb_status.h), and queries are answered
+ *  from it while the cached value is fresh.
+ *
+ *  To compile:
+ *  gcc radiod.c srb_radio.c srb_codec.c srb_channels.c srb_status.c hab_spi.c -o radiod -std=gnu99 -lbcm2835 -lrt
+ *
+ *  Built with -DSRB_RADIO_SIMULATOR and srb_sim.c in place of hab_spi.c
+ *  (and without -lbcm2835) the daemon serves the radio model instead, so
+ *  clients such as devices/radio.py can be exercised on any Linux box.
+ *
+ *  Usage:
+ *  radiod [-s socket_path] [-c channel_mirror_path] [-t temperature_interval_ms]
+ */
+
+#define _GNU_SOURCE
+#include "radiod.h"
+#include "srb_channels.h"
+#include "srb_status.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define RADIOD_MAX_CLIENTS  8
+#define RADIOD_QUEUE_SIZE   64
+#define RADIOD_BACKLOG      16      //  replies held per client while its socket is full
+
+typedef struct {
+    int fd;
+    uint32_t generation;        //  bumped on disconnect so stale queue entries are dropped
+    radiod_reply_t backlog[RADIOD_BACKLOG];
+    uint8_t backlog_head;
+    uint8_t backlog_count;
+} radiod_client_t;
+
+typedef struct {
+    uint8_t client;
+    uint32_t generation;
+    radiod_request_t request;
+} radiod_command_t;
+
+static const char *socket_path = RADIOD_SOCKET_PATH;
+static const char *channels_path = SRB_CHANNELS_PATH;
+static srb_channel_plan_t plan;
+static uint32_t temperature_ttl_us = SRB_STATUS_TEMPERATURE_TTL_US;
+static srb_status_cache_t status;
+static radiod_client_t clients[RADIOD_MAX_CLIENTS];
+static radiod_command_t queue[RADIOD_QUEUE_SIZE];
+static uint32_t queue_head = 0;
+static uint32_t queue_count = 0;
+
+static void pabort(const char *s)
+{
+	perror(s);
+	abort();
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [-sct]\n", prog);
+    puts(   "-s --socket\tpath of the command socket (default " RADIOD_SOCKET_PATH ")\n"
+            "-c --channels\tmemory channel mirror (default " SRB_CHANNELS_PATH ")\n"
+            "-t --temperature\trefresh the cached temperature every this many ms (default 5000)\n");
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "socket",     required_argument,  NULL,   's'},
+            { "channels",   required_argument,  NULL,   'c'},
+            { "temperature",required_argument,  NULL,   't'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "s:c:t:", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'c':
+                channels_path = optarg;
+                break;
+            case 't':
+                temperature_ttl_us = strtoul(optarg, NULL, 10) * 1000;
+                if( temperature_ttl_us == 0 )
+                    print_usage(argv[0]);
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static int radiod_listen(void)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if( strlen(socket_path) >= sizeof(addr.sun_path) )
+        pabort("socket path too long");
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if( fd < 0 )
+        pabort("unable to create socket");
+    unlink(socket_path);
+    if( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 )
+        pabort("unable to bind socket");
+    if( listen(fd, RADIOD_MAX_CLIENTS) < 0 )
+        pabort("unable to listen on socket");
+    return fd;
+}
+
+static void radiod_accept(int listen_fd)
+{
+    int fd;
+    while( (fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0 ) {
+        uint8_t i;
+        for( i = 0; i < RADIOD_MAX_CLIENTS; i++ ) {
+            if( clients[i].fd < 0 ) {
+                clients[i].fd = fd;
+                break;
+            }
+        }
+        if( i == RADIOD_MAX_CLIENTS )
+            close(fd);
+    }
+}
+
+static void radiod_disconnect(uint8_t client)
+{
+    close(clients[client].fd);
+    clients[client].fd = -1;
+    clients[client].generation++;
+    clients[client].backlog_count = 0;
+}
+
+//  returns 1 if sent, 0 if the socket is full, -1 if the client was dropped
+static int radiod_send(uint8_t client, const radiod_reply_t *reply)
+{
+    if( send(clients[client].fd, reply, sizeof(*reply), MSG_DONTWAIT | MSG_NOSIGNAL) >= 0 )
+        return 1;
+    if( errno == EAGAIN || errno == EWOULDBLOCK )
+        return 0;
+    radiod_disconnect(client);
+    return -1;
+}
+
+//  send what the backlog holds, in order, until the socket fills up again
+static void radiod_flush(uint8_t client)
+{
+    radiod_client_t *c = &clients[client];
+    while( c->backlog_count ) {
+        if( radiod_send(client, &c->backlog[c->backlog_head]) <= 0 )
+            return;
+        c->backlog_head = (c->backlog_head + 1) % RADIOD_BACKLOG;
+        c->backlog_count--;
+    }
+}
+
+static void radiod_reply(uint8_t client, const radiod_reply_t *reply)
+{
+    radiod_client_t *c = &clients[client];
+    if( c->fd < 0 )
+        return;
+    //  nothing overtakes a reply that is already waiting
+    if( c->backlog_count == 0 ) {
+        int ret = radiod_send(client, reply);
+        if( ret != 0 )
+            return;
+    }
+    if( c->backlog_count == RADIOD_BACKLOG ) {
+        fprintf(stderr, "WARN | client %u is not reading its replies, dropping it\n", client);
+        radiod_disconnect(client);
+        return;
+    }
+    c->backlog[(c->backlog_head + c->backlog_count) % RADIOD_BACKLOG] = *reply;
+    c->backlog_count++;
+}
+
+static void radiod_reply_status(uint8_t client, const radiod_request_t *req, int8_t status)
+{
+    radiod_reply_t reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.id = req->id;
+    reply.op = req->op;
+    reply.status = status;
+    radiod_reply(client, &reply);
+}
+
+//  drain every request a client has sent into the command queue
+static void radiod_receive(uint8_t client)
+{
+    radiod_request_t req;
+    while(1) {
+        ssize_t n = recv(clients[client].fd, &req, sizeof(req), MSG_DONTWAIT);
+        if( n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) ) {
+            radiod_disconnect(client);
+            return;
+        }
+        if( n < 0 )
+            return;
+        if( n != sizeof(req) ) {
+            radiod_reply_status(client, &req, RADIOD_EINVAL);
+            continue;
+        }
+        if( queue_count == RADIOD_QUEUE_SIZE ) {
+            radiod_reply_status(client, &req, RADIOD_EBUSY);
+            continue;
+        }
+        radiod_command_t *cmd = &queue[(queue_head + queue_count) % RADIOD_QUEUE_SIZE];
+        cmd->client = client;
+        cmd->generation = clients[client].generation;
+        cmd->request = req;
+        queue_count++;
+    }
+}
+
+//  keep the mirror on disk current whenever a channel may have changed
+static int8_t radiod_channel_status(int ret, const uint32_t *before)
+{
+    if( memcmp(before, plan.hz, sizeof(plan.hz)) != 0 &&
+            srb_channels_save(&plan, channels_path) < 0 )
+        perror(channels_path);
+    return ret < 0 ? RADIOD_EIO : RADIOD_OK;
+}
+
+static int8_t radiod_execute(const radiod_request_t *req, uint8_t *data)
+{
+    uint32_t before[SRB_RADIO_MEMORY_CHANNELS];
+    memcpy(before, plan.hz, sizeof(before));
+
+    switch( req->op ) {
+        case RADIOD_OP_SET_FREQUENCY:
+            if( req->value == SRB_CHANNEL_UNKNOWN )
+                return RADIOD_EINVAL;
+            return srb_channels_tune(&plan, req->value) < 0 ? RADIOD_EIO : RADIOD_OK;
+        case RADIOD_OP_MEMORY_RECALL:
+            if( req->arg >= SRB_RADIO_MEMORY_CHANNELS )
+                return RADIOD_EINVAL;
+            return srb_channels_recall(&plan, req->arg) < 0 ? RADIOD_EIO : RADIOD_OK;
+        case RADIOD_OP_MEMORY_STORE:
+            if( req->arg >= SRB_RADIO_MEMORY_CHANNELS )
+                return RADIOD_EINVAL;
+            return radiod_channel_status(srb_channels_store_active(&plan, req->arg), before);
+        case RADIOD_OP_PLAN_CHANNEL:
+            if( req->arg >= SRB_RADIO_MEMORY_CHANNELS || req->value == SRB_CHANNEL_UNKNOWN )
+                return RADIOD_EINVAL;
+            return radiod_channel_status(srb_channels_store(&plan, req->arg, req->value), before);
+        case RADIOD_OP_QUERY:
+        {
+            if( strchr("NDV#TF", req->arg) == NULL || req->arg == 0 )
+                return RADIOD_EINVAL;
+            uint8_t query[2] = { 'Q', req->arg };
+            srb_command_t cmd = (srb_command_t)srb_command_for_opcode(query);
+            if( srb_status_lookup(&status, cmd, data) )
+                return RADIOD_OK;
+            int ret = srb_radio_query((const char *)query, data);
+            srb_status_record(&status, cmd, ret < 0 ? SRB_RADIO_ENORESPONSE : 0, data);
+            return ret < 0 ? RADIOD_EIO : RADIOD_OK;
+        }
+        default:
+            return RADIOD_EINVAL;
+    }
+}
+
+static void radiod_run_one(void)
+{
+    radiod_command_t cmd = queue[queue_head];
+    queue_head = (queue_head + 1) % RADIOD_QUEUE_SIZE;
+    queue_count--;
+
+    //  the client went away after queueing this; don't bother the radio
+    if( clients[cmd.client].fd < 0 || clients[cmd.client].generation != cmd.generation )
+        return;
+
+    radiod_reply_t reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.id = cmd.request.id;
+    reply.op = cmd.request.op;
+    reply.status = radiod_execute(&cmd.request, reply.data);
+    radiod_reply(cmd.client, &reply);
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    signal(SIGPIPE, SIG_IGN);
+
+#ifndef SRB_RADIO_SIMULATOR
+    if( !bcm2835_init() )
+        pabort("Unable to init BCM2835 lib");
+#endif
+    srb_radio_init();
+    srb_channels_init(&plan);
+    if( srb_channels_load(&plan, channels_path) < 0 )
+        fprintf(stderr, "WARN | ignoring malformed %s\n", channels_path);
+    srb_status_t *shared = srb_status_create();
+    if( shared == NULL )
+        perror("WARN | status cache not published");
+    srb_status_init(&status, shared, temperature_ttl_us);
+
+    for(uint8_t i = 0; i < RADIOD_MAX_CLIENTS; i++ )
+        clients[i].fd = -1;
+    int listen_fd = radiod_listen();
+
+    struct pollfd fds[RADIOD_MAX_CLIENTS + 1];
+    while(1) {
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for(uint8_t i = 0; i < RADIOD_MAX_CLIENTS; i++ ) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN | (clients[i].backlog_count ? POLLOUT : 0);
+            fds[i + 1].revents = 0;
+        }
+        //  block only when there is nothing queued for the radio or due in the cache
+        if( poll(fds, ARRAY_SIZE(fds), queue_count ? 0 : srb_status_next_due_ms(&status)) < 0 ) {
+            if( errno == EINTR )
+                continue;
+            pabort("poll failed");
+        }
+        if( fds[0].revents & POLLIN )
+            radiod_accept(listen_fd);
+        for(uint8_t i = 0; i < RADIOD_MAX_CLIENTS; i++ ) {
+            if( fds[i + 1].fd >= 0 && (fds[i + 1].revents & POLLOUT) )
+                radiod_flush(i);
+            if( clients[i].fd >= 0 && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) )
+                radiod_receive(i);
+        }
+        if( queue_count )
+            radiod_run_one();
+        else
+            srb_status_refresh(&status);
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ *  radiod.h
+ *
+ *  Wire protocol for radiod, the resident SRB-MX146LV control daemon.
+ *
+ *  Clients connect to RADIOD_SOCKET_PATH (AF_UNIX, SOCK_SEQPACKET) and
+ *  send fixed size radiod_request_t records.  Requests may be pipelined;
+ *  each one is answered by a radiod_reply_t carrying the same id once
+ *  the radio has executed it.  All fields are little endian.
+ */
+
+#ifndef RADIOD_H
+#define RADIOD_H
+
+#include <stdint.h>
+#include "srb_radio.h"
+
+#define RADIOD_SOCKET_PATH      "/var/run/radiod.sock"
+
+//  request ops mirror the radio's own command letters
+#define RADIOD_OP_SET_FREQUENCY 'B'     //  value = frequency in Hz
+#define RADIOD_OP_MEMORY_RECALL 'M'     //  arg = channel
+#define RADIOD_OP_MEMORY_STORE  'm'     //  arg = channel
+#define RADIOD_OP_QUERY         'Q'     //  arg = query letter: N, D, V, #, T, F
+#define RADIOD_OP_PLAN_CHANNEL  'P'     //  arg = channel, value = frequency in Hz; written only if it changed
+
+//  reply status
+#define RADIOD_OK               0
+#define RADIOD_EINVAL           -1      //  malformed request or argument out of range
+#define RADIOD_EBUSY            -2      //  command queue full, request dropped
+#define RADIOD_EIO              -3      //  the transfer to the radio failed
+
+typedef struct __attribute__((packed)) {
+    uint16_t id;            //  chosen by the client, echoed in the reply
+    uint8_t op;
+    uint8_t arg;
+    uint32_t value;
+} radiod_request_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t id;
+    uint8_t op;
+    int8_t status;
+    uint8_t data[SRB_RADIO_MESSAGE_LENGTH];     //  raw response frame for queries
+} radiod_reply_t;
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ *  read_accel.c
+ *
+ *  Streaming sampler for the ADXL335 accelerometer on the ATtiny ADC
+ *  bridge (I2C 0x26).  It reads the three axis channels at a fixed raw
+ *  rate, converts them to g, and publishes one decimated record per
+ *  window into the shared memory ring described in accel.h.  With
+ *  --watch it attaches to a running sampler and prints its records.
+ *  --test checks the decimator without hardware.
+ *
+ *  The bridge is shared with read_humidity and with helium.py's
+ *  occasional smbus reads, so the axes are read through i2c-dev as well
+ *  and the kernel serialises them; the BCM2835 library is only used for
+ *  its system timer.
+ *
+ *  The bridge returns each 10 bit conversion as two bytes, low byte
+ *  first, from the register numbered by the channel.  The default axis
+ *  channels (3,4,5) and scaling assume the ADXL335 at 3.3 V on the
+ *  bridge's 3.3 V reference: 330 mV/g, 1.65 V at 0 g.  Check both
+ *  against the payload wiring and a tumble calibration.
+ *
+ *  To compile:
+ *  gcc read_accel.c accel.c -o read_accel -std=gnu99 -lbcm2835 -lrt -lm
+ *
+ *  Examples:
+ *  read_accel -r 200 -d 20             200 Hz raw, 10 Hz filtered records
+ *  read_accel -w                       print records from a running sampler
+ */
+
+#include "accel.h"
+#include <bcm2835.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define ACCEL_BRIDGE_ADDRESS    0x26
+#define ACCEL_I2C_DEVICE        "/dev/i2c-1"
+
+static uint8_t channels[ACCEL_AXES] = { 3, 4, 5 };
+static uint32_t rate_hz = 200;
+static uint8_t decimation = 20;
+static float zero_counts = 511.5f;
+static float counts_per_g = 102.3f;     //  0.33 V/g * 1023 / 3.3 V
+static uint32_t count = 0;
+static uint8_t watch = 0;
+static uint8_t test = 0;
+static int i2c_fd = -1;
+
+static void pabort(const char *s)
+{
+	perror(s);
+	abort();
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [-crdzsnwt]\n", prog);
+    puts(   "-c --chan\tbridge channels of the X,Y,Z axes (default 3,4,5)\n"
+            "-r --rate\traw samples per second (default 200)\n"
+            "-d --decimate\traw samples per published record, 1-64 (default 20)\n"
+            "-z --zero\tADC counts at 0 g (default 511.5)\n"
+            "-s --scale\tADC counts per g (default 102.3)\n"
+            "-n --count\tstop after this many records, 0 to run forever (default 0)\n"
+            "-w --watch\tprint records published by a running sampler\n"
+            "-t --test\tcheck the decimator, no hardware needed\n");
+    exit(1);
+}
+
+static void parse_channels(char *list)
+{
+    uint8_t n = 0;
+    for(char *tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",") ) {
+        if( n == ACCEL_AXES )
+            print_usage("read_accel");
+        channels[n++] = (uint8_t)atoi(tok);
+    }
+    if( n != ACCEL_AXES )
+        print_usage("read_accel");
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "chan",       required_argument,  NULL,   'c'},
+            { "rate",       required_argument,  NULL,   'r'},
+            { "decimate",   required_argument,  NULL,   'd'},
+            { "zero",       required_argument,  NULL,   'z'},
+            { "scale",      required_argument,  NULL,   's'},
+            { "count",      required_argument,  NULL,   'n'},
+            { "watch",      no_argument,        NULL,   'w'},
+            { "test",       no_argument,        NULL,   't'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "c:r:d:z:s:n:wt", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'c':
+                parse_channels(optarg);
+                break;
+            case 'r':
+                rate_hz = strtoul(optarg, NULL, 10);
+                //  three register reads per sample at 100 kHz leave room for about 1 kHz
+                if( rate_hz == 0 || rate_hz > 1000 )
+                    pabort("rate out of range");
+                break;
+            case 'd':
+            {
+                int d = atoi(optarg);
+                if( d < 1 || d > ACCEL_MAX_DECIMATION )
+                    pabort("decimation out of range");
+                decimation = (uint8_t)d;
+                break;
+            }
+            case 'z':
+                zero_counts = strtof(optarg, NULL);
+                break;
+            case 's':
+                counts_per_g = strtof(optarg, NULL);
+                if( counts_per_g == 0 )
+                    print_usage(argv[0]);
+                break;
+            case 'n':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                watch = 1;
+                break;
+            case 't':
+                test = 1;
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+//  register number, repeated start, two bytes: one transaction, like smbus block reads
+static int read_axis(uint8_t channel, uint16_t *value)
+{
+    uint8_t reg = channel;
+    uint8_t buf[2];
+    struct i2c_msg msgs[2] = {
+        { .addr = ACCEL_BRIDGE_ADDRESS, .flags = 0,        .len = 1,           .buf = &reg },
+        { .addr = ACCEL_BRIDGE_ADDRESS, .flags = I2C_M_RD, .len = sizeof(buf), .buf = buf },
+    };
+    struct i2c_rdwr_ioctl_data xfer = { msgs, 2 };
+    if( ioctl(i2c_fd, I2C_RDWR, &xfer) != 2 )
+        return -1;
+    *value = (uint16_t)(buf[0] | buf[1] << 8);
+    return 0;
+}
+
+//  sleep for most of the interval, then finish on the system timer
+static void wait_until(uint64_t deadline)
+{
+    uint64_t now = bcm2835_st_read();
+    if( now >= deadline )
+        return;
+    if( deadline - now > 450 ) {
+        struct timespec t = { 0, 1000 * (long)(deadline - now - 200) };
+        nanosleep(&t, NULL);
+    }
+    while( bcm2835_st_read() < deadline )
+        ;
+}
+
+static void run(accel_ring_t *ring)
+{
+    accel_decimator_t dec;
+    accel_decimator_init(&dec, decimation);
+    uint64_t period = 1000000 / rate_hz;
+    uint64_t next = bcm2835_st_read();
+    float g[ACCEL_AXES] = { 0, 0, 0 };
+
+    ring->raw_hz = rate_hz;
+    ring->output_hz = rate_hz / decimation;
+    for(uint32_t written = 0; count == 0 || written < count; ) {
+        wait_until(next);
+        if( bcm2835_st_read() > next + period )
+            ring->overruns++;
+
+        uint64_t stamp = bcm2835_st_read();
+        for(uint8_t a = 0; a < ACCEL_AXES; a++ ) {
+            uint16_t raw;
+            //  a failed read holds the axis at its last value rather than
+            //  putting a step through the filter
+            if( read_axis(channels[a], &raw) < 0 )
+                ring->errors++;
+            else
+                g[a] = ((float)raw - zero_counts) / counts_per_g;
+        }
+
+        uint32_t head = ring->head;
+        if( accel_decimator_push(&dec, g, stamp, &ring->records[head & (ACCEL_RING_SIZE - 1)]) ) {
+            __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+            written++;
+        }
+
+        next += period;
+        //  if we fell more than a period behind, don't try to catch up in a burst
+        if( bcm2835_st_read() > next + period )
+            next = bcm2835_st_read();
+    }
+}
+
+static int watch_records(void)
+{
+    const accel_ring_t *ring = accel_ring_open();
+    if( ring == NULL )
+        pabort("no sampler running");
+    accel_record_t batch[16];
+    uint32_t cursor = ring->head;
+    while(1) {
+        uint32_t n = accel_ring_read(ring, &cursor, batch, ARRAY_SIZE(batch));
+        for(uint32_t i = 0; i < n; i++ ) {
+            const accel_record_t *r = &batch[i];
+            printf("%llu", (unsigned long long)r->timestamp);
+            for(uint8_t a = 0; a < ACCEL_AXES; a++ )
+                printf(" %.3f [%.2f %.2f] %.3f", r->g[a], r->min[a], r->max[a], r->rms[a]);
+            printf("\n");
+        }
+        if( n == 0 ) {
+            fflush(stdout);
+            usleep(1000000 / (ring->output_hz ? ring->output_hz : 10));
+        }
+    }
+    return 0;
+}
+
+//  feed a signal through the decimator and return the mean and the largest
+//  deviation from it of the filtered X axis, skipping the filter's warm-up
+static void run_signal(uint8_t d, float dc, float amplitude, double cycles_per_sample,
+        float *mean, float *deviation)
+{
+    accel_decimator_t dec;
+    accel_decimator_init(&dec, d);
+    accel_record_t r;
+    float out[64];
+    uint32_t n = 0;
+    for(uint32_t i = 0; n < ARRAY_SIZE(out); i++ ) {
+        float x = dc + amplitude * (float)sin(2 * M_PI * cycles_per_sample * i);
+        float g[ACCEL_AXES] = { x, 0, 1 };
+        if( accel_decimator_push(&dec, g, i, &r) && i >= ACCEL_MAX_TAPS )
+            out[n++] = r.g[0];
+    }
+    double sum = 0;
+    for(uint32_t i = 0; i < n; i++ )
+        sum += out[i];
+    *mean = (float)(sum / n);
+    *deviation = 0;
+    for(uint32_t i = 0; i < n; i++ )
+        if( fabsf(out[i] - *mean) > *deviation )
+            *deviation = fabsf(out[i] - *mean);
+}
+
+static int self_test(void)
+{
+    int failures = 0;
+    float mean, deviation;
+    const uint32_t d = 20;
+
+    //  DC passes at unity gain
+    run_signal(d, 1.0f, 0, 0, &mean, &deviation);
+    if( fabsf(mean - 1.0f) > 1e-4f || deviation > 1e-4f ) {
+        printf("FAIL | DC gain %f\n", mean);
+        failures++;
+    }
+    //  well inside the passband: a tone at a tenth of the output rate
+    run_signal(d, 0, 1.0f, 0.1 / d, &mean, &deviation);
+    if( deviation < 0.9f ) {
+        printf("FAIL | passband tone attenuated to %f\n", deviation);
+        failures++;
+    }
+    //  above the output Nyquist frequency a tone would alias; it must be rejected,
+    //  just past Nyquist and further out, at the default and the largest decimation
+    static const uint32_t stop_decimations[] = { 20, ACCEL_MAX_DECIMATION };
+    static const double stop_cycles[] = { 0.55, 0.8, 1.7 };
+    for(uint8_t i = 0; i < ARRAY_SIZE(stop_decimations); i++ ) {
+        for(uint8_t j = 0; j < ARRAY_SIZE(stop_cycles); j++ ) {
+            uint32_t sd = stop_decimations[i];
+            run_signal(sd, 0, 1.0f, stop_cycles[j] / sd, &mean, &deviation);
+            if( deviation > 0.01f ) {
+                printf("FAIL | d=%u stopband tone at %.2f/d leaks %f\n", sd, stop_cycles[j], deviation);
+                failures++;
+            }
+        }
+    }
+
+    //  a one-sample 5 g spike is smoothed away in g but kept in max and RMS
+    accel_decimator_t dec;
+    accel_decimator_init(&dec, d);
+    accel_record_t r;
+    int seen = 0;
+    for(uint32_t i = 0; i < 10 * d; i++ ) {
+        float g[ACCEL_AXES] = { i == 5 * d + 3 ? 5.0f : 0, 0, 1 };
+        if( accel_decimator_push(&dec, g, i, &r) && r.timestamp == 6 * d - 1 ) {
+            seen = 1;
+            if( r.max[0] != 5.0f || r.min[0] != 0 || fabsf(r.rms[0] - 5.0f / sqrtf(d)) > 1e-4f ||
+                    r.g[0] > 0.5f || r.samples != d || r.rms[2] != 1.0f ) {
+                printf("FAIL | spike window g %f max %f rms %f\n", r.g[0], r.max[0], r.rms[0]);
+                failures++;
+            }
+        }
+    }
+    if( !seen ) {
+        printf("FAIL | spike window missing\n");
+        failures++;
+    }
+
+    //  throughput of the decimator alone, at the largest filter
+    accel_decimator_init(&dec, ACCEL_MAX_DECIMATION);
+    const uint32_t samples = 2000000;
+    struct timespec a, b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    float sink = 0;
+    for(uint32_t i = 0; i < samples; i++ ) {
+        float g[ACCEL_AXES] = { (float)(i & 1023), 0, 1 };
+        if( accel_decimator_push(&dec, g, i, &r) )
+            sink += r.g[0];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    double ns = (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+    printf("%u taps: %.1f ns per raw sample (%g)\n", dec.taps, ns / samples, sink);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    if( test )
+        return self_test();
+    if( watch )
+        return watch_records();
+
+    if( !bcm2835_init() )
+        pabort("Unable to init BCM2835 lib");
+    i2c_fd = open(ACCEL_I2C_DEVICE, O_RDWR);
+    if( i2c_fd < 0 )
+        pabort(ACCEL_I2C_DEVICE);
+
+    accel_ring_t *ring = accel_ring_create();
+    if( ring == NULL )
+        pabort("unable to create shared memory ring");
+    run(ring);
+    close(i2c_fd);
+    bcm2835_close();
+    return 0;
+}
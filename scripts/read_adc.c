@@ -1,4 +1,23 @@
-#include "hab_spi.h"
+/*
+ *  read_adc.c
+ *
+ *  Continuous multi-channel sampler for the MCP3008 SPI ADC.
+ *
+ *  As a sampler it owns the ADC's virtual *CS, scans the requested
+ *  channels at a fixed rate and publishes samples into the shared
+ *  memory ring described in read_adc.h.  With --watch it instead
+ *  attaches to a running sampler's ring and prints batches as they
+ *  arrive, which is how other consumers are expected to read the ADC.
+ *
+ *  To compile:
+ *  gcc read_adc.c hab_spi.c -o read_adc -std=gnu99 -lbcm2835 -lrt
+ *
+ *  Examples:
+ *  read_adc -c 0,1,2 -r 100 -d 10      sample ch 0-2 at 100 Hz, publish 10 Hz averages
+ *  read_adc -w                         print samples from a running sampler
+ */
+
+#include "read_adc.h"
 #include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -6,13 +25,24 @@
 #include <string.h>
 #include <getopt.h>
 #include <fcntl.h>
-#include <sys/ioctl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <linux/types.h>
-#include <linux/spi/spidev.h>
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 #define BUF_SIZE(a) (sizeof(a) / sizeof(uint8_t))
 
+static read_adc_config_t config = {
+    .cs = HAB_SPI_CSC,
+    .channels = { 0 },
+    .channel_count = 1,
+    .rate_hz = 10,
+    .decimation = 1,
+    .scans = 0,
+};
+static uint8_t watch = 0;
+
 static void pabort(const char *s)
 {
 	perror(s);
@@ -21,7 +51,223 @@ static void pabort(const char *s)
 
 static void print_usage(const char *prog)
 {
-    printf("Usage: %s [-c]\n", prog);
-    puts(   "-c --chan\tRead from specified channel\n");
+    printf("Usage: %s [-csrdnw]\n", prog);
+    puts(   "-c --chan\tRead from specified channel(s), comma separated\n"
+            "-s --cs\t\tvirtual chip select of the ADC (A,B,C,D)\n"
+            "-r --rate\tscan rate in Hz\n"
+            "-d --decimate\taverage this many scans per published sample\n"
+            "-n --count\tstop after this many scans\n"
+            "-w --watch\tprint samples published by a running sampler\n");
     exit(1);
-}
\ No newline at end of file
+}
+
+read_adc_ring_t *read_adc_ring_create(void)
+{
+    int fd = shm_open(READ_ADC_SHM_NAME, O_RDWR | O_CREAT, 0644);
+    if( fd < 0 )
+        return NULL;
+    if( ftruncate(fd, sizeof(read_adc_ring_t)) < 0 ) {
+        close(fd);
+        return NULL;
+    }
+    read_adc_ring_t *ring = mmap(NULL, sizeof(read_adc_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if( ring == MAP_FAILED )
+        return NULL;
+    memset(ring, 0, sizeof(read_adc_ring_t));
+    ring->size = READ_ADC_RING_SIZE;
+    __atomic_store_n(&ring->magic, READ_ADC_MAGIC, __ATOMIC_RELEASE);
+    return ring;
+}
+
+const read_adc_ring_t *read_adc_ring_open(void)
+{
+    int fd = shm_open(READ_ADC_SHM_NAME, O_RDONLY, 0);
+    if( fd < 0 )
+        return NULL;
+    const read_adc_ring_t *ring = mmap(NULL, sizeof(read_adc_ring_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if( ring == MAP_FAILED )
+        return NULL;
+    if( __atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != READ_ADC_MAGIC ||
+            ring->size != READ_ADC_RING_SIZE ) {
+        munmap((void *)ring, sizeof(read_adc_ring_t));
+        return NULL;
+    }
+    return ring;
+}
+
+/*
+ *  Single-ended conversion on one channel
+ *  Must be called inside a hab_spi_begin()/hab_spi_end() session.
+ */
+uint16_t read_adc_channel(uint8_t channel)
+{
+    char tx[3] = { 0x01, (char)((0x08 | (channel & 0x07)) << 4), 0x00 };
+    char rx[3];
+    bcm2835_spi_transfernb(tx, rx, sizeof(tx));
+    return (uint16_t)(((rx[1] & 0x03) << 8) | (uint8_t)rx[2]);
+}
+
+//  sleep for most of the interval, then finish on the system timer
+static void read_adc_wait_until(uint64_t deadline)
+{
+    uint64_t now = bcm2835_st_read();
+    if( now >= deadline )
+        return;
+    if( deadline - now > 450 ) {
+        struct timespec t = { 0, 1000 * (long)(deadline - now - 200) };
+        nanosleep(&t, NULL);
+    }
+    while( bcm2835_st_read() < deadline )
+        ;
+}
+
+void read_adc_run(const read_adc_config_t *cfg, read_adc_ring_t *ring)
+{
+    uint32_t sums[READ_ADC_MAX_CHANNELS] = { 0 };
+    uint8_t accumulated = 0;
+    uint64_t period = 1000000 / cfg->rate_hz;
+    uint64_t next = bcm2835_st_read();
+
+    ring->rate_hz = cfg->rate_hz;
+    for(uint32_t scan = 0; cfg->scans == 0 || scan < cfg->scans; scan++ ) {
+        read_adc_wait_until(next);
+        if( bcm2835_st_read() > next + period )
+            ring->overruns++;
+
+        //  one decoder selection for the whole channel list
+        hab_spi_begin(cfg->cs);
+        for(uint8_t i = 0; i < cfg->channel_count; i++ )
+            sums[i] += read_adc_channel(cfg->channels[i]);
+        hab_spi_end();
+
+        if( ++accumulated == cfg->decimation ) {
+            uint64_t now = bcm2835_st_read();
+            uint32_t head = ring->head;
+            for(uint8_t i = 0; i < cfg->channel_count; i++ ) {
+                read_adc_sample_t *s = &ring->samples[(head + i) & (READ_ADC_RING_SIZE - 1)];
+                s->timestamp = now;
+                s->channel = cfg->channels[i];
+                s->decimation = accumulated;
+                s->value = (uint16_t)((sums[i] + accumulated / 2) / accumulated);
+                sums[i] = 0;
+            }
+            __atomic_store_n(&ring->head, head + cfg->channel_count, __ATOMIC_RELEASE);
+            accumulated = 0;
+        }
+
+        next += period;
+        //  if we fell more than a period behind, don't try to catch up in a burst
+        if( bcm2835_st_read() > next + period )
+            next = bcm2835_st_read();
+    }
+}
+
+static void parse_channels(char *list)
+{
+    config.channel_count = 0;
+    for(char *tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",") ) {
+        int ch = atoi(tok);
+        if( ch < 0 || ch >= READ_ADC_MAX_CHANNELS )
+            pabort("channel out of range");
+        if( config.channel_count == READ_ADC_MAX_CHANNELS )
+            pabort("too many channels");
+        config.channels[config.channel_count++] = (uint8_t)ch;
+    }
+    if( config.channel_count == 0 )
+        print_usage("read_adc");
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "chan",       required_argument,  NULL,   'c'},
+            { "cs",         required_argument,  NULL,   's'},
+            { "rate",       required_argument,  NULL,   'r'},
+            { "decimate",   required_argument,  NULL,   'd'},
+            { "count",      required_argument,  NULL,   'n'},
+            { "watch",      no_argument,        NULL,   'w'},
+            {NULL,0,0,0},
+        };
+        int c;
+        c = getopt_long(argc, argv, "c:s:r:d:n:w", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'c':
+                parse_channels(optarg);
+                break;
+            case 's':
+            {
+                char c_cs = optarg[0] | 0x20;   //  lower case
+                if( c_cs < 'a' || c_cs > 'd' )
+                    pabort("invalid option for --cs");
+                config.cs = (hab_spi_cs_t)(c_cs - 'a');
+                break;
+            }
+            case 'r':
+                config.rate_hz = atoi(optarg);
+                if( config.rate_hz == 0 || config.rate_hz > 20000 )
+                    pabort("rate out of range");
+                break;
+            case 'd':
+            {
+                int d = atoi(optarg);
+                if( d < 1 || d > 255 )
+                    pabort("decimation out of range");
+                config.decimation = (uint8_t)d;
+                break;
+            }
+            case 'n':
+                config.scans = atoi(optarg);
+                break;
+            case 'w':
+                watch = 1;
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static int watch_samples(void)
+{
+    const read_adc_ring_t *ring = read_adc_ring_open();
+    if( ring == NULL )
+        pabort("no sampler running");
+    read_adc_sample_t batch[64];
+    uint32_t cursor = ring->head;
+    while(1) {
+        uint32_t n = read_adc_ring_read(ring, &cursor, batch, ARRAY_SIZE(batch));
+        for(uint32_t i = 0; i < n; i++ )
+            printf("%llu %u %u\n", (unsigned long long)batch[i].timestamp, batch[i].channel, batch[i].value);
+        if( n == 0 ) {
+            fflush(stdout);
+            usleep(1000000 / (ring->rate_hz ? ring->rate_hz : 10));
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    if( watch )
+        return watch_samples();
+
+    if( !bcm2835_init() )
+        pabort("Unable to init BCM2835 lib");
+    hab_spi_set_aux_gpio(RPI_V2_GPIO_P1_18, RPI_V2_GPIO_P1_22);
+    //  MCP3008 tops out around 1.35 MHz at 2.7 V
+    hab_spi_register_device(config.cs, BCM2835_SPI_MODE0, BCM2835_SPI_CLOCK_DIVIDER_256, LOW);
+
+    read_adc_ring_t *ring = read_adc_ring_create();
+    if( ring == NULL )
+        pabort("unable to create shared memory ring");
+    read_adc_run(&config, ring);
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ *  read_adc.h
+ *
+ *  Continuous acquisition from an MCP3008 (8 channel, 10 bit) SPI ADC
+ *  on one of the hab_spi virtual chip selects.
+ *
+ *  The sampler scans a list of channels at a fixed rate paced by the
+ *  BCM2835 system timer and publishes timestamped samples into a ring
+ *  buffer in POSIX shared memory.  There is a single writer; any number
+ *  of readers keep their own cursor and pull samples out in batches
+ *  with read_adc_ring_read() without locking or talking to the bus.
+ */
+
+#ifndef READ_ADC_H
+#define READ_ADC_H
+
+#include "hab_spi.h"
+#include <stdint.h>
+#include <string.h>
+
+#define READ_ADC_SHM_NAME       "/hab_read_adc"
+#define READ_ADC_MAGIC          0x41444331      //  'ADC1'
+#define READ_ADC_MAX_CHANNELS   8
+#define READ_ADC_RING_SIZE      4096            //  must be a power of 2
+
+typedef struct {
+    uint64_t timestamp;     //  system timer (us) at the end of the scan
+    uint8_t channel;
+    uint8_t decimation;     //  number of raw samples averaged into value
+    uint16_t value;
+} read_adc_sample_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t rate_hz;                   //  scan rate before decimation
+    uint32_t overruns;                  //  scans that started late
+    volatile uint32_t head;             //  total samples ever written
+    read_adc_sample_t samples[READ_ADC_RING_SIZE];
+} read_adc_ring_t;
+
+typedef struct {
+    hab_spi_cs_t cs;
+    uint8_t channels[READ_ADC_MAX_CHANNELS];
+    uint8_t channel_count;
+    uint32_t rate_hz;
+    uint8_t decimation;                 //  1 = no decimation
+    uint32_t scans;                     //  0 = run forever
+} read_adc_config_t;
+
+read_adc_ring_t *read_adc_ring_create(void);
+const read_adc_ring_t *read_adc_ring_open(void);
+uint16_t read_adc_channel(uint8_t channel);
+void read_adc_run(const read_adc_config_t *config, read_adc_ring_t *ring);
+
+/*
+ *  Copy up to max samples that are newer than *cursor into out and
+ *  advance the cursor.  A reader that falls more than a ring behind
+ *  skips forward to the oldest sample still available.  Samples that
+ *  the writer overwrote while we were copying are discarded; the writer
+ *  may be filling up to one scan past head, so that much is held back.
+ */
+static inline uint32_t read_adc_ring_read(const read_adc_ring_t *ring, uint32_t *cursor,
+        read_adc_sample_t *out, uint32_t max)
+{
+    const uint32_t window = READ_ADC_RING_SIZE - READ_ADC_MAX_CHANNELS;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t tail = *cursor;
+    if( head - tail > window )
+        tail = head - window;
+    uint32_t n = head - tail;
+    if( n > max )
+        n = max;
+    for(uint32_t i = 0; i < n; i++ )
+        out[i] = ring->samples[(tail + i) & (READ_ADC_RING_SIZE - 1)];
+
+    //  anything the writer lapped during the copy is no longer valid
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t now = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t lost = 0;
+    if( now - tail > window )
+        lost = (now - tail) - window;
+    if( lost >= n ) {
+        *cursor = now - window;
+        return 0;
+    }
+    if( lost )
+        memmove(out, out + lost, (n - lost) * sizeof(read_adc_sample_t));
+    *cursor = tail + n;
+    return n - lost;
+}
+
+#endif
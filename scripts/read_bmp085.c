@@ -0,0 +1,165 @@
+/*
+ *  read_bmp085.c
+ *
+ *  Reads the BMP085 through the native driver in bmp085.c and prints
+ *  temperature, pressure and altitude from one conversion sequence per
+ *  sample.  --test checks the compensation against the worked example
+ *  in the datasheet and times it over a large batch; it needs no
+ *  hardware.
+ *
+ *  To compile:
+ *  gcc read_bmp085.c bmp085.c altitude.c -o read_bmp085 -std=gnu99 -lbcm2835 -lm
+ *
+ *  Examples:
+ *  read_bmp085 -o 3 -b 4 -n 10 -r 2    10 samples at 2 Hz, each the mean of 4 ultra high res conversions
+ *  read_bmp085 -t                      self test, no hardware needed
+ */
+
+#include "bmp085.h"
+#include <bcm2835.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static uint8_t oss = BMP085_OSS_STANDARD;
+static uint8_t burst = 1;
+static uint32_t count = 1;
+static uint32_t rate_hz = 1;
+static int32_t sea_level_pa = BMP085_SEA_LEVEL_PA;
+static uint8_t test = 0;
+
+static void pabort(const char *s)
+{
+	perror(s);
+	abort();
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [-obnrpt]\n", prog);
+    puts(   "-o --oss\toversampling setting 0-3 (default 1)\n"
+            "-b --burst\tpressure conversions averaged per sample (default 1)\n"
+            "-n --count\tnumber of samples, 0 to run forever (default 1)\n"
+            "-r --rate\tsamples per second (default 1)\n"
+            "-p --slp\tsea level pressure in Pa for the altitude (default 101325)\n"
+            "-t --test\tcheck the compensation against the datasheet example\n");
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "oss",        required_argument,  NULL,   'o'},
+            { "burst",      required_argument,  NULL,   'b'},
+            { "count",      required_argument,  NULL,   'n'},
+            { "rate",       required_argument,  NULL,   'r'},
+            { "slp",        required_argument,  NULL,   'p'},
+            { "test",       no_argument,        NULL,   't'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "o:b:n:r:p:t", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'o':
+                oss = atoi(optarg);
+                if( oss > BMP085_OSS_ULTRAHIGHRES )
+                    print_usage(argv[0]);
+                break;
+            case 'b':
+                burst = atoi(optarg);
+                if( burst < 1 || burst > BMP085_MAX_BURST )
+                    print_usage(argv[0]);
+                break;
+            case 'n':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                rate_hz = strtoul(optarg, NULL, 10);
+                if( rate_hz == 0 )
+                    print_usage(argv[0]);
+                break;
+            case 'p':
+                sea_level_pa = atoi(optarg);
+                break;
+            case 't':
+                test = 1;
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static int self_test(void)
+{
+    //  the worked example in the BMP085 datasheet, oss = 0
+    static const bmp085_calibration_t cal = {
+        .ac1 = 408, .ac2 = -72, .ac3 = -14383, .ac4 = 32741, .ac5 = 32757, .ac6 = 23153,
+        .b1 = 6190, .b2 = 4, .mb = -32768, .mc = -8711, .md = 2868,
+    };
+    bmp085_raw_t raw = { .ut = 27898, .up = 23843 };
+    bmp085_sample_t s;
+    bmp085_compensate(&cal, 0, &raw, 1, 0, &s);
+    int ok = s.temperature == 150 && s.pressure == 69964;
+    printf("datasheet example: T=%d (150) p=%d (69964) %s\n", s.temperature, s.pressure, ok ? "OK" : "FAIL");
+
+    //  batch throughput, one temperature shared by a burst of pressures
+    enum { N = 100000 };
+    static bmp085_raw_t batch[N];
+    static bmp085_sample_t out[N];
+    for(uint32_t i = 0; i < N; i++ ) {
+        batch[i].ut = 27898 + i / BMP085_MAX_BURST;
+        batch[i].up = 23843 + (i % 64);
+    }
+    struct timespec a, b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    bmp085_compensate(&cal, 0, batch, N, 0, out);
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    double ns = ((b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec)) / N;
+    printf("compensation: %.1f ns per raw sample in bursts of %d\n", ns, BMP085_MAX_BURST);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    if( test )
+        return self_test();
+
+    if( !bcm2835_init() )
+        pabort("bcm2835_init");
+    bmp085_t dev;
+    int ret = bmp085_init(&dev, oss, burst, sea_level_pa);
+    if( ret == BMP085_ECALIBRATION )
+        pabort("BMP085 calibration EEPROM is blank");
+    if( ret < 0 )
+        pabort("BMP085 not responding");
+
+    uint64_t period = 1000000 / rate_hz;
+    uint64_t next = bcm2835_st_read();
+    for(uint32_t n = 0; count == 0 || n < count; n++ ) {
+        bmp085_sample_t s;
+        ret = bmp085_read(&dev, &s);
+        if( ret < 0 )
+            printf("ERROR | BMP085 read failed (%d)\n", ret);
+        else
+            printf("%.1f C %d Pa %.1f m\n", s.temperature / 10.0, s.pressure, s.altitude);
+        fflush(stdout);
+
+        next += period;
+        uint64_t now = bcm2835_st_read();
+        if( now < next )
+            bcm2835_delayMicroseconds(next - now);
+        else
+            next = now;
+    }
+    bcm2835_close();
+    return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ *  read_ds18b20.c
+ *
+ *  Reads every DS18B20 on a bit-banged 1-Wire bus (onewire.c) with one
+ *  bus-wide conversion per round.  The bus is searched once at startup
+ *  and the ROMs are kept.  --test checks the CRC8 and scratchpad
+ *  decoding without hardware.
+ *
+ *  w1-gpio must not be loaded:  sudo modprobe -r w1-therm w1-gpio
+ *
+ *  To compile:
+ *  gcc read_ds18b20.c onewire.c ds18b20.c -o read_ds18b20 -std=gnu99 -lbcm2835
+ *
+ *  Examples:
+ *  read_ds18b20 -s                 list the ROMs on the bus
+ *  read_ds18b20 -r 9 -n 0 -i 1     9 bit readings every second, forever
+ */
+
+#include "onewire.h"
+#include "ds18b20.h"
+#include <bcm2835.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define READ_DS18B20_MAX_DEVICES    8
+
+static uint8_t pin = ONEWIRE_DEFAULT_PIN;
+static uint8_t bits = 12;
+static uint8_t parasite = 0;
+static uint8_t search_only = 0;
+static uint32_t count = 1;
+static uint32_t interval_s = 15;
+static uint8_t test = 0;
+
+static void pabort(const char *s)
+{
+	perror(s);
+	abort();
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [-grPsnit]\n", prog);
+    puts(   "-g --gpio\tBCM GPIO of the bus (default 4)\n"
+            "-r --resolution\t9 to 12 bits (default 12)\n"
+            "-P --parasite\tdevices are parasite powered\n"
+            "-s --search\tlist the ROMs on the bus and exit\n"
+            "-n --count\tnumber of rounds, 0 to run forever (default 1)\n"
+            "-i --interval\tseconds between rounds (default 15)\n"
+            "-t --test\tcheck CRC8 and decoding against known vectors\n");
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "gpio",       required_argument,  NULL,   'g'},
+            { "resolution", required_argument,  NULL,   'r'},
+            { "parasite",   no_argument,        NULL,   'P'},
+            { "search",     no_argument,        NULL,   's'},
+            { "count",      required_argument,  NULL,   'n'},
+            { "interval",   required_argument,  NULL,   'i'},
+            { "test",       no_argument,        NULL,   't'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "g:r:Psn:i:t", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'g':
+                pin = atoi(optarg);
+                break;
+            case 'r':
+                bits = atoi(optarg);
+                if( bits < 9 || bits > 12 )
+                    print_usage(argv[0]);
+                break;
+            case 'P':
+                parasite = 1;
+                break;
+            case 's':
+                search_only = 1;
+                break;
+            case 'n':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                interval_s = strtoul(optarg, NULL, 10);
+                break;
+            case 't':
+                test = 1;
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static void print_rom(const uint8_t *rom)
+{
+    //  the same family-serial form as /sys/bus/w1/devices
+    printf("%02x-", rom[0]);
+    for(int8_t i = 6; i >= 1; i-- )
+        printf("%02x", rom[i]);
+}
+
+static int self_test(void)
+{
+    int failures = 0;
+    //  Maxim AN27's worked example
+    static const uint8_t rom[8] = { 0x02, 0x1C, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xA2 };
+    //  DS18B20 power-on scratchpad, 85 C at 12 bits
+    static const uint8_t power_on[9] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+    //  -10.125 C (0xFF5E) at 12 bits, the CRC filled in below
+    uint8_t cold[9] = { 0x5E, 0xFF, 0x4B, 0x46, 0x7F, 0xFF, 0x02, 0x10, 0x00 };
+    cold[8] = onewire_crc8(cold, 8);
+
+    if( onewire_crc8(rom, 7) != 0xA2 || onewire_crc8(rom, 8) != 0 ) {
+        printf("FAIL | ROM CRC8\n");
+        failures++;
+    }
+    if( !ds18b20_scratchpad_valid(power_on) || ds18b20_decode(power_on) != DS18B20_POWER_ON_MC ) {
+        printf("FAIL | power-on scratchpad\n");
+        failures++;
+    }
+    //  a shorted bus and a missing device
+    static const uint8_t zeros[9] = { 0 };
+    static const uint8_t ones[9] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    if( ds18b20_scratchpad_valid(zeros) || ds18b20_scratchpad_valid(ones) ) {
+        printf("FAIL | blank scratchpad accepted\n");
+        failures++;
+    }
+    if( ds18b20_decode(cold) != -10125 ) {
+        printf("FAIL | negative temperature decoded as %d\n", ds18b20_decode(cold));
+        failures++;
+    }
+    //  the same reading at 9 bits: the low three bits are undefined
+    cold[4] = 0x1F;
+    if( ds18b20_decode(cold) != -10500 ) {
+        printf("FAIL | 9 bit reading decoded as %d\n", ds18b20_decode(cold));
+        failures++;
+    }
+    for(uint8_t b = 9; b <= 12; b++ )
+        printf("%u bit: %u ms\n", b, ds18b20_conversion_ms(b));
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    if( test )
+        return self_test();
+
+    if( !bcm2835_init() )
+        pabort("bcm2835_init");
+    onewire_t bus;
+    onewire_init(&bus, pin, parasite);
+
+    uint8_t roms[READ_DS18B20_MAX_DEVICES][ONEWIRE_ROM_LENGTH];
+    uint8_t devices = 0;
+    int ret;
+    onewire_search_reset(&bus);
+    while( devices < READ_DS18B20_MAX_DEVICES && (ret = onewire_search(&bus, roms[devices])) == 1 ) {
+        if( roms[devices][0] == DS18B20_FAMILY )
+            devices++;
+    }
+    if( ret < 0 )
+        printf("WARN | search ended early (%d)\n", ret);
+    for(uint8_t i = 0; i < devices; i++ ) {
+        print_rom(roms[i]);
+        printf("\n");
+    }
+    if( search_only || devices == 0 )
+        return devices ? 0 : 1;
+
+    if( ds18b20_set_resolution(&bus, NULL, bits) < 0 )
+        pabort("set resolution");
+    for(uint32_t n = 0; count == 0 || n < count; n++ ) {
+        if( n )
+            sleep(interval_s);
+        uint64_t start = bcm2835_st_read();
+        if( ds18b20_convert(&bus, NULL, bits) < 0 || ds18b20_wait(&bus, bits) < 0 ) {
+            printf("ERROR | conversion failed\n");
+            continue;
+        }
+        for(uint8_t i = 0; i < devices; i++ ) {
+            int32_t mc;
+            print_rom(roms[i]);
+            if( ds18b20_read(&bus, roms[i], &mc) < 0 )
+                printf(" ERROR\n");
+            else
+                printf(" %.4f C\n", mc / 1000.0);
+        }
+        printf("round: %llu ms, %u CRC errors, %u missed presence\n",
+               (unsigned long long)(bcm2835_st_read() - start) / 1000, bus.crc_errors, bus.no_presence);
+        fflush(stdout);
+    }
+    bcm2835_close();
+    return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ *  read_humidity.c
+ *
+ *  Burst sampler for the HIH-4030 humidity sensor on the ATtiny ADC
+ *  bridge (I2C 0x26).  Every interval it takes a burst of conversions
+ *  of the humidity channel, compensates the mean for the latest
+ *  exterior temperature from helium.py's telemetry snapshot and
+ *  publishes a smoothed reading into the shared memory ring described
+ *  in humidity.h.  With --watch it attaches to a running sampler and
+ *  prints its records.  --test checks the fixed point stage without
+ *  hardware.
+ *
+ *  The bridge is shared with read_accel, so the conversions go through
+ *  i2c-dev and the kernel serialises the two.  A burst is issued
+ *  HUMIDITY_CHUNK conversions to an I2C_RDWR transfer: one system call
+ *  per chunk rather than one per conversion, while a chunk holds the
+ *  bus for about 2.5 ms at 100 kHz, within what read_accel leaves free
+ *  of each 5 ms raw period at its default 200 Hz.  The default burst of
+ *  64 every 5 s is then under 1 % of the bus; each record carries the
+ *  time its burst took so the budget can be checked on the payload.
+ *
+ *  To compile:
+ *  gcc read_humidity.c humidity.c -o read_humidity -std=gnu99 -lrt -lm
+ *
+ *  Examples:
+ *  read_humidity -b 64 -i 5000         64 conversions every 5 s
+ *  read_humidity -w                    print records from a running sampler
+ */
+
+#include "humidity.h"
+#include "telemetry_snapshot.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define HUMIDITY_BRIDGE_ADDRESS 0x26
+#define HUMIDITY_I2C_DEVICE     "/dev/i2c-1"
+#define HUMIDITY_CHUNK          4               //  conversions per I2C_RDWR transfer
+
+static uint8_t channel = 2;
+static uint32_t burst_size = 64;
+static uint32_t interval_ms = 5000;
+static float smoothing = 0.1f;
+static uint32_t max_age = 60;
+static uint32_t count = 0;
+static uint8_t watch = 0;
+static uint8_t test = 0;
+static int i2c_fd = -1;
+static const telemetry_snapshot_t *snapshot = NULL;
+
+static void pabort(const char *s)
+{
+	perror(s);
+	abort();
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [-cbimanwt]\n", prog);
+    puts(   "-c --chan\tbridge channel of the HIH-4030 (default 2)\n"
+            "-b --burst\tconversions per reading, 1-4096 (default 64)\n"
+            "-i --interval\tms between readings (default 5000)\n"
+            "-m --smoothing\tweight of each new reading, 0-1 (default 0.1)\n"
+            "-a --age\tseconds an exterior temperature stays usable (default 60)\n"
+            "-n --count\tstop after this many readings, 0 to run forever (default 0)\n"
+            "-w --watch\tprint records published by a running sampler\n"
+            "-t --test\tcheck the fixed point stage, no hardware needed\n");
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "chan",       required_argument,  NULL,   'c'},
+            { "burst",      required_argument,  NULL,   'b'},
+            { "interval",   required_argument,  NULL,   'i'},
+            { "smoothing",  required_argument,  NULL,   'm'},
+            { "age",        required_argument,  NULL,   'a'},
+            { "count",      required_argument,  NULL,   'n'},
+            { "watch",      no_argument,        NULL,   'w'},
+            { "test",       no_argument,        NULL,   't'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "c:b:i:m:a:n:wt", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'c':
+                channel = (uint8_t)atoi(optarg);
+                break;
+            case 'b':
+                burst_size = strtoul(optarg, NULL, 10);
+                if( burst_size == 0 || burst_size > HUMIDITY_MAX_BURST )
+                    pabort("burst out of range");
+                break;
+            case 'i':
+                interval_ms = strtoul(optarg, NULL, 10);
+                if( interval_ms == 0 )
+                    pabort("interval out of range");
+                break;
+            case 'm':
+                smoothing = strtof(optarg, NULL);
+                if( smoothing <= 0 || smoothing > 1 )
+                    pabort("smoothing out of range");
+                break;
+            case 'a':
+                max_age = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            case 'w':
+                watch = 1;
+                break;
+            case 't':
+                test = 1;
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static uint64_t monotonic_us(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+//  n conversions of the channel in one transfer: register number, repeated start, two bytes each
+static int read_chunk(uint8_t n, humidity_burst_t *burst)
+{
+    uint8_t reg = channel;
+    uint8_t buf[HUMIDITY_CHUNK][2];
+    struct i2c_msg msgs[2 * HUMIDITY_CHUNK];
+    for(uint8_t i = 0; i < n; i++ ) {
+        msgs[2 * i]     = (struct i2c_msg){ .addr = HUMIDITY_BRIDGE_ADDRESS, .flags = 0,        .len = 1, .buf = &reg };
+        msgs[2 * i + 1] = (struct i2c_msg){ .addr = HUMIDITY_BRIDGE_ADDRESS, .flags = I2C_M_RD, .len = 2, .buf = buf[i] };
+    }
+    struct i2c_rdwr_ioctl_data xfer = { msgs, 2u * n };
+    if( ioctl(i2c_fd, I2C_RDWR, &xfer) != 2 * n )
+        return -1;
+    for(uint8_t i = 0; i < n; i++ )
+        humidity_burst_add(burst, (uint16_t)(buf[i][0] | buf[i][1] << 8));
+    return 0;
+}
+
+//  the exterior temperature in 0.1 C, if helium.py has published one recently enough
+static int exterior_temperature(int16_t *temperature)
+{
+    if( snapshot == NULL ) {
+        int fd = shm_open(TELEMETRY_SNAPSHOT_SHM_NAME, O_RDONLY, 0);
+        if( fd < 0 )
+            return 0;
+        const telemetry_snapshot_t *snap = mmap(NULL, sizeof(*snap), PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if( snap == MAP_FAILED )
+            return 0;
+        if( !telemetry_snapshot_valid(snap) ) {
+            munmap((void *)snap, sizeof(*snap));
+            return 0;
+        }
+        snapshot = snap;
+    }
+    telemetry_snapshot_body_t body;
+    telemetry_snapshot_read(snapshot, &body);
+    double age = (double)time(NULL) - body.temp_time;
+    if( body.publishes == 0 || body.temp_time == 0 || age > max_age || body.extemp < -100 || body.extemp > 100 )
+        return 0;
+    *temperature = (int16_t)lround(body.extemp * 10);
+    return 1;
+}
+
+static void run(humidity_ring_t *ring)
+{
+    humidity_stage_t stage;
+    humidity_stage_init(&stage, HUMIDITY_SUPPLY_MV, HUMIDITY_REFERENCE_MV, smoothing);
+    uint64_t period = (uint64_t)interval_ms * 1000;
+    uint64_t next = monotonic_us();
+
+    ring->burst = burst_size;
+    ring->interval_ms = interval_ms;
+    for(uint32_t written = 0; count == 0 || written < count; ) {
+        uint64_t now = monotonic_us();
+        if( now < next ) {
+            struct timespec t = { (time_t)((next - now) / 1000000), (long)((next - now) % 1000000) * 1000 };
+            nanosleep(&t, NULL);
+        } else if( now > next + period ) {
+            ring->overruns++;
+        }
+
+        humidity_burst_t burst = { 0 };
+        uint64_t start = monotonic_us();
+        for(uint32_t done = 0; done < burst_size; ) {
+            uint8_t n = burst_size - done < HUMIDITY_CHUNK ? (uint8_t)(burst_size - done) : HUMIDITY_CHUNK;
+            if( read_chunk(n, &burst) < 0 ) {
+                burst.errors += n;
+                ring->errors += n;
+            }
+            done += n;
+        }
+        uint64_t end = monotonic_us();
+
+        int16_t temperature = 250;
+        uint8_t known = (uint8_t)exterior_temperature(&temperature);
+        uint32_t head = ring->head;
+        humidity_record_t *r = &ring->records[head & (HUMIDITY_RING_SIZE - 1)];
+        if( humidity_stage_push(&stage, &burst, temperature, known, r) ) {
+            r->timestamp = end;
+            r->burst_us = (uint32_t)(end - start);
+            __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+            written++;
+        }
+
+        next += period;
+        //  if we fell more than a period behind, don't try to catch up in a burst
+        if( monotonic_us() > next + period )
+            next = monotonic_us();
+    }
+}
+
+static int watch_records(void)
+{
+    const humidity_ring_t *ring = humidity_ring_open();
+    if( ring == NULL )
+        pabort("no sampler running");
+    humidity_record_t batch[8];
+    uint32_t cursor = ring->head;
+    while(1) {
+        uint32_t n = humidity_ring_read(ring, &cursor, batch, ARRAY_SIZE(batch));
+        for(uint32_t i = 0; i < n; i++ ) {
+            const humidity_record_t *r = &batch[i];
+            printf("%llu %.2f +/- %.2f %% at %.1f C%s%s, %u/%u conversions in %u us\n",
+                    (unsigned long long)r->timestamp, r->rh, r->confidence, r->temperature / 10.0,
+                    r->temperature_known ? "" : " (assumed)", r->saturated ? " saturated" : "",
+                    r->samples, r->samples + r->errors, r->burst_us);
+        }
+        if( n == 0 ) {
+            fflush(stdout);
+            usleep(1000 * (ring->interval_ms ? ring->interval_ms : 1000));
+        }
+    }
+    return 0;
+}
+
+//  the datasheet transfer function in floating point, for comparison
+static float reference_rh(float counts, float celsius)
+{
+    float ratio = counts * HUMIDITY_REFERENCE_MV / HUMIDITY_FULL_SCALE / HUMIDITY_SUPPLY_MV;
+    return (ratio - 0.16f) / 0.0062f / (1.0546f - 0.00216f * celsius);
+}
+
+static int self_test(void)
+{
+    int failures = 0;
+    humidity_stage_t stage;
+    humidity_stage_init(&stage, HUMIDITY_SUPPLY_MV, HUMIDITY_REFERENCE_MV, 0.25f);
+
+    //  the fixed point mean and compensation track the float transfer function
+    //  over the range of the sensor and of the flight's temperatures
+    float worst = 0;
+    for(uint32_t counts = 160; counts <= 1000; counts += 7 ) {
+        for(int16_t t = -600; t <= 400; t += 50 ) {
+            humidity_burst_t burst = { 0 };
+            //  a two count spread, so the mean has a fractional part
+            for(uint32_t i = 0; i < 64; i++ )
+                humidity_burst_add(&burst, (uint16_t)(counts + (i % 3)));
+            uint32_t mean_q8 = (uint32_t)((((uint64_t)burst.sum << 8) + 32) / 64);
+            float fixed = humidity_compensate(&stage, mean_q8, t) / 100.0f;
+            float error = fabsf(fixed - reference_rh(burst.sum / 64.0f, t / 10.0f));
+            if( error > worst )
+                worst = error;
+        }
+    }
+    if( worst > 0.05f ) {
+        printf("FAIL | fixed point off the transfer function by %.3f %% RH\n", worst);
+        failures++;
+    }
+
+    //  50 % sensor RH at 25 C; a steady burst adds no noise to the confidence
+    humidity_burst_t burst = { 0 };
+    uint16_t mid = (uint16_t)lroundf((0.16f + 0.0062f * 50) * HUMIDITY_SUPPLY_MV * HUMIDITY_FULL_SCALE / HUMIDITY_REFERENCE_MV);
+    for(uint32_t i = 0; i < 64; i++ )
+        humidity_burst_add(&burst, mid);
+    humidity_record_t r;
+    if( !humidity_stage_push(&stage, &burst, 250, 1, &r) ||
+            fabsf(r.rh - reference_rh(mid, 25)) > 0.05f || r.samples != 64 || r.saturated ) {
+        printf("FAIL | steady burst read %.2f %% RH\n", r.rh);
+        failures++;
+    }
+    float temp_term = HUMIDITY_TEMP_KNOWN * 0.00216f * r.rh / (1.0546f - 0.00216f * 25);
+    if( fabsf(r.confidence - sqrtf(HUMIDITY_ACCURACY * HUMIDITY_ACCURACY + temp_term * temp_term)) > 0.01f ) {
+        printf("FAIL | steady burst confidence %.3f\n", r.confidence);
+        failures++;
+    }
+    float steady = r.confidence;
+
+    //  the next reading moves the smoothed value a quarter of the way
+    float previous = r.rh;
+    burst = (humidity_burst_t){ 0 };
+    for(uint32_t i = 0; i < 64; i++ )
+        humidity_burst_add(&burst, (uint16_t)(mid + 40));
+    humidity_stage_push(&stage, &burst, 250, 1, &r);
+    float expected = previous + 0.25f * (reference_rh(mid + 40, 25) - previous);
+    if( fabsf(r.rh - expected) > 0.05f ) {
+        printf("FAIL | smoothed to %.2f, expected %.2f\n", r.rh, expected);
+        failures++;
+    }
+
+    //  without a temperature the uncertainty widens; noise widens it too
+    humidity_stage_t cold;
+    humidity_stage_init(&cold, HUMIDITY_SUPPLY_MV, HUMIDITY_REFERENCE_MV, 1.0f);
+    burst = (humidity_burst_t){ 0 };
+    for(uint32_t i = 0; i < 64; i++ )
+        humidity_burst_add(&burst, mid);
+    humidity_record_t unknown, noisy;
+    humidity_stage_push(&cold, &burst, 250, 0, &unknown);
+    burst = (humidity_burst_t){ 0 };
+    for(uint32_t i = 0; i < 64; i++ )
+        humidity_burst_add(&burst, (uint16_t)(mid + (i & 1 ? 30 : -30)));
+    humidity_stage_push(&cold, &burst, 250, 1, &noisy);
+    if( unknown.confidence < steady + 0.5f || unknown.temperature_known ) {
+        printf("FAIL | no temperature, confidence %.2f\n", unknown.confidence);
+        failures++;
+    }
+    //  30 counts of spread over 64 conversions: sigma of the mean 3.75 counts
+    float sigma = 30.0f / 8 * stage.count_rh;
+    if( fabsf(noisy.confidence * noisy.confidence - steady * steady - sigma * sigma) > 0.1f ) {
+        printf("FAIL | noisy burst confidence %.3f\n", noisy.confidence);
+        failures++;
+    }
+
+    //  full scale is only a lower bound; bad conversions are counted, not averaged
+    burst = (humidity_burst_t){ 0 };
+    humidity_burst_add(&burst, HUMIDITY_FULL_SCALE);
+    humidity_burst_add(&burst, HUMIDITY_FULL_SCALE);
+    humidity_burst_add(&burst, 0xffff);
+    humidity_stage_push(&cold, &burst, 250, 1, &r);
+    if( !r.saturated || r.samples != 2 || r.errors != 1 || r.confidence < 100.0f - r.rh ) {
+        printf("FAIL | saturated burst %.2f +/- %.2f\n", r.rh, r.confidence);
+        failures++;
+    }
+    burst = (humidity_burst_t){ 0 };
+    humidity_burst_add(&burst, 0xffff);
+    if( humidity_stage_push(&cold, &burst, 250, 1, &r) ) {
+        printf("FAIL | a burst without good conversions was published\n");
+        failures++;
+    }
+
+    //  cost of the stage itself, per conversion, at the default burst
+    const uint32_t bursts = 100000;
+    struct timespec a, b;
+    clock_gettime(CLOCK_MONOTONIC, &a);
+    float sink = 0;
+    for(uint32_t k = 0; k < bursts; k++ ) {
+        burst = (humidity_burst_t){ 0 };
+        for(uint32_t i = 0; i < 64; i++ )
+            humidity_burst_add(&burst, (uint16_t)((k + i) & 1023));
+        if( humidity_stage_push(&stage, &burst, 250, 1, &r) )
+            sink += r.rh;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    double ns = (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+    printf("64 conversion bursts: %.1f ns per conversion (%g)\n", ns / bursts / 64, sink);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    if( test )
+        return self_test();
+    if( watch )
+        return watch_records();
+
+    i2c_fd = open(HUMIDITY_I2C_DEVICE, O_RDWR);
+    if( i2c_fd < 0 )
+        pabort(HUMIDITY_I2C_DEVICE);
+
+    humidity_ring_t *ring = humidity_ring_create();
+    if( ring == NULL )
+        pabort("unable to create shared memory ring");
+    run(ring);
+    close(i2c_fd);
+    return 0;
+}
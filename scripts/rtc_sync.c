@@ -0,0 +1,184 @@
+/*
+ *  rtc_sync.c
+ *
+ *  Sets the system clock from the DS1307 at boot, so the flight software
+ *  starts with real UTC timestamps long before the GPS has a fix, and
+ *  writes the system clock back to the DS1307 once it has been set from
+ *  the GPS.  Run it as root from rc.local ahead of helium.py:
+ *      rtc_sync -s
+ *  --test checks the register decoding without hardware.
+ *
+ *  To compile:
+ *  gcc rtc_sync.c ds1307.c -o rtc_sync -std=gnu99
+ *
+ *  Examples:
+ *  rtc_sync -r         print the RTC time
+ *  rtc_sync -s         set the system clock from the RTC
+ *  rtc_sync -w         set the RTC from the system clock
+ */
+
+#include "ds1307.h"
+#include <stdint.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { RTC_SYNC_READ, RTC_SYNC_SET_SYSTEM, RTC_SYNC_WRITE_RTC };
+
+static uint8_t action = RTC_SYNC_READ;
+static uint8_t test = 0;
+
+static void pabort(const char *s)
+{
+	perror(s);
+	abort();
+}
+
+static void print_usage(const char *prog)
+{
+    printf("Usage: %s [-rswt]\n", prog);
+    puts(   "-r --read\tprint the RTC time (default)\n"
+            "-s --system\tset the system clock from the RTC\n"
+            "-w --write\tset the RTC from the system clock\n"
+            "-t --test\tcheck the register decoding\n");
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "read",       no_argument,        NULL,   'r'},
+            { "system",     no_argument,        NULL,   's'},
+            { "write",      no_argument,        NULL,   'w'},
+            { "test",       no_argument,        NULL,   't'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "rswt", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'r':
+                action = RTC_SYNC_READ;
+                break;
+            case 's':
+                action = RTC_SYNC_SET_SYSTEM;
+                break;
+            case 'w':
+                action = RTC_SYNC_WRITE_RTC;
+                break;
+            case 't':
+                test = 1;
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static const char *rtc_error(int ret)
+{
+    switch( ret )
+    {
+        case DS1307_EIO:        return "DS1307 not responding";
+        case DS1307_EHALTED:    return "DS1307 oscillator was halted, time lost";
+        case DS1307_ERANGE:     return "DS1307 holds an invalid date";
+        default:                return "unknown error";
+    }
+}
+
+static int self_test(void)
+{
+    int failures = 0;
+    struct tm tm;
+    char text[32];
+
+    //  Thursday 2013-07-04 23:59:58, 24 hour format
+    static const uint8_t h24[7] = { 0x58, 0x59, 0x23, 0x05, 0x04, 0x07, 0x13 };
+    if( ds1307_decode(h24, &tm) != 0 || timegm(&tm) != 1372982398 || tm.tm_wday != 4 ) {
+        printf("FAIL | 24 hour decode\n");
+        failures++;
+    }
+    //  the same time in 12 hour format: 11 PM
+    static const uint8_t h12[7] = { 0x58, 0x59, 0x40 | 0x20 | 0x11, 0x05, 0x04, 0x07, 0x13 };
+    if( ds1307_decode(h12, &tm) != 0 || tm.tm_hour != 23 ) {
+        printf("FAIL | 12 hour PM decode\n");
+        failures++;
+    }
+    //  12 AM is midnight
+    static const uint8_t midnight[7] = { 0x00, 0x00, 0x40 | 0x12, 0x01, 0x01, 0x01, 0x14 };
+    if( ds1307_decode(midnight, &tm) != 0 || tm.tm_hour != 0 ) {
+        printf("FAIL | 12 AM decode\n");
+        failures++;
+    }
+    static const uint8_t halted[7] = { 0x80, 0x00, 0x00, 0x01, 0x01, 0x01, 0x00 };
+    static const uint8_t april31[7] = { 0x00, 0x00, 0x00, 0x01, 0x31, 0x04, 0x13 };
+    static const uint8_t blank[7] = { 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    if( ds1307_decode(halted, &tm) != DS1307_EHALTED || ds1307_decode(april31, &tm) != DS1307_ERANGE ||
+            ds1307_decode(blank, &tm) != DS1307_ERANGE ) {
+        printf("FAIL | invalid registers accepted\n");
+        failures++;
+    }
+    //  encode and decode round trip
+    uint8_t regs[7];
+    time_t t = 1700000000;
+    struct tm in;
+    gmtime_r(&t, &in);
+    ds1307_encode(&in, regs);
+    if( ds1307_decode(regs, &tm) != 0 || timegm(&tm) != t || regs[3] != in.tm_wday + 1 ) {
+        strftime(text, sizeof(text), "%F %T", &tm);
+        printf("FAIL | round trip gave %s\n", text);
+        failures++;
+    }
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    if( test )
+        return self_test();
+
+    int fd = ds1307_open();
+    if( fd < 0 )
+        pabort(DS1307_I2C_DEVICE);
+
+    struct tm tm;
+    char text[32];
+    int ret = 0;
+    if( action == RTC_SYNC_WRITE_RTC ) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        //  the DS1307 has no sub-second setting; round to the nearest second
+        time_t t = now.tv_sec + (now.tv_nsec >= 500000000L);
+        gmtime_r(&t, &tm);
+        if( tm.tm_year < 100 || tm.tm_year > 199 ) {
+            printf("ERROR | system clock is outside 2000-2099, not written\n");
+            ret = 1;
+        } else if( ds1307_write(fd, &tm) < 0 ) {
+            printf("ERROR | %s\n", rtc_error(DS1307_EIO));
+            ret = 1;
+        }
+    } else if( (ret = ds1307_read(fd, &tm)) < 0 ) {
+        printf("ERROR | %s\n", rtc_error(ret));
+        ret = 1;
+    } else if( action == RTC_SYNC_SET_SYSTEM ) {
+        struct timespec now, set = { timegm(&tm), 0 };
+        clock_gettime(CLOCK_REALTIME, &now);
+        if( clock_settime(CLOCK_REALTIME, &set) < 0 )
+            pabort("clock_settime");
+        printf("INFO | system clock stepped by %+ld s\n", (long)(set.tv_sec - now.tv_sec));
+    }
+    if( ret == 0 ) {
+        strftime(text, sizeof(text), "%F %T", &tm);
+        printf("%s UTC\n", text);
+    }
+    close(fd);
+    return ret;
+}
@@ -0,0 +1,181 @@
+/*
+ *  srb_channels.c
+ *
+ *  SRB-MX146LV memory channel plan, see srb_channels.h
+ */
+
+#include "srb_channels.h"
+#include <stdio.h>
+#include <string.h>
+
+void srb_channels_init(srb_channel_plan_t *plan)
+{
+    memset(plan, 0, sizeof(*plan));
+}
+
+/*
+ *  Read the mirror: one "channel frequency" pair per line.
+ *  A missing or malformed file leaves every channel unknown.  Returns
+ *  the number of channels loaded, or -1 for a malformed file.
+ */
+int srb_channels_load(srb_channel_plan_t *plan, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if( f == NULL )
+        return 0;
+    unsigned channel;
+    uint32_t hz;
+    int n = 0, ret;
+    while( (ret = fscanf(f, "%u %u", &channel, &hz)) == 2 ) {
+        if( channel >= SRB_RADIO_MEMORY_CHANNELS ) {
+            n = -1;
+            break;
+        }
+        plan->hz[channel] = hz;
+        n++;
+    }
+    if( ret != EOF ) {
+        memset(plan->hz, 0, sizeof(plan->hz));
+        n = -1;
+    }
+    fclose(f);
+    return n;
+}
+
+//  the active frequency is not saved: the radio may have been power cycled since
+int srb_channels_save(const srb_channel_plan_t *plan, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    if( f == NULL )
+        return -1;
+    for(uint8_t i = 0; i < SRB_RADIO_MEMORY_CHANNELS; i++ ) {
+        if( plan->hz[i] != SRB_CHANNEL_UNKNOWN )
+            fprintf(f, "%u %u\n", i, plan->hz[i]);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+//  channel holding hz, or -1
+int srb_channels_find(const srb_channel_plan_t *plan, uint32_t hz)
+{
+    if( hz == SRB_CHANNEL_UNKNOWN )
+        return -1;
+    for(uint8_t i = 0; i < SRB_RADIO_MEMORY_CHANNELS; i++ ) {
+        if( plan->hz[i] == hz )
+            return i;
+    }
+    return -1;
+}
+
+/*
+ *  Make channel hold hz, writing only if the mirror says otherwise.
+ *  Leaves hz active when a write was needed.  Returns 1 if the channel
+ *  was written, 0 if it already held hz, or an srb_radio_command error.
+ */
+int srb_channels_store(srb_channel_plan_t *plan, uint8_t channel, uint32_t hz)
+{
+    if( channel >= SRB_RADIO_MEMORY_CHANNELS || hz == SRB_CHANNEL_UNKNOWN )
+        return SRB_DECODE_COMMAND;
+    if( plan->hz[channel] == hz ) {
+        plan->skipped++;
+        return 0;
+    }
+
+    int ret;
+    if( plan->active_hz != hz ) {
+        plan->active_hz = SRB_CHANNEL_UNKNOWN;
+        if( (ret = srb_radio_set_frequency(hz)) != SRB_DECODE_OK )
+            return ret;
+        plan->active_hz = hz;
+    }
+    plan->hz[channel] = SRB_CHANNEL_UNKNOWN;
+    if( (ret = srb_radio_memory_operation(channel, 'm')) != SRB_DECODE_OK )
+        return ret;
+    plan->hz[channel] = hz;
+    plan->stores++;
+    return 1;
+}
+
+//  'm' as issued directly: the channel takes whatever is active
+int srb_channels_store_active(srb_channel_plan_t *plan, uint8_t channel)
+{
+    if( channel >= SRB_RADIO_MEMORY_CHANNELS )
+        return SRB_DECODE_COMMAND;
+    plan->hz[channel] = SRB_CHANNEL_UNKNOWN;
+    int ret = srb_radio_memory_operation(channel, 'm');
+    if( ret == SRB_DECODE_OK )
+        plan->hz[channel] = plan->active_hz;
+    return ret;
+}
+
+/*
+ *  Bring the radio's memories in line with hz[] (SRB_RADIO_MEMORY_CHANNELS
+ *  entries, SRB_CHANNEL_UNKNOWN leaves a channel alone).  Only channels
+ *  that differ are written.  A channel holding the frequency that was
+ *  active beforehand is written last, so usually nothing has to be
+ *  retuned afterwards.  Returns the number of channels written, or an
+ *  srb_radio_command error.
+ */
+int srb_channels_apply(srb_channel_plan_t *plan, const uint32_t *hz)
+{
+    uint32_t previous = plan->active_hz;
+    int last = -1, written = 0, ret;
+
+    for(uint8_t i = 0; i < SRB_RADIO_MEMORY_CHANNELS; i++ ) {
+        if( hz[i] == SRB_CHANNEL_UNKNOWN )
+            continue;
+        if( hz[i] == previous && plan->hz[i] != hz[i] && last < 0 ) {
+            last = i;
+            continue;
+        }
+        if( (ret = srb_channels_store(plan, i, hz[i])) < 0 )
+            return ret;
+        written += ret;
+    }
+    if( last >= 0 ) {
+        if( (ret = srb_channels_store(plan, last, hz[last])) < 0 )
+            return ret;
+        written += ret;
+    }
+    if( previous != SRB_CHANNEL_UNKNOWN && plan->active_hz != previous ) {
+        if( (ret = srb_channels_tune(plan, previous)) < 0 )
+            return ret;
+    }
+    return written;
+}
+
+int srb_channels_recall(srb_channel_plan_t *plan, uint8_t channel)
+{
+    if( channel >= SRB_RADIO_MEMORY_CHANNELS )
+        return SRB_DECODE_COMMAND;
+    plan->active_hz = SRB_CHANNEL_UNKNOWN;
+    int ret = srb_radio_memory_operation(channel, 'M');
+    if( ret == SRB_DECODE_OK ) {
+        plan->active_hz = plan->hz[channel];
+        plan->recalls++;
+    }
+    return ret;
+}
+
+/*
+ *  Retune with the least traffic: nothing if hz is already active, a
+ *  2 byte recall if a channel holds it, otherwise a 5 byte 'B'.
+ */
+int srb_channels_tune(srb_channel_plan_t *plan, uint32_t hz)
+{
+    if( hz != SRB_CHANNEL_UNKNOWN && plan->active_hz == hz ) {
+        plan->skipped++;
+        return SRB_DECODE_OK;
+    }
+    int channel = srb_channels_find(plan, hz);
+    if( channel >= 0 )
+        return srb_channels_recall(plan, channel);
+
+    plan->active_hz = SRB_CHANNEL_UNKNOWN;
+    int ret = srb_radio_set_frequency(hz);
+    if( ret == SRB_DECODE_OK ) {
+        plan->active_hz = hz;
+        plan->sets++;
+    }
+    return ret;
+}
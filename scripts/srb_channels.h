@@ -0,0 +1,44 @@
+/*
+ *  srb_channels.h
+ *
+ *  Channel plan manager for the SRB-MX146LV's 16 memory channels.
+ *
+ *  The radio can't report what its memories hold, so we keep a mirror
+ *  of them (saved to SRB_CHANNELS_PATH) and only write a channel when
+ *  the plan asks for a different frequency.  Writing a channel costs a
+ *  5 byte 'B' set plus a 2 byte 'm' store; once it is there, retuning
+ *  to that frequency is a single 2 byte 'M' recall.
+ *
+ *  Delete the mirror file if the radio's memories were changed by
+ *  something else; the next plan will then rewrite every channel.
+ */
+
+#ifndef SRB_CHANNELS_H
+#define SRB_CHANNELS_H
+
+#include "srb_radio.h"
+#include <stdint.h>
+
+#define SRB_CHANNELS_PATH       "/var/www/webpy/data/radio_channels"
+#define SRB_CHANNEL_UNKNOWN     0       //  mirror entry / active frequency not known
+
+typedef struct {
+    uint32_t hz[SRB_RADIO_MEMORY_CHANNELS];     //  what each memory holds
+    uint32_t active_hz;                         //  only trusted within one process
+    uint32_t stores;                            //  B + m pairs written
+    uint32_t recalls;                           //  retunes done with M
+    uint32_t sets;                              //  retunes that needed B
+    uint32_t skipped;                           //  writes/retunes that were already in place
+} srb_channel_plan_t;
+
+void srb_channels_init(srb_channel_plan_t *plan);
+int srb_channels_load(srb_channel_plan_t *plan, const char *path);
+int srb_channels_save(const srb_channel_plan_t *plan, const char *path);
+int srb_channels_find(const srb_channel_plan_t *plan, uint32_t hz);
+int srb_channels_store(srb_channel_plan_t *plan, uint8_t channel, uint32_t hz);
+int srb_channels_store_active(srb_channel_plan_t *plan, uint8_t channel);
+int srb_channels_apply(srb_channel_plan_t *plan, const uint32_t *hz);
+int srb_channels_recall(srb_channel_plan_t *plan, uint8_t channel);
+int srb_channels_tune(srb_channel_plan_t *plan, uint32_t hz);
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ *  srb_codec.c
+ *
+ *  SRB-MX146LV command encoder and response decoder
+ */
+
+#include "srb_codec.h"
+#include <string.h>
+
+const srb_frame_t srb_frames[SRB_CMD_COUNT] = {
+    [SRB_CMD_SET_FREQUENCY]         = { {'B', 0 }, 1, 4, 5,                SRB_PAYLOAD_NONE,            0, SRB_PAYLOAD_MAX },
+    [SRB_CMD_MEMORY_RECALL]         = { {'M', 0 }, 1, 1, 2,                SRB_PAYLOAD_NONE,            0, SRB_PAYLOAD_MAX },
+    [SRB_CMD_MEMORY_STORE]          = { {'m', 0 }, 1, 1, 2,                SRB_PAYLOAD_NONE,            0, SRB_PAYLOAD_MAX },
+    [SRB_CMD_QUERY_NAME]            = { {'Q','N'}, 2, 0, SRB_FRAME_LENGTH, SRB_PAYLOAD_TEXT,            0, SRB_PAYLOAD_MAX },
+    [SRB_CMD_QUERY_DATE]            = { {'Q','D'}, 2, 0, SRB_FRAME_LENGTH, SRB_PAYLOAD_TEXT,            0, SRB_PAYLOAD_MAX },
+    [SRB_CMD_QUERY_VERSION]         = { {'Q','V'}, 2, 0, SRB_FRAME_LENGTH, SRB_PAYLOAD_TEXT,            0, SRB_PAYLOAD_MAX },
+    [SRB_CMD_QUERY_SERIAL]          = { {'Q','#'}, 2, 0, SRB_FRAME_LENGTH, SRB_PAYLOAD_TEXT,            0, SRB_PAYLOAD_MAX },
+    [SRB_CMD_QUERY_TEMPERATURE]     = { {'Q','T'}, 2, 0, SRB_FRAME_LENGTH, SRB_PAYLOAD_INT8,            1, 1 },
+    [SRB_CMD_QUERY_FREQUENCY_RANGE] = { {'Q','F'}, 2, 0, SRB_FRAME_LENGTH, SRB_PAYLOAD_FREQUENCY_RANGE, 12, 12 },
+};
+
+//  the layouts above must fit the fixed frame
+_Static_assert(SRB_HEADER_LENGTH + 12 <= SRB_FRAME_LENGTH, "QF payload does not fit a frame");
+_Static_assert(1 + 4 <= SRB_FRAME_LENGTH, "B command does not fit a frame");
+_Static_assert(sizeof(((srb_response_t *)0)->value.text) == SRB_PAYLOAD_MAX + 1, "text payload size");
+
+static uint32_t srb_read_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ *  Encode cmd into frame, padding queries with '?'
+ *  The argument is the frequency in Hz for B and the channel for M/m.
+ *  Returns the number of bytes to send, or -1.
+ */
+int srb_encode(srb_command_t cmd, uint32_t argument, uint8_t *frame, size_t size)
+{
+    if( (unsigned)cmd >= SRB_CMD_COUNT )
+        return -1;
+    const srb_frame_t *f = &srb_frames[cmd];
+    if( size < f->frame_length )
+        return -1;
+    if( f->argument_length == 1 && argument > 15 )
+        return -1;
+
+    memset(frame, SRB_PADDING, f->frame_length);
+    memcpy(frame, f->opcode, f->opcode_length);
+    for(uint8_t i = 0; i < f->argument_length; i++ )
+        frame[f->opcode_length + i] = (uint8_t)(argument >> (8 * i));
+    return f->frame_length;
+}
+
+//  the idle bus reads back as 0xFF, and a radio that isn't ready echoes '?'
+static inline uint8_t srb_header_idle(const uint8_t *header)
+{
+    return header[0] == 0xFF || header[0] == SRB_PADDING;
+}
+
+//  a MISO line held low reads 0x00 0x00, which only a command's ack may look like
+static inline uint8_t srb_header_empty(const srb_frame_t *f, const uint8_t *header)
+{
+    return header[0] == 0 && header[1] == 0 && f->payload != SRB_PAYLOAD_NONE;
+}
+
+/*
+ *  Whether header is the start of cmd's response: an error code, or a
+ *  payload length that fits cmd's layout.
+ */
+uint8_t srb_header_ready(srb_command_t cmd, const uint8_t *header)
+{
+    if( (unsigned)cmd >= SRB_CMD_COUNT || srb_header_idle(header) )
+        return 0;
+    const srb_frame_t *f = &srb_frames[cmd];
+    if( header[0] != 0 )
+        return header[1] <= SRB_PAYLOAD_MAX;
+    if( srb_header_empty(f, header) )
+        return 0;
+    return header[1] >= f->payload_min && header[1] <= f->payload_max;
+}
+
+int srb_decode(srb_command_t cmd, const uint8_t *frame, size_t size, srb_response_t *response)
+{
+    if( (unsigned)cmd >= SRB_CMD_COUNT )
+        return SRB_DECODE_COMMAND;
+    const srb_frame_t *f = &srb_frames[cmd];
+    if( size < SRB_HEADER_LENGTH )
+        return SRB_DECODE_SHORT;
+    if( srb_header_idle(frame) || srb_header_empty(f, frame) || frame[1] > SRB_PAYLOAD_MAX )
+        return SRB_DECODE_NOT_READY;
+
+    response->command = cmd;
+    response->error = frame[0];
+    response->length = frame[1];
+    if( response->length < f->payload_min || response->length > f->payload_max )
+        return SRB_DECODE_LENGTH;
+    if( size < (size_t)SRB_HEADER_LENGTH + response->length )
+        return SRB_DECODE_SHORT;
+    if( response->error != 0 )
+        return SRB_DECODE_RADIO_ERROR;
+
+    const uint8_t *payload = frame + SRB_HEADER_LENGTH;
+    switch( f->payload ) {
+        case SRB_PAYLOAD_NONE:
+            break;
+        case SRB_PAYLOAD_TEXT:
+            for(uint8_t i = 0; i < response->length; i++ ) {
+                if( payload[i] < 0x20 || payload[i] > 0x7E )
+                    return SRB_DECODE_VALUE;
+            }
+            memcpy(response->value.text, payload, response->length);
+            response->value.text[response->length] = '\0';
+            break;
+        case SRB_PAYLOAD_INT8:
+            response->value.temperature = (int8_t)payload[0];
+            break;
+        case SRB_PAYLOAD_FREQUENCY_RANGE:
+            response->value.range.min_hz = srb_read_le32(payload);
+            response->value.range.max_hz = srb_read_le32(payload + 4);
+            response->value.range.step_hz = srb_read_le32(payload + 8);
+            if( response->value.range.min_hz > response->value.range.max_hz ||
+                    response->value.range.step_hz == 0 )
+                return SRB_DECODE_VALUE;
+            break;
+    }
+    return SRB_DECODE_OK;
+}
+
+//  map the opcode at the start of a frame back to its command, or -1
+int srb_command_for_opcode(const uint8_t *opcode)
+{
+    for(uint8_t i = 0; i < SRB_CMD_COUNT; i++ ) {
+        const srb_frame_t *f = &srb_frames[i];
+        if( opcode[0] == (uint8_t)f->opcode[0] && (f->opcode_length == 1 || opcode[1] == (uint8_t)f->opcode[1]) )
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,84 @@
+/*
+ *  srb_codec.h
+ *
+ *  Frame layouts for every SRB-MX146LV command and response, with an
+ *  encoder that writes into caller (stack) storage and a decoder that
+ *  validates a response frame into a typed struct.
+ *
+ *  The codec does no I/O and allocates nothing, so it can be fuzzed and
+ *  benchmarked on any machine (see srb_codec_test.c).
+ */
+
+#ifndef SRB_CODEC_H
+#define SRB_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SRB_FRAME_LENGTH        22      //  query and response frames on the wire
+#define SRB_HEADER_LENGTH       2       //  error code + payload length
+#define SRB_PAYLOAD_MAX         (SRB_FRAME_LENGTH - SRB_HEADER_LENGTH)
+#define SRB_PADDING             0x3F    //  '?'
+
+typedef enum {
+    SRB_CMD_SET_FREQUENCY,          //  'B' + uint32 Hz
+    SRB_CMD_MEMORY_RECALL,          //  'M' + channel
+    SRB_CMD_MEMORY_STORE,           //  'm' + channel
+    SRB_CMD_QUERY_NAME,             //  'QN'
+    SRB_CMD_QUERY_DATE,             //  'QD'
+    SRB_CMD_QUERY_VERSION,          //  'QV'
+    SRB_CMD_QUERY_SERIAL,           //  'Q#'
+    SRB_CMD_QUERY_TEMPERATURE,      //  'QT'
+    SRB_CMD_QUERY_FREQUENCY_RANGE,  //  'QF'
+    SRB_CMD_COUNT
+} srb_command_t;
+
+typedef enum {
+    SRB_PAYLOAD_NONE,               //  command, nothing to decode
+    SRB_PAYLOAD_TEXT,               //  ASCII
+    SRB_PAYLOAD_INT8,               //  signed byte
+    SRB_PAYLOAD_FREQUENCY_RANGE     //  Fmin, Fmax, Fstep as little endian uint32
+} srb_payload_t;
+
+typedef struct {
+    char opcode[2];
+    uint8_t opcode_length;
+    uint8_t argument_length;        //  bytes following the opcode
+    uint8_t frame_length;           //  bytes on the wire; queries are padded
+    srb_payload_t payload;
+    uint8_t payload_min;            //  allowed payload length range
+    uint8_t payload_max;
+} srb_frame_t;
+
+extern const srb_frame_t srb_frames[SRB_CMD_COUNT];
+
+typedef struct {
+    srb_command_t command;
+    uint8_t error;                  //  error code from the radio
+    uint8_t length;                 //  payload length
+    union {
+        char text[SRB_PAYLOAD_MAX + 1];     //  NUL terminated
+        int8_t temperature;                 //  degrees C
+        struct {
+            uint32_t min_hz;
+            uint32_t max_hz;
+            uint32_t step_hz;
+        } range;
+    } value;
+} srb_response_t;
+
+//  decoder results
+#define SRB_DECODE_OK           0
+#define SRB_DECODE_SHORT        -1      //  fewer bytes than a header or the stated payload
+#define SRB_DECODE_NOT_READY    -2      //  idle bus, padding or 0x00 0x00 where the header should be
+#define SRB_DECODE_LENGTH       -3      //  payload length outside the command's layout
+#define SRB_DECODE_RADIO_ERROR  -4      //  radio reported a non-zero error code
+#define SRB_DECODE_VALUE        -5      //  payload fails a sanity check
+#define SRB_DECODE_COMMAND      -6      //  unknown command
+
+int srb_encode(srb_command_t cmd, uint32_t argument, uint8_t *frame, size_t size);
+int srb_decode(srb_command_t cmd, const uint8_t *frame, size_t size, srb_response_t *response);
+uint8_t srb_header_ready(srb_command_t cmd, const uint8_t *header);
+int srb_command_for_opcode(const uint8_t *opcode);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ *  srb_codec_test.c
+ *
+ *  Exercises the SRB-MX146LV codec without the radio.  By default it
+ *  checks encoded frames and decoded responses against known-good
+ *  vectors.  --fuzz feeds random and mutated frames to the decoder
+ *  to check that it never accepts an inconsistent response, and
+ *  --bench measures encode + decode throughput.
+ *
+ *  To compile:
+ *  gcc srb_codec_test.c srb_codec.c -o srb_codec_test -std=gnu99 -O2
+ *
+ */
+
+#include "srb_codec.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint32_t fuzz_iterations = 0;
+static uint32_t bench_iterations = 0;
+static int failures = 0;
+
+static void print_usage(const char *prog)
+{
+    printf("Tests the SRB-MX146LV command codec\n");
+    printf("Usage: %s [-fb]\n", prog);
+    puts(   "-f --fuzz\tdecode this many random/mutated frames\n"
+            "-b --bench\ttime this many encode+decode round trips\n"
+         );
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "fuzz",   required_argument,  NULL,   'f'},
+            { "bench",  required_argument,  NULL,   'b'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "f:b:", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'f':
+                fuzz_iterations = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                bench_iterations = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static void check(int ok, const char *what)
+{
+    if( !ok ) {
+        printf("FAIL | %s\n", what);
+        failures++;
+    }
+}
+
+static void test_vectors(void)
+{
+    uint8_t frame[SRB_FRAME_LENGTH];
+    srb_response_t r;
+
+    //  'B' + 144390000 little endian
+    static const uint8_t set_aprs[] = { 'B', 0x70, 0x37, 0x9B, 0x08 };
+    check(srb_encode(SRB_CMD_SET_FREQUENCY, 144390000UL, frame, sizeof(frame)) == 5 &&
+          memcmp(frame, set_aprs, sizeof(set_aprs)) == 0, "encode B 144.390 MHz");
+
+    static const uint8_t recall_3[] = { 'M', 3 };
+    check(srb_encode(SRB_CMD_MEMORY_RECALL, 3, frame, sizeof(frame)) == 2 &&
+          memcmp(frame, recall_3, sizeof(recall_3)) == 0, "encode M 3");
+    check(srb_encode(SRB_CMD_MEMORY_STORE, 16, frame, sizeof(frame)) < 0, "reject m 16");
+
+    check(srb_encode(SRB_CMD_QUERY_NAME, 0, frame, sizeof(frame)) == SRB_FRAME_LENGTH &&
+          frame[0] == 'Q' && frame[1] == 'N' && frame[2] == '?' && frame[21] == '?', "encode QN padding");
+    check(srb_encode(SRB_CMD_QUERY_NAME, 0, frame, 4) < 0, "reject short encode buffer");
+
+    static const uint8_t name[SRB_FRAME_LENGTH] = { 0, 9, 'S','R','B','M','X','1','4','6','L' };
+    check(srb_decode(SRB_CMD_QUERY_NAME, name, sizeof(name), &r) == SRB_DECODE_OK &&
+          strcmp(r.value.text, "SRBMX146L") == 0, "decode QN");
+
+    static const uint8_t temp[SRB_FRAME_LENGTH] = { 0, 1, 0xF6 };
+    check(srb_decode(SRB_CMD_QUERY_TEMPERATURE, temp, sizeof(temp), &r) == SRB_DECODE_OK &&
+          r.value.temperature == -10, "decode QT -10 C");
+
+    static const uint8_t range[SRB_FRAME_LENGTH] = { 0, 12,
+        0x00, 0x44, 0x95, 0x08,     //  144000000
+        0x80, 0xC8, 0xB3, 0x08,     //  146000000
+        0x88, 0x13, 0x00, 0x00 };   //  5000
+    check(srb_decode(SRB_CMD_QUERY_FREQUENCY_RANGE, range, sizeof(range), &r) == SRB_DECODE_OK &&
+          r.value.range.min_hz == 144000000 && r.value.range.max_hz == 146000000 &&
+          r.value.range.step_hz == 5000, "decode QF");
+
+    static const uint8_t idle[SRB_FRAME_LENGTH] = { 0xFF, 0xFF };
+    check(srb_decode(SRB_CMD_QUERY_NAME, idle, sizeof(idle), &r) == SRB_DECODE_NOT_READY, "idle bus is not ready");
+    static const uint8_t error[SRB_FRAME_LENGTH] = { 2, 0 };
+    check(srb_decode(SRB_CMD_QUERY_VERSION, error, sizeof(error), &r) == SRB_DECODE_RADIO_ERROR, "radio error code");
+    static const uint8_t bad_length[SRB_FRAME_LENGTH] = { 0, 2, 0x10, 0x20 };
+    check(srb_decode(SRB_CMD_QUERY_TEMPERATURE, bad_length, sizeof(bad_length), &r) == SRB_DECODE_LENGTH, "QT length");
+    check(srb_decode(SRB_CMD_QUERY_NAME, name, 6, &r) == SRB_DECODE_SHORT, "truncated frame");
+
+    //  0x00 0x00 is a command's ack, but not the start of a query's response
+    static const uint8_t zero[SRB_FRAME_LENGTH] = { 0, 0 };
+    check(srb_decode(SRB_CMD_QUERY_NAME, zero, sizeof(zero), &r) == SRB_DECODE_NOT_READY, "zero header is not ready");
+    check(srb_header_ready(SRB_CMD_SET_FREQUENCY, zero) && !srb_header_ready(SRB_CMD_QUERY_NAME, zero) &&
+          !srb_header_ready(SRB_CMD_QUERY_TEMPERATURE, zero), "zero header only acks a command");
+    check(srb_header_ready(SRB_CMD_QUERY_TEMPERATURE, temp) && !srb_header_ready(SRB_CMD_QUERY_TEMPERATURE, bad_length) &&
+          !srb_header_ready(SRB_CMD_QUERY_FREQUENCY_RANGE, temp), "header length fits the command");
+    check(srb_header_ready(SRB_CMD_QUERY_VERSION, error) && !srb_header_ready(SRB_CMD_QUERY_NAME, idle),
+          "error header is ready, idle bus is not");
+}
+
+static void fuzz(uint32_t iterations)
+{
+    uint8_t frame[SRB_FRAME_LENGTH];
+    srb_response_t r;
+    uint32_t accepted = 0;
+    srand(1);
+    for(uint32_t i = 0; i < iterations; i++ ) {
+        srb_command_t cmd = (srb_command_t)(rand() % SRB_CMD_COUNT);
+        size_t size = rand() % (SRB_FRAME_LENGTH + 1);
+        for(size_t j = 0; j < sizeof(frame); j++ )
+            frame[j] = (uint8_t)rand();
+        //  bias toward plausible headers so the payload paths get exercised
+        if( rand() & 1 ) {
+            frame[0] = 0;
+            frame[1] = rand() % (SRB_PAYLOAD_MAX + 2);
+        }
+        memset(&r, 0xA5, sizeof(r));
+        if( srb_decode(cmd, frame, size, &r) != SRB_DECODE_OK )
+            continue;
+        accepted++;
+        const srb_frame_t *f = &srb_frames[cmd];
+        if( r.length < f->payload_min || r.length > f->payload_max ||
+                (size_t)SRB_HEADER_LENGTH + r.length > size || r.error != 0 ) {
+            printf("FAIL | fuzz accepted an inconsistent frame (cmd %d, length %u, size %zu)\n",
+                   cmd, r.length, size);
+            failures++;
+        }
+        if( f->payload == SRB_PAYLOAD_TEXT && strlen(r.value.text) != r.length ) {
+            printf("FAIL | fuzz text length mismatch\n");
+            failures++;
+        }
+    }
+    printf("fuzz: %u frames, %u accepted\n", iterations, accepted);
+}
+
+static void bench(uint32_t iterations)
+{
+    uint8_t frame[SRB_FRAME_LENGTH];
+    static const uint8_t range[SRB_FRAME_LENGTH] = { 0, 12,
+        0x00, 0x44, 0x95, 0x08, 0x80, 0xC8, 0xB3, 0x08, 0x88, 0x13, 0x00, 0x00 };
+    srb_response_t r;
+    volatile uint32_t sink = 0;
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(uint32_t i = 0; i < iterations; i++ ) {
+        sink += srb_encode(SRB_CMD_SET_FREQUENCY, 144390000UL + i, frame, sizeof(frame));
+        sink += srb_encode(SRB_CMD_QUERY_FREQUENCY_RANGE, 0, frame, sizeof(frame));
+        if( srb_decode(SRB_CMD_QUERY_FREQUENCY_RANGE, range, sizeof(range), &r) == SRB_DECODE_OK )
+            sink += r.value.range.step_hz;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("bench: %u round trips in %.3f s, %.1f ns each\n", iterations, s, s * 1e9 / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    parse_opts(argc, argv);
+    test_vectors();
+    if( fuzz_iterations )
+        fuzz(fuzz_iterations);
+    if( bench_iterations )
+        bench(bench_iterations);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
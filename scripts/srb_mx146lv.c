@@ -18,7 +18,7 @@
  *	input A (GPIO24) and lower input B (BPIO25)
  *
  *	To compile:
- *	gcc srb_mx146lv.c hab_spi.c -o srbmx145 -std=c99 -I/usr/include/glib-2.0 -I/usr/lib/arm-linux-gnueabihf/glib-2.0/include -lglib-2.0 -lbcm2835
+ *	gcc srb_mx146lv.c srb_radio.c srb_codec.c srb_channels.c hab_spi.c -o srbmx145 -std=c99 -I/usr/include/glib-2.0 -I/usr/lib/arm-linux-gnueabihf/glib-2.0/include -lglib-2.0 -lbcm2835
  *
 */
 
@@ -28,19 +28,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <getopt.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/types.h>
-#include <linux/spi/spidev.h>
 #include <bcm2835.h>
 #include <glib.h>
-#include "hab_spi.h"
+#include "srb_radio.h"
+#include "srb_channels.h"
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 #define BUF_SIZE(a) (sizeof(a) / sizeof(uint8_t))
 
-#define XFR_USE_BCM2835_LIB 1
-
 /*
  *  Function prototypes
  *
@@ -48,13 +43,12 @@
 
 static void pabort(const char *s);
 static void parse_opts(int argc, char *argv[]);
-static void radio_spi_command_write(uint8_t *wr_buf, uint8_t *rd_buf, size_t msglen);
-static uint8_t write_radio(uint8_t *data, uint8_t *rd_buf, uint8_t length);
-static void print_query_results(uint8_t *data);
-static void radio_perform_query(char *query);
-static void radio_spi_command_write(uint8_t *wr_buf, uint8_t *rd_buf, size_t msglen);
+static void radio_perform_query(srb_command_t cmd, srb_response_t *response);
+static void radio_print_text_query(srb_command_t cmd);
 static void radio_set_frequency(uint32_t f);
 static void radio_perform_memory_operation(uint8_t channel, char op);
+static void radio_apply_plan(const char *path);
+static void print_channels(void);
 
 static void pabort(const char *s)
 {
@@ -62,12 +56,10 @@ static void pabort(const char *s)
 	abort();
 }
 
-static const char *device = "/dev/spidev0.0";
-static uint8_t mode = 0;
-static uint8_t bits = 8;
-static uint32_t speed = 39062;//500000;
-static uint16_t delay;
-static const uint8_t MESSAGE_LENGTH = 22;
+static uint8_t print_latency = 0;
+
+//  mirror of the radio's memory channels, see srb_channels.h
+static srb_channel_plan_t plan;
 
 static void print_usage(const char *prog)
 {
@@ -76,192 +68,118 @@ static void print_usage(const char *prog)
             " -F --freq\t\tset freq as 32 bit binary in Hz (little endian)\n"
 			" -M --rmem\tread freq from memory loc\n"
 			" -m --wmem\twrite active freq to memory loc\n"
+			" -P --plan\tstore a channel plan file (lines of: channel freq)\n"
+			" -C --channels\tprint the known memory channel frequencies\n"
 			" -N --qname\tread device name\n"
 			" -D --qdate\tread datecode\n"
 			" -V --qvers\tread software version\n"
 			" -S --qser\tread serial number\n"
-			" -r --qfreq\tread minimum and maximum freqs"
+			" -r --qfreq\tread minimum and maximum freqs\n"
+			" -L --latency\tprint per-command latency when done"
 		);
 	exit(1);
 }
 
-/*	Writes data to the radio with array of length */
-static uint8_t write_radio(uint8_t *data, uint8_t *rd_buf, uint8_t length) {
-    uint8_t *wr_buf = malloc(MESSAGE_LENGTH * sizeof(uint8_t));
-    if( wr_buf == NULL )
-        pabort("unable to allocate memory for write buffer");
-        
-    //  pad our message with the required dummy character '?'
-    memcpy(memset(wr_buf,0x3F,MESSAGE_LENGTH),data,2);
-    
-	int ret = 0;
-    
-    #if XFR_USE_BCM2835_LIB
-        //  set the aux pins on the 74139 before dropping the RPi *CS
-        hab_spi_lower_cs();
-        
-        bcm2835_spi_begin();
-        bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);      // The default
-        bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   // The default
-        bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_4096);
-        bcm2835_spi_chipSelect(BCM2835_SPI_CS0);                      // The default
-        bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);      // the default
-        //  transfer
-        bcm2835_spi_transfernb(wr_buf,rd_buf,MESSAGE_LENGTH);
-        bcm2835_spi_end();
-        //  for unclear reasons we must execute the transfer twice
-        bcm2835_delay(20);
-        bcm2835_spi_begin();
-        bcm2835_spi_transfernb(wr_buf,rd_buf,MESSAGE_LENGTH);
-        bcm2835_spi_end();
-        
-        //  restore our aux pins
-        hab_spi_raise_cs();
-    #else
-        int fd = open(device, O_RDWR);
-        if( fd < 0 ) pabort("unable to open device");
-        //	set SPI mode
-        ret = ioctl(fd, SPI_IOC_WR_MODE, &mode);
-        if( ret == -1 ) pabort("unable to set SPI write mode");
-        ret = ioctl(fd, SPI_IOC_RD_MODE, &mode);
-        if( ret == -1) pabort("unable to set SPI read mode");
-        //	set SPI word size
-        ret = ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits);
-        if( ret == -1) pabort("unable to set SPI word length");
-        //	set SPI max speed
-        ret = ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed);
-        if (ret == -1) pabort("unable to set SPI max speed");
-        
-        struct spi_ioc_transfer tr = {
-            .tx_buf = (unsigned long)wr_buf,
-            .rx_buf = (unsigned long)rd_buf,
-            .len = MESSAGE_LENGTH,
-            .delay_usecs = delay,
-            .speed_hz = speed,
-            .bits_per_word = bits,
-        };
-    
-        ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
-        //	for some reason, the message must be sent twice
-        ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
-        close(fd);
-        free(wr_buf);
-        if (ret < 1) pabort("can't send spi message");
-    #endif
-    return ret;
-}
-
-static void print_query_results(uint8_t *data) {
-    uint8_t err_code = data[0];
-    uint8_t length = data[1];
-    char str[length+1];
-    memcpy(&str,&data[2],length);
-    str[length] = '\0';
-    printf("%s\n",str);
+/*  run a query and decode its response, aborting on any error */
+static void radio_perform_query(srb_command_t cmd, srb_response_t *response) {
+    int ret = srb_radio_command(cmd, 0, response);
+    if( ret == SRB_RADIO_ENORESPONSE )
+        pabort("no response from radio");
+    if( ret != SRB_DECODE_OK ) {
+        fprintf(stderr, "ERROR | invalid response from radio (%d, code 0x%.2X)\n", ret, response->error);
+        exit(1);
+    }
 }
 
-//  
-static void radio_perform_query(char *query) {
-    uint8_t data[2];
-    memcpy(&data,query,2);      //  all queries are 2 bytes in length
-    uint8_t *rx_buf = (uint8_t *)malloc(MESSAGE_LENGTH * sizeof(uint8_t));
-    if( rx_buf == NULL )
-        pabort("unable to allocate memory for read buffer");
-    write_radio(data,rx_buf,MESSAGE_LENGTH);
-    print_query_results(rx_buf);
-    
-    free(rx_buf);
+static void radio_print_text_query(srb_command_t cmd) {
+    srb_response_t response;
+    radio_perform_query(cmd, &response);
+    printf("%s\n",response.value.text);
 }
 
-//  write to radio without padding message with '?' as we do with queries
-static void radio_spi_command_write(uint8_t *wr_buf, uint8_t *rd_buf, size_t msglen)
-{
-    //  set the aux pins on the 74139 before dropping the RPi *CS
-    hab_spi_lower_cs();
-    
-    bcm2835_spi_begin();
-    bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
-    bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   
-    bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_4096);
-    bcm2835_spi_chipSelect(BCM2835_SPI_CS0);                      
-    bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);
-    //  transfer
-    bcm2835_spi_transfernb(wr_buf,rd_buf,MESSAGE_LENGTH);
-    bcm2835_spi_end();
-    //  for unclear reasons we must execute the transfer twice
-    bcm2835_delay(20);
-    bcm2835_spi_begin();
-    bcm2835_spi_transfernb(wr_buf,rd_buf,MESSAGE_LENGTH);
-    bcm2835_spi_end();
-    
-    //  restore our aux pins
-    hab_spi_raise_cs();
+/*  a failed write leaves its channel unknown; save that before giving up */
+static void radio_channels_abort(const char *s) {
+    srb_channels_save(&plan, SRB_CHANNELS_PATH);
+    pabort(s);
 }
 
-/*  set the frequency to the value specified by f */
+/*  set the frequency to the value specified by f, by recall if a channel holds it */
 static void radio_set_frequency(uint32_t f) {
-    unsigned char *p = (unsigned char *)&f;
-    uint8_t *wr_buf = (uint8_t *)malloc(5 * sizeof(uint8_t));
-    if( wr_buf == NULL )
-        pabort("unable to allocate memory for write buffer");
-    wr_buf[0] = 'B';
-    memcpy(&wr_buf[1],p,sizeof(f));
-    
-    uint8_t *rd_buf = (uint8_t *)malloc(5 * sizeof(uint8_t));
-    if( rd_buf == NULL )
-        pabort("unable to allocate memory for read buffer");
-    
-    radio_spi_command_write(wr_buf, rd_buf, 5);
-    
-    free(wr_buf);
-    free(rd_buf);
+    if( srb_channels_tune(&plan, f) != SRB_DECODE_OK )
+        pabort("ERROR | unable to set frequency");
 }
 
 static void radio_perform_memory_operation(uint8_t channel, char op) {
-    
-    if( channel > 15 )
+    int ret;
+    if( channel >= SRB_RADIO_MEMORY_CHANNELS )
         pabort("Channel out of range");
-    if( (op != 'M') && (op != 'm') )
-        pabort("ERROR | channel out of range");
-    unsigned char *p = (unsigned char *)&channel;
-    uint8_t *wr_buf = (uint8_t *)malloc(2 * sizeof(uint8_t));
-    if( wr_buf == NULL )
-        pabort("unable to allocate memory for write buffer");
-    wr_buf[0] = op;
-    memcpy(&wr_buf[1],p,sizeof(unsigned char));
-    
-    uint8_t *rd_buf = (uint8_t *)malloc(2 * sizeof(uint8_t));
-    if( rd_buf == NULL )
-        pabort("unable to allocate memory for read buffer");
-        
-    radio_spi_command_write(wr_buf,rd_buf,2);
-        
-    free(wr_buf);
-    free(rd_buf);
+    if( op == 'M' )
+        ret = srb_channels_recall(&plan, channel);
+    else
+        ret = srb_channels_store_active(&plan, channel);
+    if( ret != SRB_DECODE_OK )
+        radio_channels_abort("ERROR | invalid memory operation");
+}
+
+/*  write the channels of a plan file that the radio doesn't already hold */
+static void radio_apply_plan(const char *path) {
+    srb_channel_plan_t wanted;
+    srb_channels_init(&wanted);
+    if( srb_channels_load(&wanted, path) <= 0 ) {
+        fprintf(stderr, "ERROR | unable to read channel plan %s\n", path);
+        exit(1);
+    }
+    int written = srb_channels_apply(&plan, wanted.hz);
+    if( written < 0 )
+        radio_channels_abort("ERROR | unable to store channel plan");
+    printf("%d channels written, %u unchanged\n", written, plan.skipped);
+}
+
+static void print_channels(void)
+{
+    for(uint8_t i = 0; i < SRB_RADIO_MEMORY_CHANNELS; i++ ) {
+        if( plan.hz[i] != SRB_CHANNEL_UNKNOWN )
+            printf("%2u %u\n", i, plan.hz[i]);
+        else
+            printf("%2u unknown\n", i);
+    }
+}
+
+static void print_latency_results(void)
+{
+    static const char *commands[] = { "B", "M", "m", "QN", "QD", "QV", "Q#", "QT", "QF" };
+    for(uint8_t i = 0; i < ARRAY_SIZE(commands); i++ ) {
+        const srb_radio_latency_t *lat = srb_radio_latency(commands[i]);
+        if( lat == NULL || lat->count == 0 )
+            continue;
+        printf("%-2s n=%u last=%uus max=%uus mean=%lluus polls=%u timeouts=%u\n",
+               commands[i], lat->count, lat->last_us, lat->max_us,
+               (unsigned long long)(lat->total_us / lat->count), lat->polls, lat->timeouts);
+    }
 }
 
 static void parse_opts(int argc, char *argv[])
 {
-	int ret;
-	if(!bcm2835_init())
-		pabort("Unable to init BCM2835 lib");
 	while (1) {
 		static const struct option lopts[] = {
             { "aprs",       no_argument,        NULL, 'p'},
 			{ "freq32",		required_argument, 	NULL, 'F'},
 			{ "rmem",		required_argument, 	NULL, 'M'},
 			{ "wmem",		required_argument, 	NULL, 'm'},
+			{ "plan",		required_argument, 	NULL, 'P'},
+			{ "channels",	no_argument, 		NULL, 'C'},
 			{ "qname",		no_argument, 		NULL, 'N'},
 			{ "qdate",		no_argument, 		NULL, 'D'},
 			{ "qvers",		no_argument, 		NULL, 'V'},
 			{ "qser",		no_argument, 		NULL, 'S'},
             { "qtemp",      no_argument,        NULL, 'T'},
 			{ "qfreq",		no_argument, 		NULL, 'r'},
+			{ "latency",	no_argument, 		NULL, 'L'},
 			{ NULL, 0, 0, 0 },
 		};
 		int c;
 
-		c = getopt_long(argc, argv, "pF:M:m:NDVSTr", lopts, NULL);
+		c = getopt_long(argc, argv, "pF:M:m:P:CNDVSTrL", lopts, NULL);
 		if (c == -1) break;
 
 		switch (c) {
@@ -270,20 +188,25 @@ static void parse_opts(int argc, char *argv[])
                 //  read frequency from memory
                 uint8_t channel = atoi(optarg);
                 radio_perform_memory_operation(channel,'M');
+                break;
             }
             case 'm':
             {
                 //  write active frequency to memory location
                 uint8_t channel = atoi(optarg);
-                radio_perform_memory_operation(channel,'M');
+                radio_perform_memory_operation(channel,'m');
+                break;
             }
+            case 'P':
+                radio_apply_plan(optarg);
+                break;
+            case 'C':
+                print_channels();
+                break;
             case 'p':
-            {
                 //  set frequency to 144.390MHz
-                uint32_t freq = 144390000;
-                radio_set_frequency(144390000UL);
+                radio_set_frequency(SRB_RADIO_APRS_FREQUENCY);
                 break;
-            }
             case 'F':
             {
                 uint32_t freq = atol(optarg);
@@ -291,45 +214,38 @@ static void parse_opts(int argc, char *argv[])
                 break;
             }
 			case 'N':
-                radio_perform_query("QN");      //  device name
+                radio_print_text_query(SRB_CMD_QUERY_NAME);      //  device name
 				break;
 			case 'S':
-                radio_perform_query("Q#");
+                radio_print_text_query(SRB_CMD_QUERY_SERIAL);
                 break;
 			case 'V':
-                radio_perform_query("QV");
+                radio_print_text_query(SRB_CMD_QUERY_VERSION);
                 break;
             case 'T':
             {
 				//	temperature as signed 8 bit integer (command 'QT')
-                uint8_t data[2] = {0x51, 0x54};
-                uint8_t *rx_buf = malloc(22 * sizeof(uint8_t));
-                write_radio(data,rx_buf,22);
-                for(uint8_t i = 0; i < 22; i++ ) {
-                    printf("%.2X ",rx_buf[i]);
-                }
-                puts("");
-                free(rx_buf);
+                srb_response_t response;
+                radio_perform_query(SRB_CMD_QUERY_TEMPERATURE, &response);
+                printf("%d\n",response.value.temperature);
                 break;
             }
             case 'D':
                 //  date code
-                radio_perform_query("QD");
+                radio_print_text_query(SRB_CMD_QUERY_DATE);
                 break;
             case 'r':
             {
                 //  'QF' Fmin, Fmax, Fstep as 32 bit numbers
-                uint8_t data[2] = {0x51, 0x46};
-                uint8_t *rx_buf = malloc(22 * sizeof(uint8_t));
-                write_radio(data,rx_buf,22);
-                uint32_t freql,freqh,freqs;
-                memcpy(&freql,&data[2],sizeof(freql));
-                memcpy(&freqh,&data[6],sizeof(freqh));
-                memcpy(&freqs,&data[10],sizeof(freqs));
-                printf("freq = %d,%d,%d",freql,freqh,freqs);
-                free(rx_buf);
+                srb_response_t response;
+                radio_perform_query(SRB_CMD_QUERY_FREQUENCY_RANGE, &response);
+                printf("freq = %u,%u,%u\n",response.value.range.min_hz,
+                       response.value.range.max_hz,response.value.range.step_hz);
                 break;
             }
+            case 'L':
+                print_latency = 1;
+                break;
 		default:
 			print_usage(argv[0]);
 			break;
@@ -340,13 +256,24 @@ static void parse_opts(int argc, char *argv[])
 int main(int argc, char *argv[])
 {
 	int ret = 0;
-	int fd;
+
+	if(!bcm2835_init())
+		pabort("Unable to init BCM2835 lib");
 
     //  radio is on CSB, set up the RPi GPIO pins that
     //  control the aux CS
-    hab_spi_set_cs(HAB_SPI_CSB);
-    hab_spi_set_aux_gpio(RPI_V2_GPIO_P1_18, RPI_V2_GPIO_P1_22);
-    
+    srb_radio_init();
+
+    srb_channels_init(&plan);
+    if( srb_channels_load(&plan, SRB_CHANNELS_PATH) < 0 )
+        fprintf(stderr, "WARN | ignoring malformed %s\n", SRB_CHANNELS_PATH);
+    srb_channel_plan_t before = plan;
+
 	parse_opts(argc, argv);
+	if( memcmp(before.hz, plan.hz, sizeof(plan.hz)) != 0 &&
+	        srb_channels_save(&plan, SRB_CHANNELS_PATH) < 0 )
+		perror(SRB_CHANNELS_PATH);
+	if( print_latency )
+		print_latency_results();
 	return ret;
 }
\ No newline at end of file
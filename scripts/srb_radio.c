@@ -0,0 +1,244 @@
+/*
+ *  srb_radio.c
+ *
+ *  SPI protocol for the SRB-MX146LV transceiver
+ *
+ *	The radio's chip select is CSB => Y1 of the 74HC139, so every
+ *	transfer is bracketed by hab_spi_begin(SRB_RADIO_CS) and
+ *	hab_spi_end(), which drive GPIO 24/25 into the decoder before CE0
+ *	drops.
+ *
+ *	Built with -DSRB_RADIO_SIMULATOR the same protocol code talks to
+ *	the model in srb_sim.c instead, so it can run without the radio
+ *	(see srb_sim_test.c).
+ */
+
+#include "srb_radio.h"
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include <linux/spi/spidev.h>
+
+#define XFR_USE_BCM2835_LIB 1
+
+//  the transport under the protocol: the radio on CSB, or the model
+#ifdef SRB_RADIO_SIMULATOR
+#include "srb_sim.h"
+#define srb_radio_now_us()              srb_sim_now_us()
+#define srb_radio_delay_us(us)          srb_sim_delay_us(us)
+#define srb_radio_select()              srb_sim_select()
+#define srb_radio_deselect()            srb_sim_deselect()
+#define srb_radio_transfer(tx,rx,n)     srb_sim_transfer((tx),(rx),(n))
+#else
+#define srb_radio_now_us()              bcm2835_st_read()
+#define srb_radio_delay_us(us)          bcm2835_delayMicroseconds(us)
+#define srb_radio_select()              hab_spi_begin(SRB_RADIO_CS)
+#define srb_radio_deselect()            hab_spi_end()
+#define srb_radio_transfer(tx,rx,n)     bcm2835_spi_transfernb((char *)(tx),(char *)(rx),(n))
+#endif
+
+#if !XFR_USE_BCM2835_LIB
+static const char *device = "/dev/spidev0.0";
+static uint8_t mode = 0;
+static uint8_t bits = 8;
+static uint32_t speed = 39062;//500000;
+static uint16_t delay;
+#endif
+
+//  radio is on CSB, set up the RPi GPIO pins that control the aux CS
+void srb_radio_init(void)
+{
+#ifdef SRB_RADIO_SIMULATOR
+    srb_sim_init(NULL);
+#else
+    hab_spi_set_cs(SRB_RADIO_CS);
+    hab_spi_set_aux_gpio(RPI_V2_GPIO_P1_18, RPI_V2_GPIO_P1_22);
+    hab_spi_register_device(SRB_RADIO_CS, BCM2835_SPI_MODE0, BCM2835_SPI_CLOCK_DIVIDER_4096, LOW);
+#endif
+}
+
+//  latency is kept per command, indexed by srb_command_t
+static srb_radio_latency_t latencies[SRB_CMD_COUNT];
+
+//  wait for the radio's header after B/M/m, see srb_radio_set_command_ack()
+static uint8_t command_ack = 0;
+
+static srb_radio_latency_t *srb_radio_latency_slot(const uint8_t *command)
+{
+    int cmd = srb_command_for_opcode(command);
+    return cmd < 0 ? NULL : &latencies[cmd];
+}
+
+const srb_radio_latency_t *srb_radio_latency(const char *command)
+{
+    return srb_radio_latency_slot((const uint8_t *)command);
+}
+
+static void srb_radio_record_latency(const uint8_t *command, uint64_t start, uint32_t polls, uint8_t timed_out)
+{
+    srb_radio_latency_t *lat = srb_radio_latency_slot(command);
+    if( lat == NULL )
+        return;
+    uint32_t us = (uint32_t)(srb_radio_now_us() - start);
+    lat->count++;
+    lat->polls += polls;
+    lat->timeouts += timed_out;
+    lat->last_us = us;
+    lat->total_us += us;
+    if( us > lat->max_us )
+        lat->max_us = us;
+}
+
+/*
+ *  Send one frame, then poll for the response
+ *  rd_buf receives the first rd_len bytes of the response.  Commands
+ *  that return no payload pass rd_len = SRB_HEADER_LENGTH and get the
+ *  header from the poll itself, without another transfer, or 0 to send
+ *  the frame and not wait at all.  Returns 0, or -1 if the radio never
+ *  answered.
+ */
+static int srb_radio_transact(const uint8_t *wr_buf, size_t wr_len, uint8_t *rd_buf, size_t rd_len)
+{
+    int cmd = srb_command_for_opcode(wr_buf);
+    if( cmd < 0 )
+        return -1;
+    uint8_t scratch[SRB_FRAME_LENGTH];
+    uint8_t padding[SRB_FRAME_LENGTH];
+    uint32_t polls = 0;
+    uint8_t timed_out = 0;
+    int ret = 0;
+    memset(padding,SRB_PADDING,SRB_FRAME_LENGTH);
+
+    uint64_t start = srb_radio_now_us();
+    srb_radio_select();
+    srb_radio_transfer(wr_buf,scratch,wr_len);
+    #ifdef SRB_RADIO_LEGACY_DOUBLE_SEND
+        //  for unclear reasons we used to execute the transfer twice
+        srb_radio_delay_us(20000);
+        srb_radio_transfer(wr_buf,scratch,wr_len);
+        memcpy(rd_buf,scratch,rd_len);
+    #else
+        uint8_t header[SRB_HEADER_LENGTH];
+        while( rd_len > 0 ) {
+            srb_radio_delay_us(SRB_RADIO_POLL_INTERVAL_US);
+            srb_radio_transfer(padding,header,SRB_HEADER_LENGTH);
+            polls++;
+            if( srb_header_ready((srb_command_t)cmd, header) ) {
+                if( rd_len > SRB_HEADER_LENGTH )
+                    srb_radio_transfer(padding,rd_buf,rd_len);
+                else
+                    memcpy(rd_buf,header,rd_len);
+                break;
+            }
+            if( srb_radio_now_us() - start > SRB_RADIO_TIMEOUT_US ) {
+                timed_out = 1;
+                ret = -1;
+                break;
+            }
+        }
+    #endif
+    srb_radio_deselect();
+    srb_radio_record_latency(wr_buf, start, polls, timed_out);
+    return ret;
+}
+
+/*	Writes a 2 byte query to the radio padded to a full frame; rd_buf receives the response */
+static int write_radio(const uint8_t *data, uint8_t *rd_buf)
+{
+    uint8_t wr_buf[SRB_RADIO_MESSAGE_LENGTH];
+    //  pad our message with the required dummy character '?'
+    memcpy(memset(wr_buf,SRB_PADDING,SRB_RADIO_MESSAGE_LENGTH),data,2);
+
+    #if XFR_USE_BCM2835_LIB
+        return srb_radio_transact(wr_buf, SRB_RADIO_MESSAGE_LENGTH, rd_buf, SRB_RADIO_MESSAGE_LENGTH);
+    #else
+        int fd = open(device, O_RDWR);
+        if( fd < 0 ) return -1;
+        //	set SPI mode, word size and max speed
+        if( ioctl(fd, SPI_IOC_WR_MODE, &mode) == -1 ||
+            ioctl(fd, SPI_IOC_RD_MODE, &mode) == -1 ||
+            ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) == -1 ||
+            ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) == -1 ) {
+            close(fd);
+            return -1;
+        }
+
+        struct spi_ioc_transfer tr = {
+            .tx_buf = (unsigned long)wr_buf,
+            .rx_buf = (unsigned long)rd_buf,
+            .len = SRB_RADIO_MESSAGE_LENGTH,
+            .delay_usecs = delay,
+            .speed_hz = speed,
+            .bits_per_word = bits,
+        };
+
+        int ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
+        //	for some reason, the message must be sent twice
+        ret = ioctl(fd, SPI_IOC_MESSAGE(1), &tr);
+        close(fd);
+        if (ret < 1) return -1;
+        return 0;
+    #endif
+}
+
+/*
+ *  Wait for the radio's header after a B/M/m command, to see its error
+ *  code.  Off by default: the radio doesn't reliably answer commands,
+ *  and its ack (0x00 0x00) can't be told from a MISO line stuck low,
+ *  so commands are sent once and not waited on.
+ */
+void srb_radio_set_command_ack(uint8_t wait)
+{
+    command_ack = wait;
+}
+
+/*
+ *  Encode cmd, run it and decode the response
+ *  Returns SRB_DECODE_OK, one of the SRB_DECODE_* errors, or
+ *  SRB_RADIO_ENORESPONSE if the radio never produced a valid header.
+ *  Commands return SRB_DECODE_OK once sent unless the ack is enabled.
+ *  response may be NULL for commands.
+ */
+int srb_radio_command(srb_command_t cmd, uint32_t argument, srb_response_t *response)
+{
+    uint8_t wr_buf[SRB_FRAME_LENGTH];
+    uint8_t rd_buf[SRB_FRAME_LENGTH];
+    int length = srb_encode(cmd, argument, wr_buf, sizeof(wr_buf));
+    if( length < 0 )
+        return SRB_DECODE_COMMAND;
+
+    //  commands only need the header, to see the radio's error code
+    uint8_t is_command = srb_frames[cmd].payload == SRB_PAYLOAD_NONE;
+    size_t rd_len = !is_command ? sizeof(rd_buf) : command_ack ? SRB_HEADER_LENGTH : 0;
+    memset(rd_buf, SRB_PADDING, sizeof(rd_buf));
+    if( srb_radio_transact(wr_buf, length, rd_buf, rd_len) < 0 )
+        return SRB_RADIO_ENORESPONSE;
+    if( rd_len == 0 )
+        return SRB_DECODE_OK;
+    srb_response_t scratch;
+    return srb_decode(cmd, rd_buf, sizeof(rd_buf), response ? response : &scratch);
+}
+
+//  all queries are 2 bytes in length; rd_buf must hold SRB_RADIO_MESSAGE_LENGTH bytes
+int srb_radio_query(const char *query, uint8_t *rd_buf)
+{
+    return write_radio((const uint8_t *)query, rd_buf);
+}
+
+/*  set the frequency to the value specified by f (Hz) */
+int srb_radio_set_frequency(uint32_t f)
+{
+    return srb_radio_command(SRB_CMD_SET_FREQUENCY, f, NULL);
+}
+
+/*  'M' recalls memory channel into the active frequency, 'm' stores the active frequency */
+int srb_radio_memory_operation(uint8_t channel, char op)
+{
+    if( channel >= SRB_RADIO_MEMORY_CHANNELS )
+        return -1;
+    if( (op != 'M') && (op != 'm') )
+        return -1;
+    return srb_radio_command(op == 'M' ? SRB_CMD_MEMORY_RECALL : SRB_CMD_MEMORY_STORE, channel, NULL);
+}
@@ -0,0 +1,55 @@
+/*
+ *  srb_radio.h
+ *
+ *  SPI protocol for the SRB-MX146LV transceiver, shared by the
+ *  srbmx145 command line tool and the radiod daemon.
+ *
+ *  The radio sits on CSB of the 74HC139 (see hab_spi.h).  Queries are
+ *  two ASCII bytes padded to a 22 byte frame with '?'; the response
+ *  frame is an error code, a length and up to 20 bytes of data.
+ *
+ *  Each frame is sent once.  The radio restarts its response frame on
+ *  every chip select, so we then poll with short SRB_HEADER_LENGTH
+ *  reads until the header is valid, and only then clock out the full
+ *  frame.  Commands (B, M, m) carry no response and are not polled
+ *  for one unless srb_radio_set_command_ack() asks for the radio's
+ *  error code.  Defining SRB_RADIO_LEGACY_DOUBLE_SEND restores the old
+ *  send-twice-with-20ms-delay behaviour for comparison.
+ */
+
+#ifndef SRB_RADIO_H
+#define SRB_RADIO_H
+
+#include "hab_spi.h"
+#include "srb_codec.h"
+#include <stdint.h>
+
+#define SRB_RADIO_CS                HAB_SPI_CSB
+#define SRB_RADIO_MESSAGE_LENGTH    SRB_FRAME_LENGTH
+#define SRB_RADIO_MEMORY_CHANNELS   16
+#define SRB_RADIO_APRS_FREQUENCY    144390000UL
+
+#define SRB_RADIO_POLL_INTERVAL_US  250
+#define SRB_RADIO_TIMEOUT_US        50000
+
+#define SRB_RADIO_ENORESPONSE       -10         //  no valid header within SRB_RADIO_TIMEOUT_US
+
+//  per-command latency, from the first byte sent to a valid response
+typedef struct {
+    uint32_t count;
+    uint32_t timeouts;          //  no valid header within SRB_RADIO_TIMEOUT_US
+    uint32_t polls;             //  status reads issued
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} srb_radio_latency_t;
+
+void srb_radio_init(void);
+void srb_radio_set_command_ack(uint8_t wait);
+int srb_radio_command(srb_command_t cmd, uint32_t argument, srb_response_t *response);
+int srb_radio_query(const char *query, uint8_t *rd_buf);
+int srb_radio_set_frequency(uint32_t f);
+int srb_radio_memory_operation(uint8_t channel, char op);
+const srb_radio_latency_t *srb_radio_latency(const char *command);
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ *  srb_sim.c
+ *
+ *  SRB-MX146LV protocol model, see srb_sim.h
+ */
+
+#include "srb_sim.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SRB_SIM_FRAME_LENGTH    22
+#define SRB_SIM_PAD             '?'
+
+const srb_sim_config_t srb_sim_defaults = {
+    .latency_us = SRB_SIM_DEFAULT_LATENCY_US,
+    .jitter_us = 0,
+    .spi_hz = SRB_SIM_DEFAULT_SPI_HZ,
+    .min_hz = 144000000,
+    .max_hz = 148000000,
+    .step_hz = 5000,
+    .temperature = 21,
+    .name = "SRB-MX146LV",
+    .date = "SIM",
+    .version = "0.0-sim",
+    .serial = "00000000",
+};
+
+static struct {
+    srb_sim_config_t config;
+    uint32_t frequency;
+    uint32_t channels[SRB_SIM_CHANNELS];       //  0 = never stored
+    uint8_t response[SRB_SIM_FRAME_LENGTH];
+    uint8_t has_response;
+    uint64_t ready_at;
+    uint8_t selected;
+    srb_sim_stats_t stats;
+} sim;
+
+void srb_sim_init(const srb_sim_config_t *config)
+{
+    memset(&sim, 0, sizeof(sim));
+    sim.config = config ? *config : srb_sim_defaults;
+    srand(1);
+}
+
+uint32_t srb_sim_frequency(void)
+{
+    return sim.frequency;
+}
+
+uint32_t srb_sim_channel(uint8_t channel)
+{
+    return channel < SRB_SIM_CHANNELS ? sim.channels[channel] : 0;
+}
+
+const srb_sim_stats_t *srb_sim_stats(void)
+{
+    return &sim.stats;
+}
+
+uint64_t srb_sim_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void srb_sim_delay_us(uint32_t us)
+{
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    while( nanosleep(&ts, &ts) != 0 )
+        ;
+}
+
+void srb_sim_select(void)
+{
+    sim.selected = 1;
+}
+
+void srb_sim_deselect(void)
+{
+    sim.selected = 0;
+}
+
+static void srb_sim_respond(uint8_t error, const void *payload, uint8_t length)
+{
+    memset(sim.response, SRB_SIM_PAD, sizeof(sim.response));
+    sim.response[0] = error;
+    sim.response[1] = length;
+    if( length )
+        memcpy(sim.response + 2, payload, length);
+    sim.has_response = 1;
+    if( error )
+        sim.stats.errors++;
+
+    uint32_t delay = sim.config.latency_us;
+    if( sim.config.jitter_us )
+        delay += rand() % (sim.config.jitter_us + 1);
+    sim.ready_at = srb_sim_now_us() + delay;
+}
+
+static void srb_sim_respond_text(const char *text)
+{
+    size_t length = strlen(text);
+    srb_sim_respond(0, text, length > SRB_SIM_FRAME_LENGTH - 2 ? SRB_SIM_FRAME_LENGTH - 2 : length);
+}
+
+static void srb_sim_query(uint8_t letter)
+{
+    switch( letter ) {
+        case 'N':   srb_sim_respond_text(sim.config.name);      break;
+        case 'D':   srb_sim_respond_text(sim.config.date);      break;
+        case 'V':   srb_sim_respond_text(sim.config.version);   break;
+        case '#':   srb_sim_respond_text(sim.config.serial);    break;
+        case 'T':
+            srb_sim_respond(0, &sim.config.temperature, 1);
+            break;
+        case 'F':
+        {
+            uint8_t range[12];
+            uint32_t values[3] = { sim.config.min_hz, sim.config.max_hz, sim.config.step_hz };
+            for(uint8_t i = 0; i < 12; i++ )
+                range[i] = values[i / 4] >> (8 * (i % 4));
+            srb_sim_respond(0, range, sizeof(range));
+            break;
+        }
+        default:
+            srb_sim_respond(SRB_SIM_ERR_COMMAND, NULL, 0);
+            break;
+    }
+}
+
+static void srb_sim_execute(const uint8_t *cmd, uint32_t length)
+{
+    sim.stats.commands++;
+    switch( cmd[0] ) {
+        case 'B':
+        {
+            uint32_t f = 0;
+            for(uint8_t i = 0; i < 4 && (uint32_t)(1 + i) < length; i++ )
+                f |= (uint32_t)cmd[1 + i] << (8 * i);
+            if( length < 5 || f < sim.config.min_hz || f > sim.config.max_hz ||
+                    (f - sim.config.min_hz) % sim.config.step_hz ) {
+                srb_sim_respond(SRB_SIM_ERR_RANGE, NULL, 0);
+                break;
+            }
+            sim.frequency = f;
+            srb_sim_respond(0, NULL, 0);
+            break;
+        }
+        case 'M':
+            if( length < 2 || cmd[1] >= SRB_SIM_CHANNELS || sim.channels[cmd[1]] == 0 ) {
+                srb_sim_respond(SRB_SIM_ERR_CHANNEL, NULL, 0);
+                break;
+            }
+            sim.frequency = sim.channels[cmd[1]];
+            srb_sim_respond(0, NULL, 0);
+            break;
+        case 'm':
+            if( length < 2 || cmd[1] >= SRB_SIM_CHANNELS ) {
+                srb_sim_respond(SRB_SIM_ERR_CHANNEL, NULL, 0);
+                break;
+            }
+            sim.channels[cmd[1]] = sim.frequency;
+            srb_sim_respond(0, NULL, 0);
+            break;
+        case 'Q':
+            srb_sim_query(length > 1 ? cmd[1] : 0);
+            break;
+        default:
+            srb_sim_respond(SRB_SIM_ERR_COMMAND, NULL, 0);
+            break;
+    }
+}
+
+/*
+ *  One chip select: shift the response out while the command shifts in,
+ *  then act on the command.
+ */
+void srb_sim_transfer(const uint8_t *tx, uint8_t *rx, uint32_t length)
+{
+    sim.stats.transfers++;
+    sim.stats.bytes += length;
+    if( sim.config.spi_hz )
+        srb_sim_delay_us((uint32_t)((uint64_t)length * 8 * 1000000 / sim.config.spi_hz));
+    if( !sim.selected ) {
+        sim.stats.unselected++;
+        memset(rx, 0xFF, length);
+        return;
+    }
+
+    uint8_t ready = sim.has_response && srb_sim_now_us() >= sim.ready_at;
+    for(uint32_t i = 0; i < length; i++ ) {
+        if( !sim.has_response )
+            rx[i] = 0xFF;
+        else if( !ready || i >= SRB_SIM_FRAME_LENGTH )
+            rx[i] = SRB_SIM_PAD;
+        else
+            rx[i] = sim.response[i];
+    }
+
+    uint32_t n = 0;
+    while( n < length && tx[n] == SRB_SIM_PAD )
+        n++;
+    if( n == length ) {
+        sim.stats.polls++;
+        sim.stats.busy_polls += sim.has_response && !ready;
+        return;
+    }
+    srb_sim_execute(tx, length);
+}
@@ -0,0 +1,72 @@
+/*
+ *  srb_sim.h
+ *
+ *  Software model of the SRB-MX146LV's SPI protocol, used in place of
+ *  the real radio when srb_radio.c is built with -DSRB_RADIO_SIMULATOR.
+ *
+ *  Every transfer is one chip select on the radio (CE0 gates the
+ *  74HC139).  While a transfer clocks the command in on MOSI, MISO
+ *  carries the current response frame from its first byte: '?' while
+ *  the previous command is still being processed, 0xFF before any
+ *  command has been sent.  A transfer of nothing but '?' padding is a
+ *  status poll and doesn't change anything.  When a command transfer
+ *  ends, its response becomes ready after latency_us (+ up to
+ *  jitter_us), and clocking bytes costs 8 bits at spi_hz.
+ *
+ *  The model keeps the active frequency and 16 memory channels, and
+ *  answers N, D, V, #, T and F queries from srb_sim_config_t.  The
+ *  error codes are the model's own (SRB_SIM_ERR_*).
+ */
+
+#ifndef SRB_SIM_H
+#define SRB_SIM_H
+
+#include <stdint.h>
+
+#define SRB_SIM_CHANNELS            16
+#define SRB_SIM_DEFAULT_LATENCY_US  2000
+#define SRB_SIM_DEFAULT_SPI_HZ      61035       //  250 MHz / BCM2835_SPI_CLOCK_DIVIDER_4096
+
+#define SRB_SIM_ERR_RANGE           1           //  frequency outside Fmin..Fmax or off the step
+#define SRB_SIM_ERR_CHANNEL         2           //  channel out of range or never stored
+#define SRB_SIM_ERR_COMMAND         3           //  unknown command or query
+
+typedef struct {
+    uint32_t latency_us;
+    uint32_t jitter_us;
+    uint32_t spi_hz;                //  0 = transfers take no time
+    uint32_t min_hz;
+    uint32_t max_hz;
+    uint32_t step_hz;
+    int8_t temperature;
+    const char *name;
+    const char *date;
+    const char *version;
+    const char *serial;
+} srb_sim_config_t;
+
+typedef struct {
+    uint32_t transfers;
+    uint32_t commands;
+    uint32_t polls;
+    uint32_t busy_polls;            //  polls answered with '?'
+    uint32_t errors;                //  commands answered with a non-zero error code
+    uint32_t unselected;            //  transfers while the radio's CS wasn't addressed
+    uint64_t bytes;
+} srb_sim_stats_t;
+
+extern const srb_sim_config_t srb_sim_defaults;
+
+void srb_sim_init(const srb_sim_config_t *config);
+uint32_t srb_sim_frequency(void);
+uint32_t srb_sim_channel(uint8_t channel);
+const srb_sim_stats_t *srb_sim_stats(void);
+
+//  the transport srb_radio.c uses when built with SRB_RADIO_SIMULATOR
+uint64_t srb_sim_now_us(void);
+void srb_sim_delay_us(uint32_t us);
+void srb_sim_select(void);
+void srb_sim_deselect(void);
+void srb_sim_transfer(const uint8_t *tx, uint8_t *rx, uint32_t length);
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ *  srb_sim_test.c
+ *
+ *  Runs the SRB-MX146LV protocol code (srb_radio.c, srb_channels.c)
+ *  against the radio model in srb_sim.c, so it needs neither the radio
+ *  nor a Raspberry Pi.  It first checks the protocol end to end
+ *  (queries, frequency set, memory store/recall, error codes), then
+ *  times --count rounds of commands and prints per-command latency.
+ *  --max-mean makes it fail when any command's mean latency exceeds
+ *  the given number of microseconds, for catching regressions.
+ *
+ *  To compile:
+ *  gcc -DSRB_RADIO_SIMULATOR srb_sim_test.c srb_sim.c srb_radio.c srb_codec.c srb_channels.c -o srb_sim_test -std=gnu99 -I../lib/bcm2835-1.25/src
+ *
+ */
+
+#include "srb_radio.h"
+#include "srb_channels.h"
+#include "srb_sim.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+//  the legacy transport sends every frame twice, and the model sees both
+#ifdef SRB_RADIO_LEGACY_DOUBLE_SEND
+#define SENDS_PER_COMMAND   2
+#else
+#define SENDS_PER_COMMAND   1
+#endif
+
+static srb_sim_config_t config;
+static uint32_t rounds = 100;
+static uint32_t max_mean_us = 0;
+static int failures = 0;
+
+static void print_usage(const char *prog)
+{
+    printf("Tests the SRB-MX146LV protocol against the radio model\n");
+    printf("Usage: %s [-ljcnm]\n", prog);
+    puts(   "-l --latency\tmodel response latency in us (default 2000)\n"
+            "-j --jitter\tadd up to this many us of random latency\n"
+            "-c --clock\tmodel SPI clock in Hz, 0 for instant transfers (default 61035)\n"
+            "-n --count\trounds of commands to time (default 100)\n"
+            "-m --max-mean\tfail if a command's mean latency exceeds this many us\n"
+         );
+    exit(1);
+}
+
+static void parse_opts(int argc, char *argv[])
+{
+    while(1) {
+        static const struct option lopts[] = {
+            { "latency",    required_argument,  NULL,   'l'},
+            { "jitter",     required_argument,  NULL,   'j'},
+            { "clock",      required_argument,  NULL,   'c'},
+            { "count",      required_argument,  NULL,   'n'},
+            { "max-mean",   required_argument,  NULL,   'm'},
+            {NULL,0,0,0},
+        };
+        int c = getopt_long(argc, argv, "l:j:c:n:m:", lopts, NULL);
+        if( c == -1 ) break;
+
+        switch( c )
+        {
+            case 'l':
+                config.latency_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                config.jitter_us = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                config.spi_hz = strtoul(optarg, NULL, 10);
+                break;
+            case 'n':
+                rounds = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                max_mean_us = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_usage(argv[0]);
+                break;
+        }
+    }
+}
+
+static void check(int ok, const char *what)
+{
+    if( !ok ) {
+        printf("FAIL | %s\n", what);
+        failures++;
+    }
+}
+
+static void test_protocol(void)
+{
+    srb_response_t r;
+
+    check(srb_radio_command(SRB_CMD_QUERY_NAME, 0, &r) == SRB_DECODE_OK &&
+          strcmp(r.value.text, config.name) == 0, "QN");
+    check(srb_radio_command(SRB_CMD_QUERY_VERSION, 0, &r) == SRB_DECODE_OK &&
+          strcmp(r.value.text, config.version) == 0, "QV");
+    check(srb_radio_command(SRB_CMD_QUERY_TEMPERATURE, 0, &r) == SRB_DECODE_OK &&
+          r.value.temperature == config.temperature, "QT");
+    check(srb_radio_command(SRB_CMD_QUERY_FREQUENCY_RANGE, 0, &r) == SRB_DECODE_OK &&
+          r.value.range.min_hz == config.min_hz && r.value.range.max_hz == config.max_hz &&
+          r.value.range.step_hz == config.step_hz, "QF");
+
+    //  commands are sent once and not polled for an answer
+    const srb_radio_latency_t *lat = srb_radio_latency("B");
+    uint32_t polls = lat->polls;
+    check(srb_radio_set_frequency(SRB_RADIO_APRS_FREQUENCY) == SRB_DECODE_OK &&
+          srb_sim_frequency() == SRB_RADIO_APRS_FREQUENCY && lat->polls == polls, "B 144.390 without an ack");
+    check(srb_radio_set_frequency(150000000) == SRB_DECODE_OK &&
+          srb_sim_frequency() == SRB_RADIO_APRS_FREQUENCY, "B out of range is sent");
+
+    //  with the ack the radio's error code comes back
+    srb_radio_set_command_ack(1);
+    check(srb_radio_set_frequency(150000000) == SRB_DECODE_RADIO_ERROR &&
+          srb_sim_frequency() == SRB_RADIO_APRS_FREQUENCY, "B out of range is refused");
+    check(srb_radio_memory_operation(3, 'M') == SRB_DECODE_RADIO_ERROR, "M of an empty channel is refused");
+    check(srb_radio_memory_operation(3, 'm') == SRB_DECODE_OK &&
+          srb_sim_channel(3) == SRB_RADIO_APRS_FREQUENCY, "m 3");
+    srb_radio_set_command_ack(0);
+
+    //  the plan only writes what changed, and retunes by recall
+    srb_channel_plan_t plan;
+    uint32_t wanted[SRB_RADIO_MEMORY_CHANNELS] = { 0 };
+    srb_channels_init(&plan);
+    wanted[0] = 145000000;
+    wanted[1] = 146520000;
+    check(srb_channels_apply(&plan, wanted) == 2 && srb_sim_channel(0) == 145000000 &&
+          srb_sim_channel(1) == 146520000, "plan writes two channels");
+    uint32_t commands = srb_sim_stats()->commands;
+    check(srb_channels_apply(&plan, wanted) == 0 && srb_sim_stats()->commands == commands,
+          "unchanged plan sends nothing");
+    check(srb_channels_tune(&plan, 145000000) == SRB_DECODE_OK && srb_sim_frequency() == 145000000 &&
+          plan.recalls == 1 && srb_sim_stats()->commands == commands + SENDS_PER_COMMAND, "retune by one recall");
+}
+
+static void bench(void)
+{
+    srb_response_t r;
+    uint64_t start = srb_sim_now_us();
+    for(uint32_t i = 0; i < rounds; i++ ) {
+        srb_radio_set_frequency(config.min_hz + (i % 100) * config.step_hz);
+        srb_radio_memory_operation(i % SRB_RADIO_MEMORY_CHANNELS, 'm');
+        srb_radio_memory_operation(i % SRB_RADIO_MEMORY_CHANNELS, 'M');
+        srb_radio_command(SRB_CMD_QUERY_TEMPERATURE, 0, &r);
+        srb_radio_command(SRB_CMD_QUERY_NAME, 0, &r);
+    }
+    uint64_t elapsed = srb_sim_now_us() - start;
+
+    static const char *commands[] = { "B", "M", "m", "QN", "QD", "QV", "Q#", "QT", "QF" };
+    for(uint8_t i = 0; i < ARRAY_SIZE(commands); i++ ) {
+        const srb_radio_latency_t *lat = srb_radio_latency(commands[i]);
+        if( lat == NULL || lat->count == 0 )
+            continue;
+        uint32_t mean = (uint32_t)(lat->total_us / lat->count);
+        printf("%-2s n=%u mean=%uus max=%uus polls/cmd=%.1f timeouts=%u\n",
+               commands[i], lat->count, mean, lat->max_us,
+               (double)lat->polls / lat->count, lat->timeouts);
+        if( max_mean_us && mean > max_mean_us ) {
+            printf("FAIL | %s mean latency %uus exceeds %uus\n", commands[i], mean, max_mean_us);
+            failures++;
+        }
+    }
+    const srb_sim_stats_t *stats = srb_sim_stats();
+    printf("bench: %u commands in %.3f s (%.0f/s), %llu bytes on the bus, %u busy polls\n",
+           rounds * 5, elapsed / 1e6, rounds * 5 / (elapsed / 1e6),
+           (unsigned long long)stats->bytes, stats->busy_polls);
+}
+
+int main(int argc, char *argv[])
+{
+    config = srb_sim_defaults;
+    parse_opts(argc, argv);
+    srb_radio_init();
+    srb_sim_init(&config);
+
+    test_protocol();
+    if( rounds )
+        bench();
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
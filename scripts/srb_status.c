@@ -0,0 +1,169 @@
+/*
+ *  srb_status.c
+ *
+ *  SRB-MX146LV status cache, see srb_status.h
+ */
+
+#include "srb_status.h"
+#include "srb_radio.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+_Static_assert(sizeof(srb_status_entry_t) == 48, "srb_status_entry_t layout is shared with devices/radio.py");
+_Static_assert(sizeof(srb_status_t) == 16 + 48 * SRB_STATUS_FIELDS, "srb_status_t layout is shared with devices/radio.py");
+
+static uint64_t srb_status_clock(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+srb_status_t *srb_status_create(void)
+{
+    int fd = shm_open(SRB_STATUS_SHM_NAME, O_RDWR | O_CREAT, 0644);
+    if( fd < 0 )
+        return NULL;
+    if( ftruncate(fd, sizeof(srb_status_t)) < 0 ) {
+        close(fd);
+        return NULL;
+    }
+    srb_status_t *status = mmap(NULL, sizeof(srb_status_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if( status == MAP_FAILED )
+        return NULL;
+    memset(status, 0, sizeof(srb_status_t));
+    status->fields = SRB_STATUS_FIELDS;
+    __atomic_store_n(&status->magic, SRB_STATUS_MAGIC, __ATOMIC_RELEASE);
+    return status;
+}
+
+const srb_status_t *srb_status_open(void)
+{
+    int fd = shm_open(SRB_STATUS_SHM_NAME, O_RDONLY, 0);
+    if( fd < 0 )
+        return NULL;
+    const srb_status_t *status = mmap(NULL, sizeof(srb_status_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if( status == MAP_FAILED )
+        return NULL;
+    if( __atomic_load_n(&status->magic, __ATOMIC_ACQUIRE) != SRB_STATUS_MAGIC ||
+            status->fields != SRB_STATUS_FIELDS ) {
+        munmap((void *)status, sizeof(srb_status_t));
+        return NULL;
+    }
+    return status;
+}
+
+//  everything is due straight away, so the static fields are fetched at startup
+void srb_status_init(srb_status_cache_t *cache, srb_status_t *shared, uint32_t temperature_ttl_us)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->shared = shared;
+    for(uint8_t i = 0; i < SRB_STATUS_FIELDS; i++ )
+        cache->ttl_us[i] = SRB_STATUS_TTL_ONCE;
+    cache->ttl_us[SRB_STATUS_FIELD(SRB_CMD_QUERY_TEMPERATURE)] = temperature_ttl_us;
+}
+
+/*
+ *  Record the outcome of a query, from a refresh or from a client's own
+ *  request.  Only frames that decode cleanly replace the cached value.
+ */
+void srb_status_record(srb_status_cache_t *cache, srb_command_t cmd, int result, const uint8_t *frame)
+{
+    if( cmd < SRB_CMD_QUERY_NAME || cmd >= SRB_CMD_COUNT )
+        return;
+    uint8_t field = SRB_STATUS_FIELD(cmd);
+    srb_response_t response;
+    if( result == 0 )
+        result = srb_decode(cmd, frame, SRB_FRAME_LENGTH, &response);
+
+    uint64_t now = srb_status_clock(CLOCK_MONOTONIC);
+    if( result != SRB_DECODE_OK )
+        cache->due_us[field] = now + SRB_STATUS_RETRY_US;
+    else if( cache->ttl_us[field] == SRB_STATUS_TTL_ONCE )
+        cache->due_us[field] = UINT64_MAX;
+    else
+        cache->due_us[field] = now + cache->ttl_us[field];
+    if( result == SRB_DECODE_OK )
+        cache->fetched_us[field] = now;
+
+    srb_status_t *s = cache->shared;
+    if( s == NULL )
+        return;
+    srb_status_entry_t *entry = &s->entries[field];
+    uint32_t sequence = s->sequence;
+    __atomic_store_n(&s->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    entry->result = result;
+    if( result == SRB_DECODE_OK ) {
+        memcpy(entry->frame, frame, SRB_FRAME_LENGTH);
+        entry->updated_us = srb_status_clock(CLOCK_REALTIME);
+        entry->refreshes++;
+    } else {
+        entry->failures++;
+    }
+    __atomic_store_n(&s->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ *  Copy the cached frame for cmd if it is still fresh.
+ *  Returns 1 if frame was filled in, 0 if the radio has to be asked.
+ */
+int srb_status_lookup(const srb_status_cache_t *cache, srb_command_t cmd, uint8_t *frame)
+{
+    if( cmd < SRB_CMD_QUERY_NAME || cmd >= SRB_CMD_COUNT || cache->shared == NULL )
+        return 0;
+    uint8_t field = SRB_STATUS_FIELD(cmd);
+    if( cache->fetched_us[field] == 0 )
+        return 0;
+    if( cache->ttl_us[field] != SRB_STATUS_TTL_ONCE &&
+            srb_status_clock(CLOCK_MONOTONIC) - cache->fetched_us[field] >= cache->ttl_us[field] )
+        return 0;
+    //  we are the only writer, so no need for the sequence lock here
+    memcpy(frame, cache->shared->entries[field].frame, SRB_FRAME_LENGTH);
+    return 1;
+}
+
+/*
+ *  Run the most overdue query, if any.  One transaction per call keeps
+ *  radiod free to serve its clients in between.  Returns 1 if the radio
+ *  was queried.
+ */
+int srb_status_refresh(srb_status_cache_t *cache)
+{
+    uint64_t now = srb_status_clock(CLOCK_MONOTONIC);
+    int due = -1;
+    for(uint8_t i = 0; i < SRB_STATUS_FIELDS; i++ ) {
+        if( cache->due_us[i] <= now && (due < 0 || cache->due_us[i] < cache->due_us[due]) )
+            due = i;
+    }
+    if( due < 0 )
+        return 0;
+
+    srb_command_t cmd = (srb_command_t)(SRB_CMD_QUERY_NAME + due);
+    uint8_t frame[SRB_FRAME_LENGTH];
+    int ret = srb_radio_query(srb_frames[cmd].opcode, frame);
+    srb_status_record(cache, cmd, ret < 0 ? SRB_RADIO_ENORESPONSE : 0, frame);
+    return 1;
+}
+
+//  poll() timeout until the next field is due, -1 if nothing ever will be
+int srb_status_next_due_ms(const srb_status_cache_t *cache)
+{
+    uint64_t next = UINT64_MAX;
+    for(uint8_t i = 0; i < SRB_STATUS_FIELDS; i++ ) {
+        if( cache->due_us[i] < next )
+            next = cache->due_us[i];
+    }
+    if( next == UINT64_MAX )
+        return -1;
+    uint64_t now = srb_status_clock(CLOCK_MONOTONIC);
+    if( next <= now )
+        return 0;
+    uint64_t ms = (next - now + 999) / 1000;
+    return ms > 60000 ? 60000 : (int)ms;
+}
@@ -0,0 +1,97 @@
+/*
+ *  srb_status.h
+ *
+ *  Cached SRB-MX146LV status, published by radiod in POSIX shared memory.
+ *
+ *  Each query (QN, QD, QV, Q#, QT, QF) has a time to live.  Name, date
+ *  code, version, serial and frequency range never change in flight, so
+ *  they are fetched once at startup (and retried until they succeed);
+ *  temperature is refreshed at a fixed interval.  radiod refreshes one
+ *  due field at a time while its command queue is empty, and answers
+ *  RADIOD_OP_QUERY from the cache while the field is fresh.
+ *
+ *  The last good response frame of every field is kept under a single
+ *  sequence lock.  There is a single writer; readers use
+ *  srb_status_read() and never touch SPI or take a lock.
+ */
+
+#ifndef SRB_STATUS_H
+#define SRB_STATUS_H
+
+#include "srb_codec.h"
+#include <stdint.h>
+#include <string.h>
+
+#define SRB_STATUS_SHM_NAME             "/hab_radio_status"
+#define SRB_STATUS_MAGIC                0x53524231      //  'SRB1'
+#define SRB_STATUS_FIELDS               (SRB_CMD_COUNT - SRB_CMD_QUERY_NAME)
+#define SRB_STATUS_FIELD(cmd)           ((cmd) - SRB_CMD_QUERY_NAME)
+
+#define SRB_STATUS_TTL_ONCE             0               //  never changes once fetched
+#define SRB_STATUS_TEMPERATURE_TTL_US   5000000
+#define SRB_STATUS_RETRY_US             1000000         //  after a failed refresh
+
+#define SRB_STATUS_ENODATA              -20             //  field has never been fetched
+
+//  48 bytes; devices/radio.py unpacks this layout
+typedef struct {
+    uint64_t updated_us;                //  CLOCK_REALTIME of the last good response, 0 = never
+    uint32_t refreshes;
+    uint32_t failures;
+    int32_t result;                     //  outcome of the last attempt (SRB_DECODE_* or SRB_RADIO_ENORESPONSE)
+    uint8_t frame[SRB_FRAME_LENGTH];    //  last good response frame
+    uint8_t reserved[6];
+} srb_status_entry_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t fields;
+    uint32_t sequence;                  //  odd while the writer is updating
+    uint32_t reserved;
+    srb_status_entry_t entries[SRB_STATUS_FIELDS];
+} srb_status_t;
+
+//  writer side, private to radiod
+typedef struct {
+    srb_status_t *shared;
+    uint32_t ttl_us[SRB_STATUS_FIELDS];
+    uint64_t due_us[SRB_STATUS_FIELDS];         //  CLOCK_MONOTONIC
+    uint64_t fetched_us[SRB_STATUS_FIELDS];     //  CLOCK_MONOTONIC of the last good response
+} srb_status_cache_t;
+
+srb_status_t *srb_status_create(void);
+const srb_status_t *srb_status_open(void);
+void srb_status_init(srb_status_cache_t *cache, srb_status_t *shared, uint32_t temperature_ttl_us);
+void srb_status_record(srb_status_cache_t *cache, srb_command_t cmd, int result, const uint8_t *frame);
+int srb_status_lookup(const srb_status_cache_t *cache, srb_command_t cmd, uint8_t *frame);
+int srb_status_refresh(srb_status_cache_t *cache);
+int srb_status_next_due_ms(const srb_status_cache_t *cache);
+
+/*
+ *  Decode the cached value of a query command.  updated_us (optional)
+ *  receives the wall clock time of that response.  Returns the
+ *  srb_decode() result, or SRB_STATUS_ENODATA.
+ */
+static inline int srb_status_read(const srb_status_t *status, srb_command_t cmd,
+        srb_response_t *response, uint64_t *updated_us)
+{
+    if( cmd < SRB_CMD_QUERY_NAME || cmd >= SRB_CMD_COUNT )
+        return SRB_DECODE_COMMAND;
+    const srb_status_entry_t *shared = &status->entries[SRB_STATUS_FIELD(cmd)];
+    srb_status_entry_t entry;
+    uint32_t begin, end;
+    do {
+        begin = __atomic_load_n(&status->sequence, __ATOMIC_ACQUIRE);
+        memcpy(&entry, shared, sizeof(entry));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&status->sequence, __ATOMIC_RELAXED);
+    } while( (begin & 1) || begin != end );
+
+    if( updated_us )
+        *updated_us = entry.updated_us;
+    if( entry.updated_us == 0 )
+        return SRB_STATUS_ENODATA;
+    return srb_decode(cmd, entry.frame, sizeof(entry.frame), response);
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ *  telemetry_snapshot.h
+ *
+ *  Latest flight telemetry, published by helium.py in POSIX shared
+ *  memory (services/snapshot.py is the writer and has the Python
+ *  reader).  The record sits under a single sequence lock; readers use
+ *  telemetry_snapshot_read() and never touch the sensors or take a lock.
+ *
+ *  Header only; the mapping is opened with
+ *      int fd = shm_open(TELEMETRY_SNAPSHOT_SHM_NAME, O_RDONLY, 0);
+ *      const telemetry_snapshot_t *snap = mmap(NULL, sizeof(*snap), PROT_READ, MAP_SHARED, fd, 0);
+ *  and checked with telemetry_snapshot_valid().
+ */
+
+#ifndef TELEMETRY_SNAPSHOT_H
+#define TELEMETRY_SNAPSHOT_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define TELEMETRY_SNAPSHOT_SHM_NAME     "/helium_telemetry"
+#define TELEMETRY_SNAPSHOT_MAGIC        0x484c4d31      //  'HLM1'
+
+//  field order and types must match FIELDS in services/snapshot.py
+typedef struct {
+    double updated;                     //  unix seconds of the publish
+    double sensor_time;                 //  unix seconds the sensor values were refreshed
+    double temp_time;                   //  unix seconds extemp and intemp were converted
+    double extemp;                      //  C
+    double intemp;
+    double cputemp;
+    double bmptemp;
+    double humidity;                    //  % RH
+    double humidity_confidence;         //  1 sigma uncertainty of humidity, % RH
+    double pressure;                    //  Pa
+    double slp;                         //  Pa
+    double altitude;                    //  barometric, m
+    double accelx;                      //  g
+    double accely;
+    double accelz;
+    double fix_time;                    //  unix seconds of the last GGA/VTG
+    double latitude;
+    double longitude;
+    double gps_altitude;                //  m
+    double kts;
+    double trkangle;
+    double trkmag;
+    int32_t mode;                       //  HeliumMode
+    int32_t quality;
+    int32_t satcount;
+    uint32_t publishes;                 //  0 = nothing published yet
+} telemetry_snapshot_body_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;                      //  sizeof(telemetry_snapshot_t)
+    uint32_t sequence;                  //  odd while the writer is updating
+    uint32_t reserved;
+    telemetry_snapshot_body_t body;
+} telemetry_snapshot_t;
+
+_Static_assert(sizeof(telemetry_snapshot_t) == 16 + 22 * 8 + 4 * 4, "telemetry_snapshot_t layout is shared with services/snapshot.py");
+
+static inline int telemetry_snapshot_valid(const telemetry_snapshot_t *snap)
+{
+    return __atomic_load_n(&snap->magic, __ATOMIC_ACQUIRE) == TELEMETRY_SNAPSHOT_MAGIC &&
+           snap->size == sizeof(telemetry_snapshot_t);
+}
+
+static inline void telemetry_snapshot_read(const telemetry_snapshot_t *snap, telemetry_snapshot_body_t *body)
+{
+    uint32_t begin, end;
+    do {
+        begin = __atomic_load_n(&snap->sequence, __ATOMIC_ACQUIRE);
+        memcpy(body, &snap->body, sizeof(*body));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        end = __atomic_load_n(&snap->sequence, __ATOMIC_RELAXED);
+    } while( (begin & 1) || begin != end );
+}
+
+#endif
@@ -0,0 +1,233 @@
+#!/usr/bin/python
+
+""" flightlog module """
+
+""" Append-only binary flight recorder
+
+                Every sensors or fixes row is also written as a fixed 112 byte record
+                into preallocated, mmap'd segment files, so the copy on disk doesn't
+                depend on SQLite, a working db connection or a commit succeeding.
+                Appending is a struct pack into the mapping: no system calls except
+                when a segment fills and the next one is mapped.  The kernel writes
+                dirty pages back on its own; sync() forces it (schedule it from the
+                flight loop for a bound on what a power cut can cost).
+
+                Record layout, little-endian:
+                    uint32  sequence    1, 2, 3 ... (0 marks a slot never written)
+                    uint8   kind        RECORD_SENSORS or RECORD_FIX
+                    uint8   count       number of values used
+                    uint16  reserved
+                    double  time        unix seconds
+                    double  values[11]  the columns in SENSORS_COLUMNS / FIX_COLUMNS order
+                    uint32  crc         crc32 of everything above
+                    uint32  reserved
+
+                Segments form a ring of maxSegments files; when the last is full the
+                oldest is reused.  A record torn by a power cut fails its CRC and is
+                skipped by the scanner, which also finds where to resume appending.
+
+                To export after landing:
+                    python -m services.flightlog export /var/www/webpy/data/flightlog /var/www/webpy/data/helium.db
+
+                The export only fills in what the database is missing.  The rows the
+                telemetry writer committed in flight carry the same time string as
+                their records (both come from rowTime() of one stamp), so records
+                whose (time, table) is already there are skipped.  The last exported
+                sequence is kept in <logdir>/exported and the next export starts
+                after it; pass a since-sequence to override that, e.g. 0 to recheck
+                the whole log.
+"""
+import datetime as utcclock
+import mmap
+import os
+import re
+import sqlite3 as sql
+import struct
+import sys
+import time
+import zlib
+
+RECORD_SENSORS = 1
+RECORD_FIX = 2
+
+SENSORS_COLUMNS = ('oat','iat','cput','bmpt','rh','accelx','accely','accelz','alt','bp','slp')
+FIX_COLUMNS = ('latitude','longitude','altitude','kts','trkangle','trkmag','quality','satcount')
+
+MAX_VALUES = 11
+BODY = struct.Struct('<IBBHd%dd' % MAX_VALUES)
+TRAILER = struct.Struct('<II')
+RECORD_SIZE = BODY.size + TRAILER.size          # 112
+
+SEGMENT_PATTERN = re.compile('^segment-(\d{4})\.log$')
+EXPORTED_FILE = 'exported'
+
+def rowTime(stamp):
+    """ the sensors/fixes time column for a unix timestamp; the flight loop and export
+    must agree on it for export to recognise rows already in the database """
+    return str(utcclock.datetime.fromtimestamp(stamp))
+
+def segmentPath(directory, index):
+    return os.path.join(directory, 'segment-%04d.log' % index)
+
+def decode(data, offset):
+    """ returns (sequence, kind, time, values) or None for an empty or damaged slot """
+    fields = BODY.unpack_from(data, offset)
+    if fields[0] == 0:
+        return None
+    (crc, reserved) = TRAILER.unpack_from(data, offset + BODY.size)
+    if zlib.crc32(data[offset:offset + BODY.size]) & 0xffffffff != crc:
+        return None
+    (sequence, kind, count, reserved, stamp) = fields[:5]
+    if count > MAX_VALUES:
+        return None
+    return (sequence, kind, stamp, fields[5:5 + count])
+
+def scan(directory):
+    """ recovery scanner: yields (segment, slot, record) for every intact record, unordered """
+    for name in sorted(os.listdir(directory)):
+        m = SEGMENT_PATTERN.match(name)
+        if m is None:
+            continue
+        f = open(os.path.join(directory, name), 'rb')
+        data = f.read()
+        f.close()
+        for slot in range(len(data) // RECORD_SIZE):
+            record = decode(data, slot * RECORD_SIZE)
+            if record is not None:
+                yield (int(m.group(1)), slot, record)
+
+class FlightLog:
+    def __init__(self, directory, segmentRecords=4096, maxSegments=16):
+        self.directory = directory
+        self.segmentRecords = segmentRecords
+        self.maxSegments = maxSegments
+        self.segmentSize = segmentRecords * RECORD_SIZE
+        self.map = None
+        self.appended = 0
+        self.damaged = 0
+        if not os.path.isdir(directory):
+            os.makedirs(directory)
+
+        """ resume after the newest intact record """
+        self.sequence = 0
+        segment = 0
+        slot = -1
+        for (s, n, record) in scan(directory):
+            if record[0] > self.sequence:
+                (self.sequence, segment, slot) = (record[0], s, n)
+        self._map(segment % maxSegments)
+        self.slot = slot + 1
+
+    def _map(self, index):
+        if self.map is not None:
+            self.map.close()
+        path = segmentPath(self.directory, index)
+        fd = os.open(path, os.O_RDWR | os.O_CREAT, 0644)
+        try:
+            if os.fstat(fd).st_size != self.segmentSize:
+                os.ftruncate(fd, self.segmentSize)
+            self.map = mmap.mmap(fd, self.segmentSize, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+        self.segment = index
+        self.slot = 0
+
+    def append(self, kind, stamp, values):
+        if len(values) > MAX_VALUES:
+            raise ValueError('a record holds at most %d values' % MAX_VALUES)
+        if self.slot >= self.segmentRecords:
+            self._map((self.segment + 1) % self.maxSegments)
+        self.sequence += 1
+        padded = tuple(float(v) for v in values) + (0.0,) * (MAX_VALUES - len(values))
+        body = BODY.pack(self.sequence, kind, len(values), 0, stamp, *padded)
+        offset = self.slot * RECORD_SIZE
+        self.map[offset:offset + RECORD_SIZE] = body + TRAILER.pack(zlib.crc32(body) & 0xffffffff, 0)
+        self.slot += 1
+        self.appended += 1
+        return self.sequence
+
+    def logSensors(self, *values, **kwargs):
+        """ values in SENSORS_COLUMNS order; stamp defaults to now """
+        return self.append(RECORD_SENSORS, kwargs.get('stamp', time.time()), values)
+
+    def logFix(self, *values, **kwargs):
+        """ values in FIX_COLUMNS order; stamp defaults to now """
+        return self.append(RECORD_FIX, kwargs.get('stamp', time.time()), values)
+
+    def sync(self):
+        """ force the current segment out to the card """
+        self.map.flush()
+
+    def close(self):
+        if self.map is not None:
+            self.map.flush()
+            self.map.close()
+            self.map = None
+
+def exportedSequence(directory):
+    """ the last sequence a previous export loaded, 0 if there was none """
+    try:
+        with open(os.path.join(directory, EXPORTED_FILE)) as f:
+            return int(f.read().strip() or 0)
+    except (IOError, ValueError):
+        return 0
+
+def saveExportedSequence(directory, sequence):
+    path = os.path.join(directory, EXPORTED_FILE)
+    with open(path + '.tmp', 'w') as f:
+        f.write('%d\n' % sequence)
+    os.rename(path + '.tmp', path)
+
+def export(directory, database, since=None):
+    """ bulk-load the intact records newer than since (by default, newer than the last
+    export) that the sensors/fixes tables don't already hold; returns
+    (sensors, fixes, last sequence) """
+    records = sorted(record for (segment, slot, record) in scan(directory))
+    if since is None:
+        since = exportedSequence(directory)
+        if records and since > records[-1][0]:
+            """ the log was cleared for a new flight since the last export """
+            since = 0
+    records = [record for record in records if record[0] > since]
+    con = sql.connect(database)
+    try:
+        sensorTimes = set(row[0] for row in con.execute("SELECT time FROM sensors"))
+        fixTimes = set(row[0] for row in con.execute("SELECT time FROM fixes"))
+        sensors = []
+        fixes = []
+        last = since
+        for (sequence, kind, stamp, values) in records:
+            when = rowTime(stamp)
+            if kind == RECORD_SENSORS and len(values) == len(SENSORS_COLUMNS) and when not in sensorTimes:
+                sensors.append((when,) + values)
+            elif kind == RECORD_FIX and len(values) == len(FIX_COLUMNS) and when not in fixTimes:
+                fixes.append(values[:6] + (when, int(values[6]), int(values[7])))
+            last = sequence
+        con.executemany("INSERT INTO sensors(time,%s) VALUES(?%s)" % (','.join(SENSORS_COLUMNS), ',?' * len(SENSORS_COLUMNS)), sensors)
+        con.executemany("INSERT INTO fixes(latitude,longitude,altitude,kts,trkangle,trkmag,time,quality,satcount) \
+                        VALUES(?,?,?,?,?,?,?,?,?)", fixes)
+        con.commit()
+    finally:
+        con.close()
+    saveExportedSequence(directory, last)
+    return (len(sensors), len(fixes), last)
+
+def main(argv):
+    if len(argv) >= 3 and argv[1] == 'scan':
+        records = sorted(record for (segment, slot, record) in scan(argv[2]))
+        gaps = sum(1 for i in range(1, len(records)) if records[i][0] != records[i - 1][0] + 1)
+        if records:
+            print "%d intact records, sequence %d..%d, %d gaps" % (len(records), records[0][0], records[-1][0], gaps)
+        else:
+            print "no intact records"
+        return 0
+    if len(argv) >= 4 and argv[1] == 'export':
+        since = int(argv[4]) if len(argv) > 4 else None
+        (sensors, fixes, last) = export(argv[2], argv[3], since)
+        print "exported %d sensors and %d fixes rows, last sequence %d" % (sensors, fixes, last)
+        return 0
+    print "Usage: %s scan <logdir> | export <logdir> <database> [since-sequence]" % argv[0]
+    return 1
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,166 @@
+#!/usr/bin/python
+
+""" scheduler module """
+
+""" Deadline scheduler for the flight loop
+
+                Tasks are kept in a min-heap ordered by their next deadline, so finding
+                the next thing to do is O(1) and the loop can sleep until then instead
+                of polling.  Periodic tasks are rescheduled from their previous deadline,
+                not from when they happened to run, so they don't drift.  A task that
+                falls a whole period or more behind counts an overrun and skips the
+                periods it missed rather than running them back to back.
+
+                All times are seconds on the monotonic clock.
+"""
+import ctypes
+import ctypes.util
+import heapq
+import os
+import time
+
+CLOCK_MONOTONIC = 1
+
+class _timespec(ctypes.Structure):
+    _fields_ = [('tv_sec', ctypes.c_long), ('tv_nsec', ctypes.c_long)]
+
+try:
+    _librt = ctypes.CDLL(ctypes.util.find_library('rt') or 'librt.so.1', use_errno=True)
+    _clock_gettime = _librt.clock_gettime
+    _clock_gettime.argtypes = [ctypes.c_int, ctypes.POINTER(_timespec)]
+except (OSError, AttributeError):
+    _clock_gettime = None
+
+def monotonic():
+    """ seconds since boot; wall clock steps (GPS/RTC sync) don't move it """
+    if _clock_gettime is None:
+        return time.time()
+    t = _timespec()
+    if _clock_gettime(CLOCK_MONOTONIC, ctypes.byref(t)) != 0:
+        errno = ctypes.get_errno()
+        raise OSError(errno, os.strerror(errno))
+    return t.tv_sec + t.tv_nsec * 1e-9
+
+class Task:
+    def __init__(self, name, vector, interval, deadline, phase=0.0):
+        self.name = name
+        self.vector = vector
+        self.interval = interval        # None for a one-shot task
+        self.phase = phase
+        self.deadline = deadline
+        self.cancelled = False
+        self.runs = 0
+        self.overruns = 0               # periods skipped because the task fell behind
+        self.maxLateness = 0.0          # worst start after the deadline
+        self.totalLateness = 0.0
+        self.maxDuration = 0.0
+        self.errors = 0
+
+    def stats(self):
+        mean = self.totalLateness / self.runs if self.runs else 0.0
+        return {'name': self.name, 'runs': self.runs, 'overruns': self.overruns,
+                'errors': self.errors, 'maxLateness': self.maxLateness,
+                'meanLateness': mean, 'maxDuration': self.maxDuration}
+
+class Scheduler:
+    def __init__(self, clock=monotonic, sleep=time.sleep):
+        self.clock = clock
+        self.sleep = sleep
+        self.start = clock()
+        self.heap = []
+        self.sequence = 0               # keeps equal deadlines in submission order
+        self.tasks = []
+
+    def _push(self, task):
+        heapq.heappush(self.heap, (task.deadline, self.sequence, task))
+        self.sequence += 1
+
+    def every(self, interval, vector, phase=0.0, name=None):
+        """ run vector every interval seconds, first at phase seconds after the scheduler started """
+        if interval <= 0:
+            raise ValueError('interval must be positive')
+        task = Task(name or vector.__name__, vector, interval, self.start + phase, phase)
+        self.tasks.append(task)
+        self._push(task)
+        return task
+
+    def once(self, delay, vector, name=None):
+        """ run vector once, delay seconds from now """
+        task = Task(name or vector.__name__, vector, None, self.clock() + delay)
+        self.tasks.append(task)
+        self._push(task)
+        return task
+
+    def restart(self):
+        """ start the periodic tasks' phases again from now, e.g. at launch """
+        self.start = self.clock()
+        for task in self.tasks:
+            if task.interval is not None:
+                task.deadline = self.start + task.phase
+        self.heap = []
+        for task in self.tasks:
+            self._push(task)
+
+    def cancel(self, task):
+        """ the heap entry is dropped lazily when it reaches the top """
+        task.cancelled = True
+        if task in self.tasks:
+            self.tasks.remove(task)
+
+    def nextDeadline(self):
+        while self.heap and self.heap[0][2].cancelled:
+            heapq.heappop(self.heap)
+        if not self.heap:
+            return None
+        return self.heap[0][0]
+
+    def runPending(self):
+        """ run every task whose deadline has passed; returns seconds until the next one (None if idle) """
+        now = self.clock()
+        while True:
+            deadline = self.nextDeadline()
+            if deadline is None or deadline > now:
+                break
+            (deadline, sequence, task) = heapq.heappop(self.heap)
+            lateness = now - deadline
+            task.runs += 1
+            task.totalLateness += lateness
+            task.maxLateness = max(task.maxLateness, lateness)
+            try:
+                task.vector()
+            except Exception, e:
+                task.errors += 1
+                print "ERROR | task %s failed: %s" % (task.name, e)
+            finished = self.clock()
+            task.maxDuration = max(task.maxDuration, finished - now)
+            now = finished
+
+            if task.interval is None:
+                if task in self.tasks:
+                    self.tasks.remove(task)
+                continue
+            if task.cancelled:
+                continue
+            task.deadline = deadline + task.interval
+            if task.deadline <= now:
+                """ fell at least a whole period behind; skip the missed periods """
+                missed = int((now - task.deadline) / task.interval) + 1
+                task.overruns += missed
+                task.deadline += missed * task.interval
+            self._push(task)
+
+        deadline = self.nextDeadline()
+        if deadline is None:
+            return None
+        return max(0.0, deadline - now)
+
+    def runAndSleep(self, limit=None):
+        """ run due tasks, then sleep until the next deadline (or at most limit seconds) """
+        wait = self.runPending()
+        if limit is not None and (wait is None or wait > limit):
+            wait = limit
+        if wait:
+            self.sleep(wait)
+
+    def stats(self):
+        return [task.stats() for task in self.tasks]
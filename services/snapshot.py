@@ -0,0 +1,138 @@
+#!/usr/bin/python
+
+""" snapshot module """
+
+""" Latest telemetry in POSIX shared memory
+
+                The flight process publishes one fixed-layout record of its latest
+                values to /dev/shm/helium_telemetry; the web front end and any other
+                reader map it read-only and take a consistent copy without touching
+                the I2C bus.  The record is guarded by a sequence lock: the writer
+                makes the sequence odd, writes the body, then makes it even again,
+                and a reader retries until it sees the same even sequence before
+                and after its copy.  There is a single writer.
+
+                Layout, little-endian (scripts/telemetry_snapshot.h has it for C):
+                    uint32  magic       SNAPSHOT_MAGIC
+                    uint32  size        of the whole record, to catch layout changes
+                    uint32  sequence
+                    uint32  reserved
+                    then FIELDS in order; doubles first so C packs it the same way
+
+                To publish: snap = snapshot.SnapshotWriter(); snap.publish(extemp=..., mode=...)
+                To read:    snapshot.SnapshotReader().read()   # dict of FIELDS
+"""
+import mmap
+import os
+import struct
+import time
+
+SNAPSHOT_SHM_PATH = '/dev/shm/helium_telemetry'
+SNAPSHOT_MAGIC = 0x484c4d31                 # 'HLM1'
+
+FIELDS = [
+    ('updated',     'd'),       # unix seconds of this publish
+    ('sensorTime',  'd'),       # unix seconds the sensor values were last refreshed
+    ('tempTime',    'd'),       # unix seconds extemp and intemp were converted
+    ('extemp',      'd'),       # C
+    ('intemp',      'd'),       # C
+    ('cputemp',     'd'),       # C
+    ('bmptemp',     'd'),       # C
+    ('humidity',    'd'),       # % RH
+    ('humidityConfidence', 'd'),    # 1 sigma uncertainty of humidity, % RH
+    ('pressure',    'd'),       # Pa
+    ('slp',         'd'),       # sea-level pressure, Pa
+    ('altitude',    'd'),       # barometric, m
+    ('accelx',      'd'),       # g
+    ('accely',      'd'),
+    ('accelz',      'd'),
+    ('fixTime',     'd'),       # unix seconds of the last GGA/VTG
+    ('latitude',    'd'),
+    ('longitude',   'd'),
+    ('gpsAltitude', 'd'),       # m
+    ('kts',         'd'),
+    ('trkangle',    'd'),
+    ('trkmag',      'd'),
+    ('mode',        'i'),       # HeliumMode
+    ('quality',     'i'),       # GGA fix quality
+    ('satcount',    'i'),
+    ('publishes',   'I'),
+]
+
+HEADER = struct.Struct('<IIII')
+BODY = struct.Struct('<' + ''.join(code for (name, code) in FIELDS))
+SNAPSHOT_SIZE = HEADER.size + BODY.size
+SEQUENCE = struct.Struct('<I')
+SEQUENCE_OFFSET = 8
+
+class SnapshotError(Exception):
+    pass
+
+class SnapshotWriter:
+    def __init__(self, path=SNAPSHOT_SHM_PATH):
+        fd = os.open(path, os.O_RDWR | os.O_CREAT, 0644)
+        try:
+            os.ftruncate(fd, SNAPSHOT_SIZE)
+            self.shm = mmap.mmap(fd, SNAPSHOT_SIZE, mmap.MAP_SHARED, mmap.PROT_READ | mmap.PROT_WRITE)
+        finally:
+            os.close(fd)
+        self.values = dict((name, 0) for (name, code) in FIELDS)
+        self.sequence = 0
+        self.shm[:] = '\0' * SNAPSHOT_SIZE
+        HEADER.pack_into(self.shm, 0, SNAPSHOT_MAGIC, SNAPSHOT_SIZE, 0, 0)
+
+    def publish(self, **values):
+        """ update the named fields and publish the whole record """
+        for name in values:
+            if name not in self.values:
+                raise KeyError(name)
+        self.values.update(values)
+        self.values['updated'] = time.time()
+        self.values['publishes'] = (self.values['publishes'] + 1) & 0xffffffff
+        body = BODY.pack(*[self.values[name] for (name, code) in FIELDS])
+
+        SEQUENCE.pack_into(self.shm, SEQUENCE_OFFSET, (self.sequence + 1) & 0xffffffff)
+        self.shm[HEADER.size:SNAPSHOT_SIZE] = body
+        self.sequence = (self.sequence + 2) & 0xffffffff
+        SEQUENCE.pack_into(self.shm, SEQUENCE_OFFSET, self.sequence)
+
+    def close(self):
+        self.shm.close()
+
+class SnapshotReader:
+    def __init__(self, path=SNAPSHOT_SHM_PATH):
+        try:
+            fd = os.open(path, os.O_RDONLY)
+        except OSError, e:
+            raise SnapshotError('no telemetry snapshot: %s' % e)
+        try:
+            if os.fstat(fd).st_size < SNAPSHOT_SIZE:
+                raise SnapshotError('telemetry snapshot is truncated')
+            self.shm = mmap.mmap(fd, SNAPSHOT_SIZE, mmap.MAP_SHARED, mmap.PROT_READ)
+        finally:
+            os.close(fd)
+        (magic, size, sequence, reserved) = HEADER.unpack_from(self.shm, 0)
+        if magic != SNAPSHOT_MAGIC or size != SNAPSHOT_SIZE:
+            self.shm.close()
+            raise SnapshotError('telemetry snapshot layout mismatch')
+
+    def read(self):
+        """ consistent copy of every field, retrying while the writer is mid-publish """
+        while True:
+            begin = SEQUENCE.unpack_from(self.shm, SEQUENCE_OFFSET)[0]
+            if begin & 1:
+                continue
+            body = self.shm[HEADER.size:SNAPSHOT_SIZE]
+            if SEQUENCE.unpack_from(self.shm, SEQUENCE_OFFSET)[0] == begin:
+                break
+        return dict(zip([name for (name, code) in FIELDS], BODY.unpack(body)))
+
+    def age(self):
+        """ seconds since the last publish, None if nothing has been published """
+        values = self.read()
+        if values['publishes'] == 0:
+            return None
+        return time.time() - values['updated']
+
+    def close(self):
+        self.shm.close()
@@ -0,0 +1,142 @@
+#!/usr/bin/python
+
+""" telemetry module """
+
+""" Batched SQLite writer for the sensors and fixes tables
+
+                One thread owns the only connection to the database, opened in WAL
+                mode, and inserts rows with prepared statements.  Producers hand rows
+                to a bounded in-memory queue and never touch the disk; the writer
+                commits when batchSize rows have built up or flushInterval seconds
+                have passed since the oldest uncommitted row, so the card sees one
+                fsync per batch instead of one journal rewrite per sample.
+
+                If the queue is full (the card has stalled) the row is dropped and
+                counted rather than blocking the flight loop.
+
+                To use: writer = telemetry.TelemetryWriter('/var/www/webpy/data/helium.db')
+                        writer.saveSensors(time, oat, iat, ...)
+                        writer.close()              # flushes what is queued
+"""
+import Queue
+import sqlite3 as sql
+import threading
+import time
+
+SENSORS_INSERT = """INSERT INTO sensors(time,oat,iat,cput,bmpt,rh,accelx,accely,accelz,alt,bp,slp) \
+                    VALUES(?,?,?,?,?,?,?,?,?,?,?,?)"""
+FIXES_INSERT = """INSERT INTO fixes(latitude,longitude,altitude,kts,trkangle,trkmag,time,quality,satcount) \
+                    VALUES(?,?,?,?,?,?,?,?,?)"""
+
+_STOP = object()
+
+class TelemetryWriter:
+    def __init__(self, path, batchSize=20, flushInterval=30.0, maxQueue=256):
+        self.path = path
+        self.batchSize = batchSize
+        self.flushInterval = flushInterval
+        self.queue = Queue.Queue(maxQueue)
+        self.written = 0
+        self.dropped = 0
+        self.commits = 0
+        self.errors = 0
+        self.thread = threading.Thread(target=self._run, name='telemetry')
+        self.thread.daemon = True
+        self.thread.start()
+
+    def saveSensors(self, *row):
+        """ queue one row for the sensors table; returns False if it was dropped """
+        return self._put(SENSORS_INSERT, row)
+
+    def saveFix(self, *row):
+        """ queue one row for the fixes table; returns False if it was dropped """
+        return self._put(FIXES_INSERT, row)
+
+    def _put(self, statement, row):
+        try:
+            self.queue.put_nowait((statement, row))
+            return True
+        except Queue.Full:
+            self.dropped += 1
+            return False
+
+    def close(self, timeout=None):
+        """ commit whatever is queued and close the database """
+        self.queue.put((_STOP, None))
+        self.thread.join(timeout)
+
+    def stats(self):
+        return {'written': self.written, 'dropped': self.dropped, 'commits': self.commits,
+                'errors': self.errors, 'queued': self.queue.qsize()}
+
+    def _connect(self):
+        con = sql.connect(self.path)
+        con.execute('PRAGMA journal_mode=WAL')
+        """ WAL only needs the fsync at checkpoints to stay consistent """
+        con.execute('PRAGMA synchronous=NORMAL')
+        return con
+
+    def _commit(self, con, batch):
+        """ one transaction per batch, one executemany per table """
+        statements = {}
+        for (statement, row) in batch:
+            statements.setdefault(statement, []).append(row)
+        try:
+            for statement in statements:
+                con.executemany(statement, statements[statement])
+            con.commit()
+            self.written += len(batch)
+            self.commits += 1
+        except sql.Error, e:
+            self.errors += 1
+            print "ERROR | telemetry batch of %d rows lost: %s" % (len(batch), e.args[0])
+            try:
+                con.rollback()
+            except sql.Error:
+                pass
+
+    def _run(self):
+        con = None
+        batch = []
+        oldest = None
+        while True:
+            timeout = None
+            if batch:
+                timeout = max(0.0, oldest + self.flushInterval - time.time())
+            try:
+                (statement, row) = self.queue.get(True, timeout)
+            except Queue.Empty:
+                statement = None
+
+            if statement is _STOP:
+                break
+            if statement is not None:
+                if not batch:
+                    oldest = time.time()
+                batch.append((statement, row))
+            if batch and (len(batch) >= self.batchSize or time.time() - oldest >= self.flushInterval):
+                if con is None:
+                    try:
+                        con = self._connect()
+                    except sql.Error, e:
+                        """ keep the rows and try again at the next trigger """
+                        self.errors += 1
+                        print "ERROR | cannot open %s: %s" % (self.path, e.args[0])
+                        oldest = time.time()
+                        if len(batch) > self.queue.maxsize:
+                            self.dropped += len(batch) - self.queue.maxsize
+                            del batch[:-self.queue.maxsize]
+                        continue
+                self._commit(con, batch)
+                batch = []
+
+        if batch:
+            try:
+                if con is None:
+                    con = self._connect()
+                self._commit(con, batch)
+            except sql.Error, e:
+                self.errors += 1
+                print "ERROR | cannot open %s: %s" % (self.path, e.args[0])
+        if con is not None:
+            con.close()
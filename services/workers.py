@@ -0,0 +1,151 @@
+#!/usr/bin/python
+
+""" workers module """
+
+""" Bounded worker pool for slow device reads
+
+                A fixed number of threads serve jobs submitted under a lane name, one
+                lane per device or service.  A lane runs at most one job at a time, so
+                a device is never read from two threads at once, and holds at most
+                depth jobs waiting behind the one that is running.  With the default
+                depth of 0 a submit while the previous run is still queued or busy is
+                skipped and counted, so a stuck 1-Wire conversion or gphoto2 capture
+                costs one worker instead of piling up a thread per tick.
+
+                The pool as a whole holds at most maxPending waiting jobs; submit()
+                never blocks, it returns False when the job was not accepted.
+"""
+import threading
+import time
+from collections import deque
+
+class Lane:
+    def __init__(self, name, depth):
+        self.name = name
+        self.depth = depth
+        self.pending = deque()          # (vector, args, submitted)
+        self.running = False
+        self.submitted = 0
+        self.completed = 0
+        self.skipped = 0                # rejected because the lane or the pool was full
+        self.errors = 0
+        self.maxWait = 0.0              # worst time from submit to start
+        self.maxDuration = 0.0
+
+    def stats(self):
+        return {'name': self.name, 'submitted': self.submitted, 'completed': self.completed,
+                'skipped': self.skipped, 'errors': self.errors, 'running': self.running,
+                'pending': len(self.pending), 'maxWait': self.maxWait,
+                'maxDuration': self.maxDuration}
+
+class WorkerPool:
+    def __init__(self, workers=2, maxPending=16):
+        self.maxPending = maxPending
+        self.lanes = {}
+        self.ready = deque()            # lanes with a job waiting and none running
+        self.queued = 0
+        self.stopping = False
+        self.condition = threading.Condition()
+        self.threads = []
+        for n in range(workers):
+            thread = threading.Thread(target=self._work, name='worker-%d' % n)
+            thread.daemon = True
+            thread.start()
+            self.threads.append(thread)
+
+    def lane(self, name, depth=0):
+        """ create or reconfigure a lane; depth is how many jobs may wait behind a running one """
+        self.condition.acquire()
+        try:
+            if name not in self.lanes:
+                self.lanes[name] = Lane(name, depth)
+            else:
+                self.lanes[name].depth = depth
+            return self.lanes[name]
+        finally:
+            self.condition.release()
+
+    def submit(self, name, vector, *args):
+        """ queue vector(*args) on the named lane; returns False if it was skipped """
+        self.condition.acquire()
+        try:
+            lane = self.lanes.get(name)
+            if lane is None:
+                lane = self.lanes[name] = Lane(name, 0)
+            if self.stopping or self.queued >= self.maxPending or \
+                    len(lane.pending) + lane.running > lane.depth:
+                lane.skipped += 1
+                return False
+            lane.pending.append((vector, args, time.time()))
+            lane.submitted += 1
+            self.queued += 1
+            if not lane.running and len(lane.pending) == 1:
+                self.ready.append(lane)
+                self.condition.notify()
+            return True
+        finally:
+            self.condition.release()
+
+    def busy(self, name):
+        """ True if the lane has a job running or waiting """
+        self.condition.acquire()
+        try:
+            lane = self.lanes.get(name)
+            return lane is not None and (lane.running or len(lane.pending) > 0)
+        finally:
+            self.condition.release()
+
+    def _work(self):
+        while True:
+            self.condition.acquire()
+            try:
+                while not self.ready and not self.stopping:
+                    self.condition.wait()
+                if not self.ready:
+                    return
+                lane = self.ready.popleft()
+                (vector, args, submitted) = lane.pending.popleft()
+                self.queued -= 1
+                lane.running = True
+            finally:
+                self.condition.release()
+
+            started = time.time()
+            failed = False
+            try:
+                vector(*args)
+            except Exception, e:
+                failed = True
+                print "ERROR | worker job %s failed: %s" % (lane.name, e)
+            finished = time.time()
+
+            self.condition.acquire()
+            try:
+                lane.running = False
+                lane.completed += 1
+                lane.errors += failed
+                lane.maxWait = max(lane.maxWait, started - submitted)
+                lane.maxDuration = max(lane.maxDuration, finished - started)
+                if lane.pending:
+                    self.ready.append(lane)
+                    self.condition.notify()
+            finally:
+                self.condition.release()
+
+    def shutdown(self, timeout=None):
+        """ run what is already queued, then stop the workers """
+        self.condition.acquire()
+        try:
+            self.stopping = True
+            self.condition.notifyAll()
+        finally:
+            self.condition.release()
+        for thread in self.threads:
+            thread.join(timeout)
+
+    def stats(self):
+        self.condition.acquire()
+        try:
+            return [lane.stats() for lane in self.lanes.values()]
+        finally:
+            self.condition.release()
@@ -1,11 +1,29 @@
 import web
 import time
-import os
+import json
 from devices import bmp085
 from devices import mcp2300x
 from devices import tmp102
 from devices import ds18xx
+from devices import ds1307
 from protocols import i2c
+from services import snapshot
+
+SNAPSHOT_MAX_AGE = 30           # seconds; older than this and helium.py isn't publishing
+
+def latestTelemetry():
+    """ the flight process's latest values, or None if it isn't running """
+    try:
+        reader = snapshot.SnapshotReader()
+    except snapshot.SnapshotError:
+        return None
+    try:
+        values = reader.read()
+    finally:
+        reader.close()
+    if values['publishes'] == 0 or time.time() - values['updated'] > SNAPSHOT_MAX_AGE:
+        return None
+    return values
 
 urls = (
     '/',                'index',
@@ -14,26 +32,38 @@ urls = (
     '/test/tmp102',     'testTMP102',
     '/test/ds18b20',    'testDS18B20',
     '/test/time',       'testDS1307',
-    '/test/altitude',   'getAltitude'
+    '/test/altitude',   'getAltitude',
+    '/telemetry',       'getTelemetry'
 )
 
+""" one RTC reader for the life of the server; it only goes to the chip every few
+minutes and advances its cached time in between """
+rtc = None
+
 class testDS1307:
     def GET(self):
-        text = os.popen("sudo hwclock -r").read()
-        components = text.split()
-        dateComponents = components[4].split(':')
+        global rtc
+        if rtc is None:
+            rtc = ds1307.DS1307()
+        stamp = rtc.now()
+        if stamp is None:
+            return "RTC is not readable"
         info = {}
-        info['hr'] = dateComponents[0]
-        info['min'] = dateComponents[1]
-        info['sec'] = dateComponents[2]
+        info['hr'] = '%02d' % stamp.hour
+        info['min'] = '%02d' % stamp.minute
+        info['sec'] = '%02d' % stamp.second
         template = web.template.render('templates/')
         web.header('Content-Type', 'text/html')
         return template.time(info)
         
 class getWorkshopTemp:
     def GET(self):
-        bmp = bmp085.BMP085(0x77)
-        temp = bmp.readTemperature();
+        telemetry = latestTelemetry()
+        if telemetry is not None:
+            temp = telemetry['bmptemp']
+        else:
+            bmp = bmp085.BMP085(0x77)
+            temp = bmp.readTemperature();
         
         template = web.template.render('templates/')
         web.header('Content-Type', 'text/html')
@@ -43,11 +73,22 @@ class getWorkshopTemp:
         
 class getAltitude:
     def GET(self):
+        telemetry = latestTelemetry()
+        if telemetry is not None:
+            return telemetry['altitude']
         bmp = bmp085.BMP085(0x77)
         alt = bmp.readAltitude();
         
         return alt
 
+class getTelemetry:
+    def GET(self):
+        telemetry = latestTelemetry()
+        if telemetry is None:
+            raise web.notfound()
+        web.header('Content-Type', 'application/json')
+        return json.dumps(telemetry)
+
 class testGPIO:
     def GET(self):        
         mcp = mcp2300x.MCP23017(0x20)